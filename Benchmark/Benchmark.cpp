@@ -0,0 +1,631 @@
+// Headless benchmarks for the model and render hot paths. Builds a
+// synthetic document and times drawing, picking, adding/removing shapes,
+// undo/redo, jumping through the history, transactions and export, then
+// writes the results as JSON so runs can be compared across releases.
+// Progress goes to stderr, so stdout only ever holds the results.
+#include <wx/app.h>
+#include <wx/init.h>
+#include <wx/cmdline.h>
+#include <wx/dcmemory.h>
+#include <wx/ffile.h>
+#include <wx/filename.h>
+#include <wx/image.h>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <random>
+#include <vector>
+#include "PaintModel.h"
+#include "PngWriter.h"
+#include "RasterImage.h"
+#include "SessionSnapshot.h"
+#include "TileRenderer.h"
+#include "DocumentGenerator.h"
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Bumped whenever the meaning of a result changes, so old numbers
+	// aren't compared against new ones
+	const int FORMAT_VERSION = 1;
+	const long DEFAULT_SHAPES = 2500;
+	const long DEFAULT_STROKE_POINTS = 200;
+	const long DEFAULT_RUNS = 5;
+	const long DEFAULT_SEED = 1;
+	const long DEFAULT_WIDTH = 1920;
+	const long DEFAULT_HEIGHT = 1080;
+	const int PICK_COUNT = 1000;
+	const int JUMP_COUNT = 100;
+	// Pixels each move in a transaction drags the shape by
+	const int TRANSACTION_MOVE = 5;
+	// Zoom used to time drawing a whole document shrunk onto the screen
+	const double ZOOMED_OUT_SCALE = 0.125;
+
+	const wxCmdLineEntryDesc COMMAND_LINE[] =
+	{
+		{ wxCMD_LINE_SWITCH, "h", "help", "show this help",
+			wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+		{ wxCMD_LINE_OPTION, "o", "output", "write the results to this file instead of stdout",
+			wxCMD_LINE_VAL_STRING, 0 },
+		{ wxCMD_LINE_OPTION, "n", "shapes", "shapes of each kind in the document (default 2500)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_OPTION, "p", "stroke-points", "samples in each pencil stroke (default 200)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_OPTION, "r", "runs", "times each benchmark is repeated (default 5)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_OPTION, "s", "seed", "seed for the document generator (default 1)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_OPTION, "W", "width", "canvas width (default 1920)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_OPTION, "H", "height", "canvas height (default 1080)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_SWITCH, "v", "verify", "also check that transactions undo, redo and load back right, failing if not",
+			wxCMD_LINE_VAL_NONE, 0 },
+		wxCMD_LINE_DESC_END
+	};
+
+	struct Options
+	{
+		wxString mOutput;
+		long mShapes;
+		long mStrokePoints;
+		long mRuns;
+		long mSeed;
+		wxSize mSize;
+		bool mVerify;
+	};
+
+	// Timings of one benchmark, in milliseconds per run
+	struct Result
+	{
+		wxString mName;
+		// Operations done by each run, e.g. shapes drawn
+		size_t mOps;
+		std::vector<double> mTimes;
+		// Why the benchmark didn't run, if it didn't
+		wxString mSkipped;
+	};
+
+	double ElapsedMs(Clock::time_point start)
+	{
+		return std::chrono::duration<double, std::milli>(Clock::now() - start).count();
+	}
+
+	// Records the times of a benchmark that ran and prints the best one
+	Result Report(const wxString& name, size_t ops, const std::vector<double>& times)
+	{
+		Result result;
+		result.mName = name;
+		result.mOps = ops;
+		result.mTimes = times;
+		wxFprintf(stderr, "%-28s %10.3f ms\n", name, *std::min_element(times.begin(), times.end()));
+		return result;
+	}
+
+	// Times body, runs times over
+	Result Measure(const wxString& name, size_t ops, long runs, std::function<void()> body)
+	{
+		std::vector<double> times;
+		for (long i = 0; i < runs; i++)
+		{
+			Clock::time_point start = Clock::now();
+			body();
+			times.push_back(ElapsedMs(start));
+		}
+		return Report(name, ops, times);
+	}
+
+	Result Skip(const wxString& name, const wxString& reason)
+	{
+		Result result;
+		result.mName = name;
+		result.mOps = 0;
+		result.mSkipped = reason;
+		wxFprintf(stderr, "%-28s skipped: %s\n", name, reason);
+		return result;
+	}
+
+	bool ParseOptions(int argc, char** argv, Options& options)
+	{
+		wxCmdLineParser parser(COMMAND_LINE, argc, argv);
+		if (parser.Parse() != 0)
+		{
+			return false;
+		}
+		options.mShapes = DEFAULT_SHAPES;
+		options.mStrokePoints = DEFAULT_STROKE_POINTS;
+		options.mRuns = DEFAULT_RUNS;
+		options.mSeed = DEFAULT_SEED;
+		long width = DEFAULT_WIDTH;
+		long height = DEFAULT_HEIGHT;
+		parser.Found("o", &options.mOutput);
+		parser.Found("n", &options.mShapes);
+		parser.Found("p", &options.mStrokePoints);
+		parser.Found("r", &options.mRuns);
+		parser.Found("s", &options.mSeed);
+		parser.Found("W", &width);
+		parser.Found("H", &height);
+		options.mVerify = parser.Found("v");
+		if (options.mShapes < 1 || options.mStrokePoints < 2 || options.mRuns < 1 ||
+			width < 1 || height < 1)
+		{
+			wxFprintf(stderr, "Shapes, runs and the canvas size must be positive, "
+				"and strokes need at least 2 points.\n");
+			return false;
+		}
+		options.mSize = wxSize(width, height);
+		return true;
+	}
+
+	void BuildDocument(PaintModel& model, const Options& options, std::vector<Result>& results)
+	{
+		// Each kind is timed separately, on top of the kinds before it.
+		// The document left behind by the last run is the one the rest of
+		// the benchmarks work on.
+		std::vector<double> rects, ellipses, lines, strokes;
+		for (long i = 0; i < options.mRuns; i++)
+		{
+			model.New();
+			model.SetSize(options.mSize);
+			DocumentGenerator generator(options.mSize, static_cast<unsigned int>(options.mSeed));
+			Clock::time_point start = Clock::now();
+			generator.AddRects(model, options.mShapes);
+			rects.push_back(ElapsedMs(start));
+			start = Clock::now();
+			generator.AddEllipses(model, options.mShapes);
+			ellipses.push_back(ElapsedMs(start));
+			start = Clock::now();
+			generator.AddLines(model, options.mShapes);
+			lines.push_back(ElapsedMs(start));
+			start = Clock::now();
+			generator.AddStrokes(model, options.mShapes, options.mStrokePoints);
+			strokes.push_back(ElapsedMs(start));
+			model.ClearDamage();
+		}
+		results.push_back(Report("build.rects", options.mShapes, rects));
+		results.push_back(Report("build.ellipses", options.mShapes, ellipses));
+		results.push_back(Report("build.lines", options.mShapes, lines));
+		results.push_back(Report("build.strokes", options.mShapes, strokes));
+	}
+
+	void BenchmarkDrawing(PaintModel& model, const Options& options, bool gui,
+		std::vector<Result>& results)
+	{
+		size_t count = options.mShapes * 4;
+		if (!gui)
+		{
+			results.push_back(Skip("draw.memorydc", "no display"));
+			results.push_back(Skip("draw.memorydc.zoomed_out", "no display"));
+			return;
+		}
+
+		wxBitmap bitmap(options.mSize);
+		wxMemoryDC dc(bitmap);
+		dc.SetBackground(*wxWHITE_BRUSH);
+		results.push_back(Measure("draw.memorydc", count, options.mRuns, [&]()
+		{
+			dc.Clear();
+			model.DrawShapes(dc, false);
+		}));
+		// Most shapes shrink to a few pixels and take the dot path
+		results.push_back(Measure("draw.memorydc.zoomed_out", count, options.mRuns, [&]()
+		{
+			dc.SetUserScale(1.0, 1.0);
+			dc.Clear();
+			dc.SetUserScale(ZOOMED_OUT_SCALE, ZOOMED_OUT_SCALE);
+			model.DrawShapes(dc, false);
+		}));
+		dc.SetUserScale(1.0, 1.0);
+		dc.SelectObject(wxNullBitmap);
+	}
+
+	void BenchmarkEditing(PaintModel& model, const Options& options, std::vector<Result>& results)
+	{
+		std::mt19937 random(options.mSeed);
+		std::uniform_int_distribution<int> x(0, options.mSize.GetWidth() - 1);
+		std::uniform_int_distribution<int> y(0, options.mSize.GetHeight() - 1);
+		std::vector<wxPoint> points;
+		for (int i = 0; i < PICK_COUNT; i++)
+		{
+			points.push_back(wxPoint(x(random), y(random)));
+		}
+		results.push_back(Measure("select", points.size(), options.mRuns, [&]()
+		{
+			for (const wxPoint& point : points)
+			{
+				model.SelectShape(point);
+			}
+		}));
+		model.UnSelectShape();
+		model.ClearDamage();
+
+		std::vector<const Shape*> order;
+		model.GetDrawOrder(order);
+		std::vector<std::shared_ptr<Shape>> shapes;
+		for (const Shape* shape : order)
+		{
+			shapes.push_back(model.GetShape(shape->GetId()));
+		}
+		// Removing and adding back puts every shape at its old z, so the
+		// document is the same after each pair of runs
+		std::vector<double> removes, adds;
+		for (long i = 0; i < options.mRuns; i++)
+		{
+			Clock::time_point start = Clock::now();
+			for (const std::shared_ptr<Shape>& shape : shapes)
+			{
+				model.RemoveShape(shape);
+			}
+			removes.push_back(ElapsedMs(start));
+			model.ClearDamage();
+			start = Clock::now();
+			for (const std::shared_ptr<Shape>& shape : shapes)
+			{
+				model.AddShape(shape);
+			}
+			adds.push_back(ElapsedMs(start));
+			model.ClearDamage();
+		}
+		results.push_back(Report("remove_shape", shapes.size(), removes));
+		results.push_back(Report("add_shape", shapes.size(), adds));
+
+		// Same idea for the history: undo everything, then redo it all
+		std::vector<double> undos, redos;
+		size_t commands = 0;
+		for (long i = 0; i < options.mRuns; i++)
+		{
+			commands = 0;
+			Clock::time_point start = Clock::now();
+			while (model.CanUndo())
+			{
+				model.Undo();
+				commands++;
+			}
+			undos.push_back(ElapsedMs(start));
+			model.ClearDamage();
+			start = Clock::now();
+			while (model.CanRedo())
+			{
+				model.Redo();
+			}
+			redos.push_back(ElapsedMs(start));
+			model.ClearDamage();
+		}
+		results.push_back(Report("undo", commands, undos));
+		results.push_back(Report("redo", commands, redos));
+
+		// Jumps all over the history like dragging the history slider does,
+		// ending back at the last revision so every run makes the same jumps
+		std::uniform_int_distribution<size_t> revision(0, model.GetLastRevision());
+		std::vector<size_t> revisions;
+		for (int i = 0; i < JUMP_COUNT - 1; i++)
+		{
+			revisions.push_back(revision(random));
+		}
+		revisions.push_back(model.GetLastRevision());
+		results.push_back(Measure("go_to_revision", revisions.size(), options.mRuns, [&]()
+		{
+			for (size_t target : revisions)
+			{
+				model.GoToRevision(target);
+				model.ClearDamage();
+			}
+		}));
+	}
+
+	// Starts a new document and adds steps to it, each grouped in a
+	// transaction with one nested in it, the way a scripted bulk edit
+	// would: a rect, two moves and two restyles of it, which merge, and a
+	// line. The same options always make the same document.
+	void AddTransactions(PaintModel& model, const Options& options, size_t steps)
+	{
+		model.New();
+		model.SetSize(options.mSize);
+		DocumentGenerator generator(options.mSize, static_cast<unsigned int>(options.mSeed));
+		for (size_t i = 0; i < steps; i++)
+		{
+			model.BeginTransaction();
+			generator.AddRects(model, 1);
+			model.SelectShape(model.GetNextShapeId() - 1);
+			model.BeginTransaction();
+			wxPoint point, botRight;
+			model.GetSelectedShape()->GetBounds(point, botRight);
+			for (int j = 0; j < 2; j++)
+			{
+				model.CreateCommand(CM_Move, point);
+				point += wxPoint(TRANSACTION_MOVE, TRANSACTION_MOVE);
+				model.UpdateCommand(point);
+				model.FinalizeCommand();
+			}
+			for (int j = 1; j <= 2; j++)
+			{
+				model.SetPenWidth(j);
+				model.SetPenCommand();
+			}
+			model.CommitTransaction();
+			model.UnSelectShape();
+			generator.AddLines(model, 1);
+			model.CommitTransaction();
+		}
+	}
+
+	// Writes model's session to a new temporary file and returns its name,
+	// or an empty string if it can't be written
+	wxString WriteSession(PaintModel& model)
+	{
+		wxString filename = wxFileName::CreateTempFileName("paint");
+		if (filename.empty())
+		{
+			return filename;
+		}
+		SessionSnapshot snapshot;
+		model.CaptureSession(snapshot);
+		std::atomic<bool> cancel(false);
+		if (!snapshot.Write(filename, cancel))
+		{
+			return wxString();
+		}
+		return filename;
+	}
+
+	// Times transactions with nothing of the history kept in memory, so
+	// every compound command goes through the spill file on the way to
+	// being undone and redone, and loading the session back as recovering
+	// it would
+	void BenchmarkTransactions(const Options& options, std::vector<Result>& results)
+	{
+		std::shared_ptr<PaintModel> model = std::make_shared<PaintModel>();
+		model->SetHistoryBudget(0);
+		size_t count = options.mShapes;
+		std::vector<double> commits, undos, redos;
+		for (long i = 0; i < options.mRuns; i++)
+		{
+			Clock::time_point start = Clock::now();
+			AddTransactions(*model, options, count);
+			commits.push_back(ElapsedMs(start));
+			model->ClearDamage();
+			start = Clock::now();
+			while (model->CanUndo())
+			{
+				model->Undo();
+			}
+			undos.push_back(ElapsedMs(start));
+			model->ClearDamage();
+			start = Clock::now();
+			while (model->CanRedo())
+			{
+				model->Redo();
+			}
+			redos.push_back(ElapsedMs(start));
+			model->ClearDamage();
+		}
+		results.push_back(Report("transaction.commit", count, commits));
+		results.push_back(Report("transaction.undo", count, undos));
+		results.push_back(Report("transaction.redo", count, redos));
+
+		wxString filename = WriteSession(*model);
+		if (filename.empty())
+		{
+			results.push_back(Skip("transaction.load_session", "no temporary file"));
+			return;
+		}
+		std::shared_ptr<PaintModel> loaded = std::make_shared<PaintModel>();
+		loaded->SetHistoryBudget(0);
+		results.push_back(Measure("transaction.load_session", count, options.mRuns, [&]()
+		{
+			loaded->LoadSession(filename);
+		}));
+		wxRemoveFile(filename);
+	}
+
+	// Checks that the transactions BenchmarkTransactions times make one
+	// command each, and that undoing, redoing and jumping through them,
+	// spilled, and through the session loaded back leave the same
+	// documents as adding fewer of them does. Returns false, saying what
+	// differs, if anything does.
+	bool VerifyTransactions(const Options& options)
+	{
+		size_t count = options.mShapes;
+		std::shared_ptr<PaintModel> reference = std::make_shared<PaintModel>();
+		AddTransactions(*reference, options, 0);
+		uint64_t firstHash = reference->GetDocumentHash();
+		AddTransactions(*reference, options, count / 2);
+		uint64_t halfHash = reference->GetDocumentHash();
+		AddTransactions(*reference, options, count);
+		uint64_t lastHash = reference->GetDocumentHash();
+		reference.reset();
+
+		std::shared_ptr<PaintModel> model = std::make_shared<PaintModel>();
+		model->SetHistoryBudget(0);
+		AddTransactions(*model, options, count);
+		// One command for each outermost transaction
+		if (model->GetLastRevision() != count || model->GetDocumentHash() != lastHash)
+		{
+			wxFprintf(stderr, "Transactions didn't make one command each.\n");
+			return false;
+		}
+		while (model->CanUndo())
+		{
+			model->Undo();
+		}
+		bool same = model->GetDocumentHash() == firstHash;
+		while (model->CanRedo())
+		{
+			model->Redo();
+		}
+		same = same && model->GetDocumentHash() == lastHash;
+		model->GoToRevision(count / 2);
+		same = same && model->GetDocumentHash() == halfHash;
+		model->GoToRevision(count);
+		if (!same)
+		{
+			wxFprintf(stderr, "Undoing and redoing transactions changed the document.\n");
+			return false;
+		}
+
+		wxString filename = WriteSession(*model);
+		if (filename.empty())
+		{
+			wxFprintf(stderr, "Cannot write the session to a temporary file.\n");
+			return false;
+		}
+		std::shared_ptr<PaintModel> loaded = std::make_shared<PaintModel>();
+		loaded->SetHistoryBudget(0);
+		same = loaded->LoadSession(filename);
+		wxRemoveFile(filename);
+		same = same && loaded->GetLastRevision() == count && loaded->GetDocumentHash() == lastHash;
+		loaded->GoToRevision(count / 2);
+		same = same && loaded->GetDocumentHash() == halfHash;
+		loaded->GoToRevision(0);
+		same = same && loaded->GetDocumentHash() == firstHash;
+		loaded->GoToRevision(count);
+		same = same && loaded->GetDocumentHash() == lastHash;
+		if (!same)
+		{
+			wxFprintf(stderr, "The loaded session differs from the one saved.\n");
+		}
+		return same;
+	}
+
+	void BenchmarkExport(PaintModel& model, const Options& options, std::vector<Result>& results)
+	{
+		size_t count = options.mShapes * 4;
+		RasterImage raster(options.mSize.GetWidth(), options.mSize.GetHeight());
+		TileRenderer renderer;
+		results.push_back(Measure("export.render", count, options.mRuns, [&]()
+		{
+			renderer.Render(model, raster);
+		}));
+
+		wxString filename = wxFileName::CreateTempFileName("paint");
+		if (filename.empty())
+		{
+			results.push_back(Skip("export.png", "no temporary file"));
+			results.push_back(Skip("export.jpeg", "no temporary file"));
+			return;
+		}
+		size_t pixels = static_cast<size_t>(raster.GetWidth()) * raster.GetHeight();
+		PngWriter writer;
+		results.push_back(Measure("export.png", pixels, options.mRuns, [&]()
+		{
+			writer.Write(raster, filename);
+		}));
+		// wx's own encoder, which JPEG (and BMP) exports go through
+		results.push_back(Measure("export.jpeg", pixels, options.mRuns, [&]()
+		{
+			raster.ToImage().SaveFile(filename, wxBITMAP_TYPE_JPEG);
+		}));
+		wxRemoveFile(filename);
+	}
+
+	wxString FormatResults(const Options& options, const std::vector<Result>& results)
+	{
+		wxString json;
+		json << "{\n";
+		json << wxString::Format("  \"version\": %d,\n", FORMAT_VERSION);
+		json << wxString::Format("  \"config\": {\"width\": %d, \"height\": %d, \"shapes_per_kind\": %ld, "
+			"\"stroke_points\": %ld, \"seed\": %ld, \"runs\": %ld},\n",
+			options.mSize.GetWidth(), options.mSize.GetHeight(), options.mShapes,
+			options.mStrokePoints, options.mSeed, options.mRuns);
+		json << "  \"results\": [\n";
+		for (size_t i = 0; i < results.size(); i++)
+		{
+			const Result& result = results[i];
+			json << "    {\"name\": \"" << result.mName << "\", ";
+			if (!result.mSkipped.empty())
+			{
+				json << "\"skipped\": \"" << result.mSkipped << "\"}";
+			}
+			else
+			{
+				std::vector<double> sorted = result.mTimes;
+				std::sort(sorted.begin(), sorted.end());
+				double total = 0.0;
+				json << wxString::Format("\"ops\": %lu, \"times_ms\": [",
+					static_cast<unsigned long>(result.mOps));
+				for (size_t j = 0; j < result.mTimes.size(); j++)
+				{
+					total += result.mTimes[j];
+					json << wxString::Format(j == 0 ? "%.3f" : ", %.3f", result.mTimes[j]);
+				}
+				double median = sorted[sorted.size() / 2];
+				if (sorted.size() % 2 == 0)
+				{
+					median = (median + sorted[sorted.size() / 2 - 1]) / 2.0;
+				}
+				json << wxString::Format("], \"min_ms\": %.3f, \"median_ms\": %.3f, \"mean_ms\": %.3f, "
+					"\"ops_per_sec\": %.1f}",
+					sorted.front(), median, total / sorted.size(),
+					median > 0.0 ? result.mOps * 1000.0 / median : 0.0);
+			}
+			json << (i + 1 < results.size() ? ",\n" : "\n");
+		}
+		json << "  ]\n}\n";
+		return json;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	// wxBitmap and wxMemoryDC need the GUI up, which on GTK means a
+	// display; without one (e.g. on a build server) the DC benchmarks are
+	// skipped and everything else still runs. Use xvfb-run to get them.
+#ifdef __WXGTK__
+	bool gui = wxGetenv("DISPLAY") != nullptr || wxGetenv("WAYLAND_DISPLAY") != nullptr;
+#else
+	bool gui = true;
+#endif
+	if (gui)
+	{
+		wxApp::SetInstance(new wxApp());
+	}
+	if (!wxEntryStart(argc, argv))
+	{
+		wxFprintf(stderr, "Failed to initialize wxWidgets.\n");
+		return 1;
+	}
+
+	Options options;
+	if (!ParseOptions(argc, argv, options))
+	{
+		wxEntryCleanup();
+		return 1;
+	}
+	wxInitAllImageHandlers();
+
+	std::vector<Result> results;
+	std::shared_ptr<PaintModel> model = std::make_shared<PaintModel>();
+	BuildDocument(*model, options, results);
+	BenchmarkDrawing(*model, options, gui, results);
+	BenchmarkEditing(*model, options, results);
+	BenchmarkTransactions(options, results);
+	BenchmarkExport(*model, options, results);
+	model.reset();
+
+	wxString json = FormatResults(options, results);
+	int status = 0;
+	// Kept out of the timed runs, so they measure the same work either way
+	if (options.mVerify && !VerifyTransactions(options))
+	{
+		status = 1;
+	}
+	if (options.mOutput.empty())
+	{
+		fputs(json.utf8_str(), stdout);
+	}
+	else
+	{
+		wxFFile file(options.mOutput, "w");
+		if (!file.IsOpened() || !file.Write(json))
+		{
+			wxFprintf(stderr, "Cannot write '%s'.\n", options.mOutput);
+			status = 1;
+		}
+	}
+	wxEntryCleanup();
+	return status;
+}
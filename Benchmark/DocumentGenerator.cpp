@@ -0,0 +1,92 @@
+#include "DocumentGenerator.h"
+#include "PaintModel.h"
+#include <algorithm>
+
+namespace
+{
+	const wxColour PALETTE[] =
+	{
+		wxColour(0, 0, 0), wxColour(255, 255, 255), wxColour(128, 128, 128),
+		wxColour(200, 30, 30), wxColour(30, 160, 50), wxColour(40, 70, 200),
+		wxColour(240, 200, 20), wxColour(250, 130, 20), wxColour(140, 50, 170),
+		wxColour(20, 170, 180), wxColour(120, 70, 30), wxColour(250, 150, 180)
+	};
+	const int PALETTE_SIZE = sizeof(PALETTE) / sizeof(PALETTE[0]);
+	const int MAX_PEN_WIDTH = 8;
+	// Dragged shapes span at most this fraction of the canvas
+	const int SHAPE_DIVISOR = 8;
+	// Largest distance between two pencil samples
+	const int STROKE_STEP = 6;
+}
+
+DocumentGenerator::DocumentGenerator(const wxSize& size, unsigned int seed)
+: mSize(size)
+, mRandom(seed)
+{
+}
+
+void DocumentGenerator::AddRects(PaintModel& model, int count)
+{
+	AddDragged(model, CM_DrawRect, count);
+}
+
+void DocumentGenerator::AddEllipses(PaintModel& model, int count)
+{
+	AddDragged(model, CM_DrawEllipse, count);
+}
+
+void DocumentGenerator::AddLines(PaintModel& model, int count)
+{
+	AddDragged(model, CM_DrawLine, count);
+}
+
+void DocumentGenerator::AddStrokes(PaintModel& model, int count, int pointCount)
+{
+	for (int i = 0; i < count; i++)
+	{
+		SetRandomStyle(model);
+		wxPoint point = RandomPoint();
+		model.CreateCommand(CM_DrawPencil, point);
+		for (int j = 1; j < pointCount; j++)
+		{
+			point.x = std::max(0, std::min(mSize.GetWidth() - 1, point.x + RandomInt(-STROKE_STEP, STROKE_STEP)));
+			point.y = std::max(0, std::min(mSize.GetHeight() - 1, point.y + RandomInt(-STROKE_STEP, STROKE_STEP)));
+			model.UpdateCommand(point);
+		}
+		model.FinalizeCommand();
+	}
+}
+
+void DocumentGenerator::AddDragged(PaintModel& model, CommandType commandType, int count)
+{
+	int maxWidth = std::max(2, mSize.GetWidth() / SHAPE_DIVISOR);
+	int maxHeight = std::max(2, mSize.GetHeight() / SHAPE_DIVISOR);
+	for (int i = 0; i < count; i++)
+	{
+		SetRandomStyle(model);
+		wxPoint start = RandomPoint();
+		wxPoint end(start.x + RandomInt(-maxWidth, maxWidth), start.y + RandomInt(-maxHeight, maxHeight));
+		model.CreateCommand(commandType, start);
+		// A drag always passes through a few points before it's released
+		model.UpdateCommand(wxPoint((start.x + end.x) / 2, (start.y + end.y) / 2));
+		model.UpdateCommand(end);
+		model.FinalizeCommand();
+	}
+}
+
+void DocumentGenerator::SetRandomStyle(PaintModel& model)
+{
+	model.SetPenColor(PALETTE[RandomInt(0, PALETTE_SIZE - 1)]);
+	model.SetPenWidth(RandomInt(1, MAX_PEN_WIDTH));
+	model.SetBrushColor(PALETTE[RandomInt(0, PALETTE_SIZE - 1)]);
+}
+
+wxPoint DocumentGenerator::RandomPoint()
+{
+	return wxPoint(RandomInt(0, mSize.GetWidth() - 1), RandomInt(0, mSize.GetHeight() - 1));
+}
+
+int DocumentGenerator::RandomInt(int min, int max)
+{
+	return std::uniform_int_distribution<int>(min, max)(mRandom);
+}
@@ -0,0 +1,38 @@
+#pragma once
+#include <random>
+#include <wx/gdicmn.h>
+#include "Command.h"
+
+class PaintModel;
+
+// Fills a model with random shapes for benchmarking. Shapes are drawn
+// through the same commands the mouse handlers use, so every one of them
+// ends up on the undo stack just like it would in a real document. On a
+// given platform the same seed always produces the same document.
+class DocumentGenerator
+{
+public:
+	DocumentGenerator(const wxSize& size, unsigned int seed);
+
+	void AddRects(PaintModel& model, int count);
+
+	void AddEllipses(PaintModel& model, int count);
+
+	void AddLines(PaintModel& model, int count);
+	// Freehand strokes of pointCount samples each, wandering like a hand
+	// would rather than jumping around the canvas
+	void AddStrokes(PaintModel& model, int count, int pointCount);
+private:
+	// Drags out a two point shape between random corners
+	void AddDragged(PaintModel& model, CommandType commandType, int count);
+	// Picks the pen and brush for the next shape from a small palette, so
+	// documents reuse styles the way drawings do
+	void SetRandomStyle(PaintModel& model);
+
+	wxPoint RandomPoint();
+
+	int RandomInt(int min, int max);
+
+	wxSize mSize;
+	std::mt19937 mRandom;
+};
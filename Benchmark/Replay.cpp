@@ -0,0 +1,213 @@
+// Plays an input recording made with File>Record Input against a fresh
+// model, without a window, and reports how long each kind of event took
+// along with a hash of the resulting document. Replays are deterministic,
+// so the hash catches changes in behavior while the latencies catch
+// changes in speed.
+#include <wx/init.h>
+#include <wx/cmdline.h>
+#include <wx/ffile.h>
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <vector>
+#include "PaintModel.h"
+#include "InputController.h"
+#include "InputRecording.h"
+
+namespace
+{
+	typedef std::chrono::steady_clock Clock;
+
+	// Bumped whenever the meaning of a result changes
+	const int FORMAT_VERSION = 1;
+	const long DEFAULT_RUNS = 5;
+
+	// Exit codes, so scripts can tell a wrong document from a broken run
+	const int EXIT_FAILED = 1;
+	const int EXIT_HASH_MISMATCH = 2;
+	const int EXIT_NOT_DETERMINISTIC = 3;
+
+	const wxCmdLineEntryDesc COMMAND_LINE[] =
+	{
+		{ wxCMD_LINE_SWITCH, "h", "help", "show this help",
+			wxCMD_LINE_VAL_NONE, wxCMD_LINE_OPTION_HELP },
+		{ wxCMD_LINE_OPTION, "o", "output", "write the results to this file instead of stdout",
+			wxCMD_LINE_VAL_STRING, 0 },
+		{ wxCMD_LINE_OPTION, "r", "runs", "times the recording is played (default 5)",
+			wxCMD_LINE_VAL_NUMBER, 0 },
+		{ wxCMD_LINE_OPTION, "e", "expect-hash", "fail unless the document hash is this (hex)",
+			wxCMD_LINE_VAL_STRING, 0 },
+		{ wxCMD_LINE_PARAM, nullptr, nullptr, "recording",
+			wxCMD_LINE_VAL_STRING, 0 },
+		wxCMD_LINE_DESC_END
+	};
+
+	double Percentile(const std::vector<double>& sorted, double percent)
+	{
+		// Nearest rank, so every reported value is one that was measured
+		size_t rank = static_cast<size_t>(percent / 100.0 * sorted.size() + 0.999999);
+		return sorted[std::min(sorted.size(), std::max<size_t>(rank, 1)) - 1];
+	}
+
+	wxString FormatLatencies(std::vector<double> samples)
+	{
+		std::sort(samples.begin(), samples.end());
+		double total = 0.0;
+		for (double sample : samples)
+		{
+			total += sample;
+		}
+		return wxString::Format("{\"count\": %lu, \"p50\": %.2f, \"p90\": %.2f, \"p99\": %.2f, "
+			"\"max\": %.2f, \"total\": %.2f}",
+			static_cast<unsigned long>(samples.size()), Percentile(samples, 50.0),
+			Percentile(samples, 90.0), Percentile(samples, 99.0), samples.back(), total);
+	}
+
+	// Quotes text as a JSON string
+	wxString QuoteJson(const wxString& text)
+	{
+		wxString quoted = "\"";
+		for (wxUniChar c : text)
+		{
+			if (c == '"' || c == '\\')
+			{
+				quoted << '\\' << c;
+			}
+			else if (c < 0x20)
+			{
+				quoted << wxString::Format("\\u%04x", static_cast<unsigned>(c.GetValue()));
+			}
+			else
+			{
+				quoted << c;
+			}
+		}
+		return quoted << "\"";
+	}
+
+	// Plays every event once on a new model, adding each one's latency, in
+	// microseconds, to the samples of its type; returns the document hash
+	uint64_t Replay(const InputRecording& recording, std::vector<std::vector<double>>& latencies)
+	{
+		std::shared_ptr<PaintModel> model = std::make_shared<PaintModel>();
+		InputController input(model);
+		for (const InputEvent& event : recording.GetEvents())
+		{
+			Clock::time_point start = Clock::now();
+			input.Apply(event);
+			double elapsed = std::chrono::duration<double, std::micro>(Clock::now() - start).count();
+			latencies[event.mType].push_back(elapsed);
+			// Stands in for the repaint that would follow, so the damage
+			// region doesn't grow over the whole replay
+			model->ClearDamage();
+		}
+		return model->GetDocumentHash();
+	}
+}
+
+int main(int argc, char** argv)
+{
+	wxInitializer initializer(argc, argv);
+	if (!initializer.IsOk())
+	{
+		wxFprintf(stderr, "Failed to initialize wxWidgets.\n");
+		return EXIT_FAILED;
+	}
+
+	wxCmdLineParser parser(COMMAND_LINE, argc, argv);
+	if (parser.Parse() != 0)
+	{
+		return EXIT_FAILED;
+	}
+	long runs = DEFAULT_RUNS;
+	wxString output;
+	wxString expected;
+	parser.Found("r", &runs);
+	parser.Found("o", &output);
+	bool checkHash = parser.Found("e", &expected);
+	wxString filename = parser.GetParam(0);
+	if (runs < 1)
+	{
+		wxFprintf(stderr, "Runs must be positive.\n");
+		return EXIT_FAILED;
+	}
+
+	InputRecording recording;
+	if (!recording.Load(filename))
+	{
+		wxFprintf(stderr, "Cannot read recording '%s'.\n", filename);
+		return EXIT_FAILED;
+	}
+	if (recording.IsEmpty())
+	{
+		wxFprintf(stderr, "Recording '%s' has no events.\n", filename);
+		return EXIT_FAILED;
+	}
+
+	std::vector<std::vector<double>> latencies(IE_Count);
+	uint64_t hash = 0;
+	bool deterministic = true;
+	for (long i = 0; i < runs; i++)
+	{
+		uint64_t runHash = Replay(recording, latencies);
+		if (i > 0 && runHash != hash)
+		{
+			deterministic = false;
+		}
+		hash = runHash;
+	}
+
+	std::vector<double> all;
+	wxString json;
+	json << "{\n";
+	json << wxString::Format("  \"version\": %d,\n", FORMAT_VERSION);
+	json << "  \"recording\": " << QuoteJson(filename) << ",\n";
+	json << wxString::Format("  \"events\": %lu,\n  \"recorded_ms\": %lu,\n  \"runs\": %ld,\n",
+		static_cast<unsigned long>(recording.GetEvents().size()),
+		static_cast<unsigned long>(recording.GetEvents().back().mTime), runs);
+	json << wxString::Format("  \"hash\": \"%016llx\",\n", static_cast<unsigned long long>(hash));
+	json << "  \"deterministic\": " << (deterministic ? "true" : "false") << ",\n";
+	json << "  \"latency_us\": {\n";
+	for (int type = 0; type < IE_Count; type++)
+	{
+		const std::vector<double>& samples = latencies[type];
+		if (!samples.empty())
+		{
+			all.insert(all.end(), samples.begin(), samples.end());
+			json << "    \"" << InputRecording::GetTypeName(static_cast<InputEventType>(type)) << "\": "
+				<< FormatLatencies(samples) << ",\n";
+		}
+	}
+	json << "    \"all\": " << FormatLatencies(all) << "\n";
+	json << "  }\n}\n";
+
+	int status = 0;
+	if (output.empty())
+	{
+		fputs(json.utf8_str(), stdout);
+	}
+	else
+	{
+		wxFFile file(output, "w");
+		if (!file.IsOpened() || !file.Write(json))
+		{
+			wxFprintf(stderr, "Cannot write '%s'.\n", output);
+			status = EXIT_FAILED;
+		}
+	}
+
+	if (!deterministic)
+	{
+		wxFprintf(stderr, "Runs produced different documents.\n");
+		status = EXIT_NOT_DETERMINISTIC;
+	}
+	else if (checkHash &&
+		expected.Lower() != wxString::Format("%016llx", static_cast<unsigned long long>(hash)))
+	{
+		wxFprintf(stderr, "Document hash %016llx doesn't match the expected %s.\n",
+			static_cast<unsigned long long>(hash), expected);
+		status = EXIT_HASH_MISMATCH;
+	}
+	return status;
+}
@@ -0,0 +1,128 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+#include <wx/gdicmn.h>
+
+// Records of little-endian, fixed width fields, as written to the
+// command journal and the history spill file
+
+// Appends fields to a record
+class RecordWriter
+{
+public:
+	RecordWriter(std::vector<unsigned char>& record)
+	: mRecord(record)
+	{
+	}
+
+	template <class T>
+	void Put(T value)
+	{
+		for (size_t i = 0; i < sizeof(T); i++)
+		{
+			mRecord.push_back(static_cast<unsigned char>(static_cast<uint64_t>(value) >> (i * 8)));
+		}
+	}
+
+	void PutDouble(double value)
+	{
+		uint64_t bits = 0;
+		std::memcpy(&bits, &value, sizeof(value));
+		Put(bits);
+	}
+
+	void PutPoint(const wxPoint& point)
+	{
+		Put(static_cast<uint32_t>(point.x));
+		Put(static_cast<uint32_t>(point.y));
+	}
+	// The bytes as they are, preceded by their size
+	void PutBytes(const std::vector<unsigned char>& bytes)
+	{
+		Put(static_cast<uint32_t>(bytes.size()));
+		mRecord.insert(mRecord.end(), bytes.begin(), bytes.end());
+	}
+
+	std::vector<unsigned char>& GetRecord() { return mRecord; }
+private:
+	std::vector<unsigned char>& mRecord;
+};
+
+// Reads the fields of a record back in order, failing instead of reading
+// past its end
+class RecordReader
+{
+public:
+	RecordReader(const std::vector<unsigned char>& record)
+	: mRecord(record)
+	, mPos(0)
+	{
+	}
+
+	template <class T>
+	bool Get(T& value)
+	{
+		if (mRecord.size() - mPos < sizeof(T))
+		{
+			return false;
+		}
+		uint64_t bits = 0;
+		for (size_t i = 0; i < sizeof(T); i++)
+		{
+			bits |= static_cast<uint64_t>(mRecord[mPos + i]) << (i * 8);
+		}
+		value = static_cast<T>(bits);
+		mPos += sizeof(T);
+		return true;
+	}
+
+	bool GetDouble(double& value)
+	{
+		uint64_t bits = 0;
+		if (!Get(bits))
+		{
+			return false;
+		}
+		std::memcpy(&value, &bits, sizeof(value));
+		return true;
+	}
+
+	bool GetPoint(wxPoint& point)
+	{
+		uint32_t x = 0;
+		uint32_t y = 0;
+		if (!Get(x) || !Get(y))
+		{
+			return false;
+		}
+		point = wxPoint(static_cast<int32_t>(x), static_cast<int32_t>(y));
+		return true;
+	}
+	// Bytes written by PutBytes, left in place
+	bool GetBytes(const unsigned char*& bytes, size_t& size)
+	{
+		uint32_t count = 0;
+		if (!Get(count) || mRecord.size() - mPos < count)
+		{
+			return false;
+		}
+		bytes = mRecord.data() + mPos;
+		size = count;
+		mPos += count;
+		return true;
+	}
+	// Everything after the fields read so far
+	const unsigned char* GetRest(size_t& size)
+	{
+		size = mRecord.size() - mPos;
+		const unsigned char* rest = mRecord.data() + mPos;
+		mPos = mRecord.size();
+		return rest;
+	}
+
+	bool IsAtEnd() const { return mPos == mRecord.size(); }
+private:
+	const std::vector<unsigned char>& mRecord;
+	size_t mPos;
+};
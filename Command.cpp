@@ -1,9 +1,11 @@
 #include "Command.h"
 #include "Shape.h"
+#include "Profiler.h"
 #include "PaintModel.h"
 
-Command::Command(const wxPoint& start, std::shared_ptr<Shape> shape)
-	:mStartPoint(start)
+Command::Command(const wxPoint& start, const std::shared_ptr<Shape>& shape)
+	:mType(CM_DrawLine)
+	,mStartPoint(start)
 	,mEndPoint(start)
 	,mShape(shape)
 {
@@ -16,46 +18,51 @@ void Command::Update(const wxPoint& newPoint)
 	mEndPoint = newPoint;
 }
 
-std::shared_ptr<Command> CommandFactory::Create(std::shared_ptr<PaintModel> model,
+std::shared_ptr<Command> CommandFactory::Create(const std::shared_ptr<PaintModel>& model,
 	CommandType type, const wxPoint& start)
 {
+	PROFILE_SCOPE("CommandFactory::Create");
 	std::shared_ptr<Command> retVal = nullptr;
     std::shared_ptr<Shape> shape = nullptr;
     
     switch (type)
     {
         case CM_DrawLine:
-            shape = std::make_shared<LineShape>(start);
-            retVal = std::make_shared<DrawCommand>(start, shape);
+            shape = model->Make<LineShape>(start);
+            retVal = model->Make<DrawCommand>(start, shape);
             model->AddShape(shape);
             break;
             
         case CM_DrawEllipse:
-            shape = std::make_shared<EllipseShape>(start);
-            retVal = std::make_shared<DrawCommand>(start, shape);
+            shape = model->Make<EllipseShape>(start);
+            retVal = model->Make<DrawCommand>(start, shape);
             model->AddShape(shape);
             break;
             
         case CM_DrawRect:
-            shape = std::make_shared<RectShape>(start);
-            retVal = std::make_shared<DrawCommand>(start, shape);
+            shape = model->Make<RectShape>(start);
+            retVal = model->Make<DrawCommand>(start, shape);
             model->AddShape(shape);
             break;
             
         case CM_DrawPencil:
-            shape = std::make_shared<PencilShape>(start);
-            retVal = std::make_shared<DrawCommand>(start, shape);
+        {
+            std::shared_ptr<PencilShape> pencil = model->Make<PencilShape>(start);
+            pencil->SetTolerance(model->GetSimplifyTolerance());
+            shape = pencil;
+            retVal = model->Make<DrawCommand>(start, shape);
             model->AddShape(shape);
             break;
+        }
             
         case CM_Move:
             shape = model->GetSelectedShape();
-            retVal = std::make_shared<MoveCommand>(start, shape);
+            retVal = model->Make<MoveCommand>(start, shape);
             break;
             
         case CM_Delete:
             shape = model->GetSelectedShape();
-            retVal = std::make_shared<DeleteCommand>(start, shape);
+            retVal = model->Make<DeleteCommand>(start, shape);
             retVal->SetShape(shape);
             model->RemoveShape(shape);
             break;
@@ -63,22 +70,31 @@ std::shared_ptr<Command> CommandFactory::Create(std::shared_ptr<PaintModel> mode
         case CM_SetPen:
         case CM_SetBrush:
             shape = model->GetSelectedShape();
-            retVal = std::make_shared<PenBrushCommand>(start, shape);
-            std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetOldPen(shape->GetPen());
-            std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetNewPen(model->GetPen());
-            std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetOldBrush(shape->GetBrush());
-            std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetNewBrush(model->GetBrush());
+            retVal = model->Make<PenBrushCommand>(start, shape);
+            std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetOldStyle(shape->GetStyle());
+            std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetNewStyle(model->GetStyle());
             std::dynamic_pointer_cast<PenBrushCommand>(retVal)->SetShape(shape);
             break;
+            
+        case CM_Compound:
+            // Only transactions make these, out of finalized commands
+            return nullptr;
     }
     
-    shape->SetPen(model->GetPen());
-    shape->SetBrush(model->GetBrush());
+    // Moving or deleting a shape leaves its style alone, since undoing them
+    // wouldn't put it back
+    if(type != CM_Move && type != CM_Delete)
+    {
+        shape->SetStyle(model->GetStyle(), model->GetStyles());
+    }
+    retVal->SetType(type);
 	return retVal;
 }
 
-DrawCommand::DrawCommand(const wxPoint& start, std::shared_ptr<Shape> shape)
+DrawCommand::DrawCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape)
     : Command(start, shape)
+    , mShapeOffset(shape->GetOffset())
+    , mShapeStyle(shape->GetStyle())
 {
     
 }
@@ -89,84 +105,89 @@ void DrawCommand::Update(const wxPoint &newPoint)
     mShape->Update(newPoint);
 }
 
-void DrawCommand::Undo(std::shared_ptr<PaintModel> model)
+void DrawCommand::Undo(const std::shared_ptr<PaintModel>& model)
 {
     model->RemoveShape(mShape);
 }
 
-void DrawCommand::Redo(std::shared_ptr<PaintModel> model)
+void DrawCommand::Redo(const std::shared_ptr<PaintModel>& model)
 {
+    mShape->SetOffset(mShapeOffset);
+    mShape->SetStyle(mShapeStyle, model->GetStyles());
     model->AddShape(mShape);
 }
 
-void DrawCommand::Finalize(std::shared_ptr<PaintModel> model)
+void DrawCommand::Finalize(const std::shared_ptr<PaintModel>& model)
 {
     mShape->Finalize();
+    // The factory styles the shape after making the command
+    SetShapeState(mShape->GetOffset(), mShape->GetStyle());
 }
 
-PenBrushCommand::PenBrushCommand(const wxPoint& start, std::shared_ptr<Shape> shape)
+PenBrushCommand::PenBrushCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape)
 : Command(start, shape)
+, mOldStyle(shape->GetStyle())
+, mNewStyle(shape->GetStyle())
 {
-    if(!mOldPen.IsOk())
-    {
-        mOldPen = *wxBLACK_PEN;
-    }
-    if(!mOldBrush.IsOk())
-    {
-        mOldBrush = *wxBLACK_BRUSH;
-    }
     
-    mNewPen = shape->GetPen();
-    mNewBrush = shape->GetBrush();
 }
 
-void PenBrushCommand::Undo(std::shared_ptr<PaintModel> model)
+void PenBrushCommand::Undo(const std::shared_ptr<PaintModel>& model)
 {
-    mShape->SetPen(mOldPen);
-    mShape->SetBrush(mOldBrush);
-    model->SetPenColor(mOldPen.GetColour());
-    model->SetPenWidth(mOldPen.GetWidth());
-    model->SetBrushColor(mOldBrush.GetColour());
+    mShape->SetStyle(mOldStyle, model->GetStyles());
+    model->SetStyle(mOldStyle);
 }
 
-void PenBrushCommand::Redo(std::shared_ptr<PaintModel> model)
+void PenBrushCommand::Redo(const std::shared_ptr<PaintModel>& model)
 {
-    mShape->SetPen(mNewPen);
-    mShape->SetBrush(mNewBrush);
-    model->SetPenColor(mNewPen.GetColour());
-    model->SetPenWidth(mNewPen.GetWidth());
-    model->SetBrushColor(mNewBrush.GetColour());
+    mShape->SetStyle(mNewStyle, model->GetStyles());
+    model->SetStyle(mNewStyle);
 }
 
-void PenBrushCommand::Finalize(std::shared_ptr<PaintModel> model)
+bool PenBrushCommand::Merge(Command& next)
+{
+    if((next.GetType() != CM_SetPen && next.GetType() != CM_SetBrush) || next.GetShape() != mShape)
+    {
+        return false;
+    }
+    mNewStyle = static_cast<PenBrushCommand&>(next).GetNewStyle();
+    return true;
+}
+
+void PenBrushCommand::Finalize(const std::shared_ptr<PaintModel>& model)
 {
     mShape->Finalize();
 }
 
-DeleteCommand::DeleteCommand(const wxPoint& start, std::shared_ptr<Shape> shape)
+DeleteCommand::DeleteCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape)
 : Command(start, shape)
+, mShapeOffset(shape->GetOffset())
+, mShapeStyle(shape->GetStyle())
 {
 
 }
 
 
-void DeleteCommand::Finalize(std::shared_ptr<PaintModel> model)
+void DeleteCommand::Finalize(const std::shared_ptr<PaintModel>& model)
 {
     mShape->Finalize();
 }
 
-void DeleteCommand::Undo(std::shared_ptr<PaintModel> model)
+void DeleteCommand::Undo(const std::shared_ptr<PaintModel>& model)
 {
+    mShape->SetOffset(mShapeOffset);
+    mShape->SetStyle(mShapeStyle, model->GetStyles());
     model->AddShape(mShape);
 }
 
-void DeleteCommand::Redo(std::shared_ptr<PaintModel> model)
+void DeleteCommand::Redo(const std::shared_ptr<PaintModel>& model)
 {
     model->RemoveShape(mShape);
 }
 
-MoveCommand::MoveCommand(const wxPoint& start, std::shared_ptr<Shape> shape)
+MoveCommand::MoveCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape)
 : Command(start, shape)
+, mOldOffset(shape->GetOffset())
 {
     
 }
@@ -174,20 +195,63 @@ MoveCommand::MoveCommand(const wxPoint& start, std::shared_ptr<Shape> shape)
 void MoveCommand::Update(const wxPoint &newPoint)
 {
     Command::Update(newPoint);
-    mShape->SetOffset(mEndPoint-mStartPoint);
+    mShape->SetOffset(mOldOffset+mEndPoint-mStartPoint);
 }
 
-void MoveCommand::Finalize(std::shared_ptr<PaintModel> model)
+void MoveCommand::Finalize(const std::shared_ptr<PaintModel>& model)
 {
     
 }
 
-void MoveCommand::Undo(std::shared_ptr<PaintModel> model)
+void MoveCommand::Undo(const std::shared_ptr<PaintModel>& model)
+{
+    mShape->SetOffset(mOldOffset);
+}
+
+void MoveCommand::Redo(const std::shared_ptr<PaintModel>& model)
 {
-    mShape->SetOffset(wxPoint(0,0));
+    mShape->SetOffset(mOldOffset+mEndPoint-mStartPoint);
+}
+
+bool MoveCommand::Merge(Command& next)
+{
+    if(next.GetType() != CM_Move || next.GetShape() != mShape)
+    {
+        return false;
+    }
+    // Both ends of next are in its own drag, so only the difference counts
+    mEndPoint += next.GetEndPoint() - next.GetStartPoint();
+    return true;
+}
+
+CompoundCommand::CompoundCommand()
+: Command(wxPoint(), nullptr)
+{
+    mType = CM_Compound;
+}
+
+void CompoundCommand::Finalize(const std::shared_ptr<PaintModel>& model)
+{
+    
+}
+
+void CompoundCommand::Undo(const std::shared_ptr<PaintModel>& model)
+{
+    for(auto iter = mCommands.rbegin(); iter != mCommands.rend(); ++iter)
+    {
+        (*iter)->Undo(model);
+    }
+}
+
+void CompoundCommand::Redo(const std::shared_ptr<PaintModel>& model)
+{
+    for(auto& command : mCommands)
+    {
+        command->Redo(model);
+    }
 }
 
-void MoveCommand::Redo(std::shared_ptr<PaintModel> model)
+bool CompoundCommand::Merge(Command& next)
 {
-    mShape->SetOffset(mEndPoint-mStartPoint);
+    return !mCommands.empty() && mCommands.back()->Merge(next);
 }
@@ -1,8 +1,8 @@
 #pragma once
 #include <wx/gdicmn.h>
-#include <wx/pen.h>
-#include <wx/brush.h>
 #include <memory>
+#include <vector>
+#include "StyleTable.h"
 
 enum CommandType
 {
@@ -14,6 +14,7 @@ enum CommandType
 	CM_Delete,
 	CM_SetPen,
 	CM_SetBrush,
+	CM_Compound,
 };
 
 // Forward declarations
@@ -25,22 +26,37 @@ class Shape;
 class Command
 {
 public:
-	Command(const wxPoint& start, std::shared_ptr<Shape> shape);
+	Command(const wxPoint& start, const std::shared_ptr<Shape>& shape);
 	// Called when the command is still updating (such as in the process of drawing)
 	virtual void Update(const wxPoint& newPoint);
 	// Called when the command is completed
-	virtual void Finalize(std::shared_ptr<PaintModel> model) = 0;
+	virtual void Finalize(const std::shared_ptr<PaintModel>& model) = 0;
 	// Used to "undo" the command
-	virtual void Undo(std::shared_ptr<PaintModel> model) = 0;
+	virtual void Undo(const std::shared_ptr<PaintModel>& model) = 0;
 	// Used to "redo" the command
-	virtual void Redo(std::shared_ptr<PaintModel> model) = 0;
+	virtual void Redo(const std::shared_ptr<PaintModel>& model) = 0;
+	// Folds next, finalized right after this command, into this one so
+	// they're undone as one; returns false if they can't be merged
+	virtual bool Merge(Command& next) { return false; }
     
     std::shared_ptr<Shape> GetShape() { return mShape; }
     
-    void SetShape(std::shared_ptr<Shape> shape) { mShape = shape; }
+    CommandType GetType() { return mType; }
+    
+    void SetType(CommandType type) { mType = type; }
+    
+    wxPoint GetStartPoint() { return mStartPoint; }
+    
+    wxPoint GetEndPoint() { return mEndPoint; }
+    // Only sets the point, without updating the shape the way Update does
+    void SetEndPoint(const wxPoint& point) { mEndPoint = point; }
+    
+    void SetShape(const std::shared_ptr<Shape>& shape) { mShape = shape; }
     
 	virtual ~Command() { }
 protected:
+	// What the factory created this command for
+	CommandType mType;
 	wxPoint mStartPoint;
 	wxPoint mEndPoint;
 	std::shared_ptr<Shape> mShape;
@@ -49,72 +65,124 @@ protected:
 // Factory method to help create a particular command
 struct CommandFactory
 {
-	static std::shared_ptr<Command> Create(std::shared_ptr<PaintModel> model,
+	static std::shared_ptr<Command> Create(const std::shared_ptr<PaintModel>& model,
 		CommandType type, const wxPoint& start);
 };
 
 class DrawCommand : public Command
 {
 public:
-    DrawCommand(const wxPoint& start, std::shared_ptr<Shape> shape);
+    DrawCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape);
     
-    void Finalize(std::shared_ptr<PaintModel> model) override;
+    void Finalize(const std::shared_ptr<PaintModel>& model) override;
     
-    void Undo(std::shared_ptr<PaintModel> model) override;
+    void Undo(const std::shared_ptr<PaintModel>& model) override;
     
-    void Redo(std::shared_ptr<PaintModel> model) override;
+    void Redo(const std::shared_ptr<PaintModel>& model) override;
     
     void Update(const wxPoint& newPoint) override;
+    // Offset and style the shape is drawn with, which redoing puts back
+    // since the history may have left it anywhere in the meantime
+    void SetShapeState(const wxPoint& offset, StyleId style) { mShapeOffset = offset; mShapeStyle = style; }
+    
+    wxPoint GetShapeOffset() { return mShapeOffset; }
+    
+    StyleId GetShapeStyle() { return mShapeStyle; }
+private:
+    wxPoint mShapeOffset;
+    StyleId mShapeStyle;
 };
 
 class PenBrushCommand : public Command
 {
 public:
-    PenBrushCommand(const wxPoint& start, std::shared_ptr<Shape> shape);
+    PenBrushCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape);
     
-    void Finalize(std::shared_ptr<PaintModel> model) override;
+    void Finalize(const std::shared_ptr<PaintModel>& model) override;
     
-    void Undo(std::shared_ptr<PaintModel> model) override;
+    void Undo(const std::shared_ptr<PaintModel>& model) override;
     
-    void Redo(std::shared_ptr<PaintModel> model) override;
+    void Redo(const std::shared_ptr<PaintModel>& model) override;
     
-    void SetNewPen(wxPen pen) { mNewPen = pen; }
+    void SetNewStyle(StyleId style) { mNewStyle = style; }
     
-    void SetOldPen(wxPen pen) { mOldPen = pen; }
+    void SetOldStyle(StyleId style) { mOldStyle = style; }
     
-    void SetNewBrush(wxBrush brush) { mNewBrush = brush; }
+    StyleId GetNewStyle() { return mNewStyle; }
     
-    void SetOldBrush(wxBrush brush) { mOldBrush = brush; }
+    StyleId GetOldStyle() { return mOldStyle; }
+    // Restyling the same shape again keeps the first old style
+    bool Merge(Command& next) override;
 private:
-    wxPen mOldPen;
-    wxPen mNewPen;
-    wxBrush mOldBrush;
-    wxBrush mNewBrush;
+    StyleId mOldStyle;
+    StyleId mNewStyle;
 };
 
 class DeleteCommand : public Command
 {
 public:
-    DeleteCommand(const wxPoint& start, std::shared_ptr<Shape> shape);
+    DeleteCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape);
+    
+    void Finalize(const std::shared_ptr<PaintModel>& model) override;
+    
+    void Undo(const std::shared_ptr<PaintModel>& model) override;
     
-    void Finalize(std::shared_ptr<PaintModel> model) override;
+    void Redo(const std::shared_ptr<PaintModel>& model) override;
+    // Offset and style the shape had when it was deleted, which undoing
+    // puts back
+    void SetShapeState(const wxPoint& offset, StyleId style) { mShapeOffset = offset; mShapeStyle = style; }
     
-    void Undo(std::shared_ptr<PaintModel> model) override;
+    wxPoint GetShapeOffset() { return mShapeOffset; }
     
-    void Redo(std::shared_ptr<PaintModel> model) override;
+    StyleId GetShapeStyle() { return mShapeStyle; }
+private:
+    wxPoint mShapeOffset;
+    StyleId mShapeStyle;
 };
 
 class MoveCommand : public Command
 {
 public:
-    MoveCommand(const wxPoint& start, std::shared_ptr<Shape> shape);
+    MoveCommand(const wxPoint& start, const std::shared_ptr<Shape>& shape);
     
     void Update(const wxPoint& newPoint) override;
     
-    void Finalize(std::shared_ptr<PaintModel> model) override;
+    void Finalize(const std::shared_ptr<PaintModel>& model) override;
+    
+    void Undo(const std::shared_ptr<PaintModel>& model) override;
     
-    void Undo(std::shared_ptr<PaintModel> model) override;
+    void Redo(const std::shared_ptr<PaintModel>& model) override;
     
-    void Redo(std::shared_ptr<PaintModel> model) override;
+    void SetOldOffset(const wxPoint& offset) { mOldOffset = offset; }
+    
+    wxPoint GetOldOffset() { return mOldOffset; }
+    // Moving the same shape again adds to the distance moved
+    bool Merge(Command& next) override;
+private:
+    // Offset the shape had before the move, which the move adds to
+    wxPoint mOldOffset;
 };
 
+// Commands that are undone and redone as one, as made by a transaction
+// (see PaintModel::BeginTransaction). It has no shape of its own.
+class CompoundCommand : public Command
+{
+public:
+    CompoundCommand();
+    // Appends command, which has already been finalized
+    void Add(const std::shared_ptr<Command>& command) { mCommands.push_back(command); }
+    
+    bool IsEmpty() { return mCommands.empty(); }
+    
+    const std::vector<std::shared_ptr<Command>>& GetCommands() { return mCommands; }
+    
+    void Finalize(const std::shared_ptr<PaintModel>& model) override;
+    // Undoes the commands last to first
+    void Undo(const std::shared_ptr<PaintModel>& model) override;
+    
+    void Redo(const std::shared_ptr<PaintModel>& model) override;
+    // Merges next into the last command
+    bool Merge(Command& next) override;
+private:
+    std::vector<std::shared_ptr<Command>> mCommands;
+};
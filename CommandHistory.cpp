@@ -0,0 +1,727 @@
+#include "CommandHistory.h"
+#include "BinaryRecord.h"
+#include "PaintModel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <utility>
+
+// Needed for odr-uses
+const size_t CommandHistory::COMMAND_BYTES;
+
+namespace
+{
+	// The commands a command is made of, which is itself unless it's compound
+	void GetCommands(const std::shared_ptr<Command>& command, std::vector<std::shared_ptr<Command>>& commands)
+	{
+		if (command->GetType() == CM_Compound)
+		{
+			commands = static_cast<CompoundCommand&>(*command).GetCommands();
+		}
+		else
+		{
+			commands.assign(1, command);
+		}
+	}
+
+	bool IsDrawing(CommandType type)
+	{
+		return type == CM_DrawLine || type == CM_DrawEllipse || type == CM_DrawRect || type == CM_DrawPencil;
+	}
+}
+
+CommandHistory::CommandHistory()
+: mPosition(0)
+, mMemoryUsage(0)
+, mSpill(std::make_shared<SpillFile>())
+{
+}
+
+void CommandHistory::Push(PaintModel& model, const std::shared_ptr<Command>& command)
+{
+	Truncate(model, mPosition);
+	Entry entry;
+	entry.mCommand = command;
+	entry.mRecord.mOffset = 0;
+	entry.mRecord.mSize = 0;
+	entry.mBytes = COMMAND_BYTES;
+	if (command->GetType() == CM_Compound)
+	{
+		entry.mBytes += COMMAND_BYTES * static_cast<CompoundCommand&>(*command).GetCommands().size();
+	}
+	Describe(entry);
+	if (entry.mRestyles)
+	{
+		mRestyles.push_back(mEntries.size());
+	}
+	mLoaded.insert(mEntries.size());
+	mEntries.push_back(entry);
+	mMemoryUsage += entry.mBytes;
+	mPosition = mEntries.size();
+}
+
+void CommandHistory::Truncate(PaintModel& model, size_t index)
+{
+	if (index >= mEntries.size())
+	{
+		return;
+	}
+	ShapeId drawn = INVALID_SHAPE_ID;
+	for (size_t i = index; i < mEntries.size(); i++)
+	{
+		drawn = std::min(drawn, mEntries[i].mDrawn);
+		Release(model, i);
+	}
+	mEntries.resize(index);
+	mRestyles.erase(std::lower_bound(mRestyles.begin(), mRestyles.end(), index), mRestyles.end());
+	// Nothing left can refer to the shapes the dropped commands drew
+	mShapes.erase(mShapes.lower_bound(drawn), mShapes.end());
+	mPosition = std::min(mPosition, index);
+}
+
+std::shared_ptr<Command> CommandHistory::Get(PaintModel& model, size_t index)
+{
+	if (index >= mEntries.size())
+	{
+		return nullptr;
+	}
+	Entry& entry = mEntries[index];
+	if (entry.mCommand != nullptr)
+	{
+		return entry.mCommand;
+	}
+
+	PROFILE_SCOPE("CommandHistory::Get (spilled)");
+	std::vector<unsigned char> record;
+	std::shared_ptr<Command> command;
+	if (ReadRecord(entry.mRecord, record))
+	{
+		RecordReader reader(record);
+		command = ReadCommand(model, reader, false);
+	}
+	if (command == nullptr)
+	{
+		if (index < mPosition)
+		{
+			DropBefore(model, index + 1);
+		}
+		else
+		{
+			Truncate(model, index);
+		}
+		return nullptr;
+	}
+	entry.mCommand = command;
+	mLoaded.insert(index);
+	mMemoryUsage += entry.mBytes;
+	return command;
+}
+
+void CommandHistory::Changed(size_t index)
+{
+	Entry& entry = mEntries[index];
+	// The old record stays in the file, unused
+	entry.mRecord.mSize = 0;
+	Describe(entry);
+	auto iter = std::lower_bound(mRestyles.begin(), mRestyles.end(), index);
+	bool listed = iter != mRestyles.end() && *iter == index;
+	if (entry.mRestyles && !listed)
+	{
+		mRestyles.insert(iter, index);
+	}
+	else if (!entry.mRestyles && listed)
+	{
+		mRestyles.erase(iter);
+	}
+}
+
+bool CommandHistory::GetStepStyle(size_t from, size_t to, StyleId& style) const
+{
+	auto iter = std::lower_bound(mRestyles.begin(), mRestyles.end(), std::min(from, to));
+	if (to < from)
+	{
+		// Undoing from the top down, the lowest restyle is undone last
+		if (iter != mRestyles.end() && *iter < from)
+		{
+			style = mEntries[*iter].mUndoStyle;
+			return true;
+		}
+	}
+	else if (from < to)
+	{
+		// Redoing from the bottom up, the highest one is redone last
+		iter = std::lower_bound(iter, mRestyles.end(), to);
+		if (iter != mRestyles.begin() && *(iter - 1) >= from)
+		{
+			style = mEntries[*(iter - 1)].mRedoStyle;
+			return true;
+		}
+	}
+	return false;
+}
+
+void CommandHistory::Clear()
+{
+	mEntries.clear();
+	mPosition = 0;
+	mLoaded.clear();
+	mRestyles.clear();
+	mMemoryUsage = 0;
+	// A snapshot being written may still read the old file, so it's left
+	// to the snapshot to remove
+	mSpill = std::make_shared<SpillFile>();
+	mShapes.clear();
+}
+
+bool CommandHistory::GetFurthest(size_t& distance) const
+{
+	if (mLoaded.empty())
+	{
+		return false;
+	}
+	FindFurthest(distance);
+	return true;
+}
+
+bool CommandHistory::SpillFurthest(PaintModel& model)
+{
+	if (mLoaded.empty())
+	{
+		return false;
+	}
+	size_t distance = 0;
+	size_t index = FindFurthest(distance);
+	Entry& entry = mEntries[index];
+
+	PROFILE_SCOPE("CommandHistory::SpillFurthest");
+	// A command restored from a snapshot has a record before its shapes do
+	std::vector<std::shared_ptr<Command>> commands;
+	GetCommands(entry.mCommand, commands);
+	for (auto& command : commands)
+	{
+		if (!SpillShape(command->GetShape()))
+		{
+			return false;
+		}
+	}
+	commands.clear();
+	if (entry.mRecord.mSize == 0)
+	{
+		std::vector<unsigned char> record;
+		RecordWriter writer(record);
+		WriteEntry(writer, entry);
+		if (!WriteRecord(record, entry.mRecord))
+		{
+			return false;
+		}
+	}
+	Release(model, index);
+	return true;
+}
+
+std::shared_ptr<Shape> CommandHistory::ReadShape(PaintModel& model, ShapeId id)
+{
+	auto iter = mShapes.find(id);
+	std::vector<unsigned char> record;
+	if (iter == mShapes.end() || !ReadRecord(iter->second, record))
+	{
+		return nullptr;
+	}
+	PROFILE_SCOPE("CommandHistory::ReadShape");
+	RecordReader reader(record);
+	std::shared_ptr<Shape> shape = ReadShape(model, reader);
+	if (shape == nullptr || !reader.IsAtEnd() || !model.RebindShape(id, shape))
+	{
+		return nullptr;
+	}
+	return shape;
+}
+
+void CommandHistory::Capture(PaintModel& model, SessionSnapshot& snapshot)
+{
+	PROFILE_SCOPE("CommandHistory::Capture");
+	snapshot.SetSpill(mSpill);
+	// The shapes in the document are captured along with it. The others
+	// commands refer to are in the spill file, unless only commands in
+	// memory have needed them so far.
+	for (auto& iter : mShapes)
+	{
+		if (model.GetShape(iter.first) == nullptr)
+		{
+			std::vector<unsigned char> head;
+			RecordWriter writer(head);
+			writer.Put(static_cast<uint8_t>(SessionSnapshot::SR_HistoryShape));
+			writer.Put(static_cast<uint32_t>(iter.first));
+			snapshot.Add(std::move(head), iter.second.mOffset, iter.second.mSize);
+		}
+	}
+	std::set<ShapeId> captured;
+	std::vector<std::shared_ptr<Command>> commands;
+	for (size_t index : mLoaded)
+	{
+		GetCommands(mEntries[index].mCommand, commands);
+		for (auto& command : commands)
+		{
+			const std::shared_ptr<Shape>& shape = command->GetShape();
+			ShapeId id = shape->GetId();
+			if (mShapes.count(id) == 0 && model.GetShape(id) == nullptr && captured.insert(id).second)
+			{
+				std::vector<unsigned char> record;
+				RecordWriter writer(record);
+				writer.Put(static_cast<uint8_t>(SessionSnapshot::SR_HistoryShape));
+				writer.Put(static_cast<uint32_t>(id));
+				WriteShape(writer, *shape);
+				snapshot.Add(std::move(record));
+			}
+		}
+	}
+
+	for (auto& entry : mEntries)
+	{
+		std::vector<unsigned char> record;
+		RecordWriter writer(record);
+		writer.Put(static_cast<uint8_t>(SessionSnapshot::SR_Command));
+		writer.Put(static_cast<uint32_t>(entry.mBytes));
+		writer.Put(static_cast<uint32_t>(entry.mDrawn));
+		writer.Put(static_cast<uint8_t>(entry.mRestyles));
+		writer.Put(static_cast<uint32_t>(entry.mUndoStyle));
+		writer.Put(static_cast<uint32_t>(entry.mRedoStyle));
+		if (entry.mRecord.mSize != 0)
+		{
+			snapshot.Add(std::move(record), entry.mRecord.mOffset, entry.mRecord.mSize);
+		}
+		else
+		{
+			WriteEntry(writer, entry);
+			snapshot.Add(std::move(record));
+		}
+	}
+}
+
+bool CommandHistory::Restore(PaintModel& model, const std::vector<unsigned char>& record)
+{
+	RecordReader reader(record);
+	uint8_t type = 0;
+	uint32_t id = 0;
+	if (!reader.Get(type))
+	{
+		return false;
+	}
+	if (type == SessionSnapshot::SR_HistoryShape)
+	{
+		if (!reader.Get(id) || id >= model.GetNextShapeId() || reader.IsAtEnd())
+		{
+			return false;
+		}
+		size_t size = 0;
+		const unsigned char* rest = reader.GetRest(size);
+		Record where;
+		if (!WriteRecord(std::vector<unsigned char>(rest, rest + size), where))
+		{
+			return false;
+		}
+		mShapes[static_cast<ShapeId>(id)] = where;
+		return true;
+	}
+
+	uint32_t bytes = 0, undoStyle = 0, redoStyle = 0;
+	uint8_t restyles = 0;
+	if (type != SessionSnapshot::SR_Command || !reader.Get(bytes) || !reader.Get(id) || !reader.Get(restyles) ||
+		!reader.Get(undoStyle) || !reader.Get(redoStyle) || undoStyle >= model.GetStyles().GetCount() ||
+		redoStyle >= model.GetStyles().GetCount() || reader.IsAtEnd())
+	{
+		return false;
+	}
+	// Everything restored starts out spilled
+	Entry entry;
+	size_t size = 0;
+	const unsigned char* rest = reader.GetRest(size);
+	if (!WriteRecord(std::vector<unsigned char>(rest, rest + size), entry.mRecord))
+	{
+		return false;
+	}
+	entry.mBytes = bytes;
+	entry.mDrawn = static_cast<ShapeId>(id);
+	entry.mRestyles = restyles != 0;
+	entry.mUndoStyle = static_cast<StyleId>(undoStyle);
+	entry.mRedoStyle = static_cast<StyleId>(redoStyle);
+	if (entry.mRestyles)
+	{
+		mRestyles.push_back(mEntries.size());
+	}
+	mEntries.push_back(entry);
+	return true;
+}
+
+void CommandHistory::WriteShape(RecordWriter& writer, const Shape& shape)
+{
+	wxPoint start, end, topLeft, botRight;
+	shape.GetGeometry(start, end, topLeft, botRight);
+	writer.Put(static_cast<uint8_t>(shape.GetKind()));
+	writer.Put(static_cast<uint32_t>(shape.GetStyle()));
+	writer.PutPoint(start);
+	writer.PutPoint(end);
+	writer.PutPoint(topLeft);
+	writer.PutPoint(botRight);
+	writer.PutPoint(shape.GetOffset());
+	if (shape.GetKind() == SK_Pencil)
+	{
+		// The stroke as it is, levels of detail and all, so reading it back
+		// doesn't have to simplify it again
+		const PencilShape& pencil = static_cast<const PencilShape&>(shape);
+		std::vector<unsigned char> deltas;
+		writer.PutDouble(pencil.GetTolerance());
+		writer.Put(static_cast<uint32_t>(pencil.GetRecordedCount()));
+		writer.Put(static_cast<uint32_t>(pencil.GetPointCount()));
+		pencil.GetPoints().GetDeltas(deltas);
+		writer.PutBytes(deltas);
+		writer.Put(static_cast<uint8_t>(pencil.GetLevelCount()));
+		for (size_t i = 0; i < pencil.GetLevelCount(); i++)
+		{
+			deltas.clear();
+			writer.PutDouble(pencil.GetLevelTolerance(i));
+			writer.Put(static_cast<uint32_t>(pencil.GetLevelPoints(i).GetCount()));
+			pencil.GetLevelPoints(i).GetDeltas(deltas);
+			writer.PutBytes(deltas);
+		}
+	}
+}
+
+std::shared_ptr<Shape> CommandHistory::ReadShape(PaintModel& model, RecordReader& reader)
+{
+	uint8_t kind = 0;
+	uint32_t style = 0;
+	wxPoint start, end, topLeft, botRight, offset;
+	if (!reader.Get(kind) || !reader.Get(style) || !reader.GetPoint(start) || !reader.GetPoint(end) ||
+		!reader.GetPoint(topLeft) || !reader.GetPoint(botRight) || !reader.GetPoint(offset) ||
+		kind > SK_Pencil || style >= model.GetStyles().GetCount())
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<Shape> shape;
+	switch (kind)
+	{
+		case SK_Rect:
+			shape = model.Make<RectShape>(start);
+			break;
+		case SK_Ellipse:
+			shape = model.Make<EllipseShape>(start);
+			break;
+		case SK_Line:
+			shape = model.Make<LineShape>(start);
+			break;
+		default:
+			shape = model.Make<PencilShape>(start);
+			break;
+	}
+	shape->SetGeometry(start, end, topLeft, botRight);
+	shape->SetOffset(offset);
+	shape->SetStyle(static_cast<StyleId>(style), model.GetStyles());
+
+	if (kind == SK_Pencil)
+	{
+		PencilShape& pencil = static_cast<PencilShape&>(*shape);
+		double tolerance = 0.0;
+		uint32_t recordedCount = 0, count = 0;
+		const unsigned char* deltas = nullptr;
+		size_t size = 0;
+		uint8_t levelCount = 0;
+		if (!reader.GetDouble(tolerance) || !reader.Get(recordedCount) || !reader.Get(count) ||
+			!reader.GetBytes(deltas, size) || !PointStream::CheckDeltas(deltas, size, count) || count == 0 ||
+			!reader.Get(levelCount))
+		{
+			return nullptr;
+		}
+		pencil.Restore(deltas, size, count, recordedCount, tolerance);
+		for (uint8_t i = 0; i < levelCount; i++)
+		{
+			if (!reader.GetDouble(tolerance) || !reader.Get(count) || !reader.GetBytes(deltas, size) ||
+				!PointStream::CheckDeltas(deltas, size, count) || count == 0)
+			{
+				return nullptr;
+			}
+			pencil.RestoreLevel(tolerance, deltas, size, count);
+		}
+	}
+	return shape;
+}
+
+void CommandHistory::Describe(Entry& entry)
+{
+	entry.mDrawn = INVALID_SHAPE_ID;
+	entry.mRestyles = false;
+	entry.mUndoStyle = StyleTable::DEFAULT_STYLE;
+	entry.mRedoStyle = StyleTable::DEFAULT_STYLE;
+	std::vector<std::shared_ptr<Command>> commands;
+	GetCommands(entry.mCommand, commands);
+	for (auto& command : commands)
+	{
+		CommandType type = command->GetType();
+		if (IsDrawing(type))
+		{
+			entry.mDrawn = std::min(entry.mDrawn, command->GetShape()->GetId());
+		}
+		else if (type == CM_SetPen || type == CM_SetBrush)
+		{
+			// A compound one is undone last to first
+			PenBrushCommand& penBrush = static_cast<PenBrushCommand&>(*command);
+			if (!entry.mRestyles)
+			{
+				entry.mUndoStyle = penBrush.GetOldStyle();
+			}
+			entry.mRedoStyle = penBrush.GetNewStyle();
+			entry.mRestyles = true;
+		}
+	}
+}
+
+void CommandHistory::DropBefore(PaintModel& model, size_t index)
+{
+	for (size_t i = 0; i < index; i++)
+	{
+		Release(model, i);
+	}
+	mEntries.erase(mEntries.begin(), mEntries.begin() + index);
+	std::set<size_t> loaded;
+	for (size_t i : mLoaded)
+	{
+		loaded.insert(loaded.end(), i - index);
+	}
+	mLoaded.swap(loaded);
+	mRestyles.erase(mRestyles.begin(), std::lower_bound(mRestyles.begin(), mRestyles.end(), index));
+	for (size_t& i : mRestyles)
+	{
+		i -= index;
+	}
+	mPosition -= std::min(mPosition, index);
+}
+
+void CommandHistory::Release(PaintModel& model, size_t index)
+{
+	Entry& entry = mEntries[index];
+	if (entry.mCommand == nullptr)
+	{
+		return;
+	}
+	std::vector<std::shared_ptr<Command>> commands;
+	GetCommands(entry.mCommand, commands);
+	std::vector<ShapeId> shapes;
+	for (auto& command : commands)
+	{
+		shapes.push_back(command->GetShape()->GetId());
+	}
+	commands.clear();
+	entry.mCommand.reset();
+	mLoaded.erase(index);
+	mMemoryUsage -= entry.mBytes;
+	// The model stops counting the ones that are gone now
+	for (ShapeId id : shapes)
+	{
+		model.ReleaseShape(id);
+	}
+}
+
+size_t CommandHistory::FindFurthest(size_t& distance) const
+{
+	// A done command is needed once the ones done after it are undone, an
+	// undone one once the ones before it are redone. The oldest goes first
+	// on a tie.
+	size_t first = *mLoaded.begin();
+	size_t last = *mLoaded.rbegin();
+	size_t firstDistance = first < mPosition ? mPosition - first : first + 1 - mPosition;
+	size_t lastDistance = last < mPosition ? mPosition - last : last + 1 - mPosition;
+	distance = std::max(firstDistance, lastDistance);
+	return firstDistance >= lastDistance ? first : last;
+}
+
+bool CommandHistory::WriteRecord(const std::vector<unsigned char>& record, Record& where)
+{
+	uint64_t offset = 0;
+	if (!mSpill->Append(record, offset))
+	{
+		return false;
+	}
+	where.mOffset = offset;
+	where.mSize = static_cast<uint32_t>(record.size());
+	return true;
+}
+
+bool CommandHistory::ReadRecord(const Record& where, std::vector<unsigned char>& record)
+{
+	return where.mSize != 0 && mSpill->Read(where.mOffset, where.mSize, record);
+}
+
+void CommandHistory::WriteEntry(RecordWriter& writer, const Entry& entry)
+{
+	std::vector<std::shared_ptr<Command>> commands;
+	GetCommands(entry.mCommand, commands);
+	if (entry.mCommand->GetType() == CM_Compound)
+	{
+		writer.Put(static_cast<uint8_t>(CM_Compound));
+		writer.Put(static_cast<uint32_t>(commands.size()));
+	}
+	for (auto& command : commands)
+	{
+		WriteCommand(writer, *command);
+	}
+}
+
+void CommandHistory::WriteCommand(RecordWriter& writer, Command& command)
+{
+	writer.Put(static_cast<uint8_t>(command.GetType()));
+	writer.Put(static_cast<uint32_t>(command.GetShape()->GetId()));
+	writer.PutPoint(command.GetStartPoint());
+	writer.PutPoint(command.GetEndPoint());
+	if (command.GetType() == CM_SetPen || command.GetType() == CM_SetBrush)
+	{
+		PenBrushCommand& penBrush = static_cast<PenBrushCommand&>(command);
+		writer.Put(static_cast<uint32_t>(penBrush.GetOldStyle()));
+		writer.Put(static_cast<uint32_t>(penBrush.GetNewStyle()));
+	}
+	else if (command.GetType() == CM_Move)
+	{
+		writer.PutPoint(static_cast<MoveCommand&>(command).GetOldOffset());
+	}
+	else if (command.GetType() == CM_Delete)
+	{
+		DeleteCommand& deletion = static_cast<DeleteCommand&>(command);
+		writer.PutPoint(deletion.GetShapeOffset());
+		writer.Put(static_cast<uint32_t>(deletion.GetShapeStyle()));
+	}
+	else
+	{
+		DrawCommand& drawing = static_cast<DrawCommand&>(command);
+		writer.PutPoint(drawing.GetShapeOffset());
+		writer.Put(static_cast<uint32_t>(drawing.GetShapeStyle()));
+	}
+}
+
+std::shared_ptr<Command> CommandHistory::ReadCommand(PaintModel& model, RecordReader& reader, bool nested)
+{
+	uint8_t type = 0;
+	if (!reader.Get(type))
+	{
+		return nullptr;
+	}
+	if (type == CM_Compound && !nested)
+	{
+		uint32_t count = 0;
+		if (!reader.Get(count))
+		{
+			return nullptr;
+		}
+		std::shared_ptr<CompoundCommand> compound = model.Make<CompoundCommand>();
+		for (uint32_t i = 0; i < count; i++)
+		{
+			std::shared_ptr<Command> command = ReadCommand(model, reader, true);
+			if (command == nullptr)
+			{
+				return nullptr;
+			}
+			compound->Add(command);
+		}
+		return compound;
+	}
+
+	uint32_t id = 0;
+	wxPoint start, end, offset;
+	uint32_t oldStyle = 0, newStyle = 0;
+	if (!reader.Get(id) || !reader.GetPoint(start) || !reader.GetPoint(end) || type > CM_SetBrush)
+	{
+		return nullptr;
+	}
+	CommandType commandType = static_cast<CommandType>(type);
+	if (commandType == CM_SetPen || commandType == CM_SetBrush)
+	{
+		if (!reader.Get(oldStyle) || !reader.Get(newStyle))
+		{
+			return nullptr;
+		}
+	}
+	else if (!reader.GetPoint(offset) || (commandType != CM_Move && !reader.Get(newStyle)))
+	{
+		return nullptr;
+	}
+	if (oldStyle >= model.GetStyles().GetCount() || newStyle >= model.GetStyles().GetCount())
+	{
+		return nullptr;
+	}
+
+	// The shape may be in the model, held by something else or gone, in
+	// which case it's made again from the spill file
+	std::shared_ptr<Shape> shape = model.GetShape(static_cast<ShapeId>(id));
+	if (shape == nullptr)
+	{
+		shape = model.GetRemovedShape(static_cast<ShapeId>(id));
+	}
+	if (shape == nullptr)
+	{
+		shape = ReadShape(model, static_cast<ShapeId>(id));
+	}
+	if (shape == nullptr)
+	{
+		return nullptr;
+	}
+
+	std::shared_ptr<Command> command;
+	switch (commandType)
+	{
+		case CM_DrawLine:
+		case CM_DrawEllipse:
+		case CM_DrawRect:
+		case CM_DrawPencil:
+		{
+			std::shared_ptr<DrawCommand> drawing = model.Make<DrawCommand>(start, shape);
+			drawing->SetShapeState(offset, static_cast<StyleId>(newStyle));
+			command = drawing;
+			break;
+		}
+		case CM_Move:
+		{
+			std::shared_ptr<MoveCommand> move = model.Make<MoveCommand>(start, shape);
+			move->SetOldOffset(offset);
+			command = move;
+			break;
+		}
+		case CM_Delete:
+		{
+			std::shared_ptr<DeleteCommand> deletion = model.Make<DeleteCommand>(start, shape);
+			deletion->SetShapeState(offset, static_cast<StyleId>(newStyle));
+			command = deletion;
+			break;
+		}
+		case CM_SetPen:
+		case CM_SetBrush:
+		{
+			std::shared_ptr<PenBrushCommand> penBrush = model.Make<PenBrushCommand>(start, shape);
+			penBrush->SetOldStyle(static_cast<StyleId>(oldStyle));
+			penBrush->SetNewStyle(static_cast<StyleId>(newStyle));
+			command = penBrush;
+			break;
+		}
+		case CM_Compound:
+			// Compound commands don't nest
+			return nullptr;
+	}
+	command->SetType(commandType);
+	command->SetEndPoint(end);
+	return command;
+}
+
+bool CommandHistory::SpillShape(const std::shared_ptr<Shape>& shape)
+{
+	if (mShapes.count(shape->GetId()) > 0)
+	{
+		return true;
+	}
+	std::vector<unsigned char> record;
+	RecordWriter writer(record);
+	WriteShape(writer, *shape);
+	Record where;
+	if (!WriteRecord(record, where))
+	{
+		return false;
+	}
+	mShapes[shape->GetId()] = where;
+	return true;
+}
@@ -0,0 +1,155 @@
+#pragma once
+#include <cstdint>
+#include <map>
+#include <memory>
+#include <set>
+#include <vector>
+#include "Command.h"
+#include "SessionSnapshot.h"
+#include "Shape.h"
+#include "SpillFile.h"
+
+class PaintModel;
+class RecordReader;
+class RecordWriter;
+
+// The model's undo/redo history: every command in the order it was done,
+// and a position that splits the ones that are done (before it) from the
+// ones that are undone (from it on). Undoing, redoing and jumping only move
+// the position; the commands stay where they are.
+//
+// Commands can be written out to a spill file to keep the memory the
+// history holds under a budget, the ones furthest from the position first,
+// and are read back one at a time when they're needed again. A spilled
+// command refers to its shape by ID. Every shape a spilled command refers
+// to is written out once as well, since its geometry doesn't change after
+// it's finalized, so it can be made again under the same ID if nothing else
+// holds it by the time it's needed. A record stays in the file after it's
+// read back, so spilling the same command again costs nothing, and the
+// file only grows with commands and shapes that haven't been spilled yet.
+class CommandHistory
+{
+public:
+	// Rough cost of a command, the shared pointer's control block and its
+	// place in the history, not counting the shape
+	static const size_t COMMAND_BYTES = 128;
+
+	CommandHistory();
+
+	bool IsEmpty() const { return mEntries.empty(); }
+
+	size_t GetCount() const { return mEntries.size(); }
+	// Commands that are done
+	size_t GetPosition() const { return mPosition; }
+	// Moves the position without doing or undoing anything
+	void SetPosition(size_t position) { mPosition = position; }
+	// Drops the commands from the position on, then appends command and
+	// moves past it
+	void Push(PaintModel& model, const std::shared_ptr<Command>& command);
+	// Drops the commands from index on
+	void Truncate(PaintModel& model, size_t index);
+	// Returns the command at index, reading it back if it's spilled, or
+	// nullptr if it can't be read. The commands that can't be reached
+	// without it are dropped then: the ones before it if it's done, which
+	// moves the position back, or the ones from it on if it isn't.
+	std::shared_ptr<Command> Get(PaintModel& model, size_t index);
+	// Call after changing the command at index, as merging does, so it's
+	// written out again the next time it's spilled
+	void Changed(size_t index);
+	// Puts in style the model's current style as going from revision from
+	// to revision to one command at a time would leave it, which is up to
+	// the last restyle on the way. Returns false if there's none.
+	bool GetStepStyle(size_t from, size_t to, StyleId& style) const;
+
+	void Clear();
+	// Estimated bytes held by the commands in memory, not counting their
+	// shapes (see ShapeRegistry::GetRemovedMemoryUsage)
+	size_t GetMemoryUsage() const { return mMemoryUsage; }
+	// Puts in distance how many revisions away from the position the model
+	// has to go before it needs the command in memory furthest from it.
+	// Returns false if there's none.
+	bool GetFurthest(size_t& distance) const;
+	// Writes the command in memory furthest from the position to the spill
+	// file and lets go of it. Returns false if there's none or it can't be
+	// written.
+	bool SpillFurthest(PaintModel& model);
+	// Makes the shape with the given ID again from the spill file, under
+	// that ID. Returns nullptr if it was never written or can't be read.
+	std::shared_ptr<Shape> ReadShape(PaintModel& model, ShapeId id);
+	// Adds every command to snapshot, along with the shapes they refer to
+	// that the model doesn't have, which PaintModel::CaptureSession leaves
+	// out. Commands and shapes already in the spill file are read from it
+	// when the snapshot is written, so the history has to keep it until
+	// then.
+	void Capture(PaintModel& model, SessionSnapshot& snapshot);
+	// Appends the command or keeps the shape of a record Capture added,
+	// spilled either way, in the order they were added. The position stays
+	// put. Returns false if the record doesn't fit the model.
+	bool Restore(PaintModel& model, const std::vector<unsigned char>& record);
+
+	// Writes shape's kind, style, geometry and offset, and the stroke of
+	// a pencil shape
+	static void WriteShape(RecordWriter& writer, const Shape& shape);
+	// Makes a shape, without an ID, from what WriteShape wrote. Returns
+	// nullptr if it doesn't fit the model.
+	static std::shared_ptr<Shape> ReadShape(PaintModel& model, RecordReader& reader);
+private:
+	// Where a record is in the spill file; mSize is 0 if there's none
+	struct Record
+	{
+		uint64_t mOffset;
+		uint32_t mSize;
+	};
+
+	struct Entry
+	{
+		// Null while the command is spilled
+		std::shared_ptr<Command> mCommand;
+		Record mRecord;
+		size_t mBytes;
+		// Lowest ID among the shapes the command draws, if any. IDs only go
+		// up, so shapes with this ID or higher go with the command when
+		// it's dropped.
+		ShapeId mDrawn;
+		// Whether the command restyles a shape, and the current style of
+		// the model after it's undone and redone
+		bool mRestyles;
+		StyleId mUndoStyle;
+		StyleId mRedoStyle;
+	};
+
+	// Fills in what entry says about its command
+	void Describe(Entry& entry);
+	// Drops the commands before index, which moves the position back
+	void DropBefore(PaintModel& model, size_t index);
+	// Lets go of the command at index, if it's in memory
+	void Release(PaintModel& model, size_t index);
+	// Index of the command in memory furthest from the position, with its
+	// distance as GetFurthest puts it; there has to be one
+	size_t FindFurthest(size_t& distance) const;
+
+	bool WriteRecord(const std::vector<unsigned char>& record, Record& where);
+
+	bool ReadRecord(const Record& where, std::vector<unsigned char>& record);
+	// Writes the command of entry, compound or not
+	void WriteEntry(RecordWriter& writer, const Entry& entry);
+	// Writes a command that isn't compound
+	void WriteCommand(RecordWriter& writer, Command& command);
+	// Reads a command written by WriteEntry; nested is set for the
+	// commands of a compound one
+	std::shared_ptr<Command> ReadCommand(PaintModel& model, RecordReader& reader, bool nested);
+	// Writes shape to the spill file unless it's been written before
+	bool SpillShape(const std::shared_ptr<Shape>& shape);
+
+	std::vector<Entry> mEntries;
+	size_t mPosition;
+	// Indices of the entries whose command is in memory
+	std::set<size_t> mLoaded;
+	// Indices of the entries that restyle a shape, in ascending order
+	std::vector<size_t> mRestyles;
+	size_t mMemoryUsage;
+	// Shared with snapshots being written
+	std::shared_ptr<SpillFile> mSpill;
+	// Shapes written to the spill file, by ID
+	std::map<ShapeId, Record> mShapes;
+};
@@ -0,0 +1,267 @@
+#include "DocumentFile.h"
+#include "Profiler.h"
+#include <wx/file.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <cmath>
+#include <cstring>
+
+// Needed for odr-uses
+const uint32_t DocumentFile::MAGIC;
+const uint32_t DocumentFile::VERSION;
+const uint32_t DocumentFile::ENDIAN_CHECK;
+
+// The layout on disk must not depend on the compiler's padding
+static_assert(sizeof(DocumentFile::Header) == 64, "Header layout changed");
+static_assert(sizeof(DocumentFile::StyleRecord) == 24, "StyleRecord layout changed");
+static_assert(sizeof(DocumentFile::ShapeRecord) == 72, "ShapeRecord layout changed");
+static_assert(sizeof(DocumentFile::LevelRecord) == 16, "LevelRecord layout changed");
+
+namespace
+{
+	// Keeps every record, including the level records in the pool, aligned
+	// for reading in place
+	const uint64_t ALIGNMENT = 8;
+
+	uint64_t Align(uint64_t offset)
+	{
+		return (offset + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+	}
+
+	// Pads out to the next 8 byte boundary
+	void AlignPool(std::vector<unsigned char>& pool)
+	{
+		pool.resize(static_cast<size_t>(Align(pool.size())), 0);
+	}
+
+	template <class T>
+	void AppendRecord(std::vector<unsigned char>& pool, const T& record)
+	{
+		const unsigned char* bytes = reinterpret_cast<const unsigned char*>(&record);
+		pool.insert(pool.end(), bytes, bytes + sizeof(T));
+	}
+
+	void SetPoint(int32_t* out, const wxPoint& point)
+	{
+		out[0] = point.x;
+		out[1] = point.y;
+	}
+
+	// Checks that count records of size bytes at offset lie inside a file
+	// of fileSize bytes, starting on a record boundary
+	bool CheckSection(uint64_t offset, uint64_t count, uint64_t size, uint64_t fileSize)
+	{
+		return offset % ALIGNMENT == 0 && offset <= fileSize && count <= (fileSize - offset) / size;
+	}
+
+	// Checks that a run of deltas lies inside the pool and holds the
+	// number of points it claims
+	bool CheckDeltas(const unsigned char* pool, uint64_t poolSize, uint64_t offset, uint32_t size, uint32_t count)
+	{
+		return count > 0 && offset <= poolSize && size <= poolSize - offset &&
+			PointStream::CheckDeltas(pool + offset, size, count);
+	}
+}
+
+bool DocumentFile::IsPlainPenStyle(int32_t style)
+{
+	return (style >= wxPENSTYLE_SOLID && style <= wxPENSTYLE_DOT_DASH) || style == wxPENSTYLE_TRANSPARENT ||
+		(style >= wxPENSTYLE_FIRST_HATCH && style <= wxPENSTYLE_LAST_HATCH);
+}
+
+bool DocumentFile::IsPlainBrushStyle(int32_t style)
+{
+	return style == wxBRUSHSTYLE_SOLID || style == wxBRUSHSTYLE_TRANSPARENT ||
+		(style >= wxBRUSHSTYLE_FIRST_HATCH && style <= wxBRUSHSTYLE_LAST_HATCH);
+}
+
+bool DocumentFile::Save(const wxString& filename, const wxSize& size, const StyleTable& styles,
+	const std::vector<const Shape*>& shapes)
+{
+	PROFILE_SCOPE("DocumentFile::Save");
+	std::vector<StyleRecord> styleRecords(styles.GetCount());
+	for (size_t i = 0; i < styleRecords.size(); i++)
+	{
+		const wxPen& pen = styles.GetPen(static_cast<StyleId>(i));
+		const wxBrush& brush = styles.GetBrush(static_cast<StyleId>(i));
+		StyleRecord& record = styleRecords[i];
+		record.mPenColour = pen.GetColour().GetRGBA();
+		record.mPenWidth = pen.GetWidth();
+		record.mPenStyle = pen.GetStyle();
+		record.mBrushColour = brush.GetColour().GetRGBA();
+		record.mBrushStyle = brush.GetStyle();
+		record.mReserved = 0;
+	}
+
+	std::vector<ShapeRecord> shapeRecords(shapes.size());
+	std::vector<unsigned char> pool;
+	for (size_t i = 0; i < shapes.size(); i++)
+	{
+		const Shape& shape = *shapes[i];
+		ShapeRecord& record = shapeRecords[i];
+		std::memset(&record, 0, sizeof(record));
+		record.mKind = static_cast<uint8_t>(shape.GetKind());
+		record.mStyle = shape.GetStyle();
+		wxPoint start, end, topLeft, botRight;
+		shape.GetGeometry(start, end, topLeft, botRight);
+		SetPoint(record.mStart, start);
+		SetPoint(record.mEnd, end);
+		SetPoint(record.mTopLeft, topLeft);
+		SetPoint(record.mBotRight, botRight);
+		SetPoint(record.mOffset, shape.GetOffset());
+		if (shape.GetKind() != SK_Pencil)
+		{
+			continue;
+		}
+
+		const PencilShape& pencil = static_cast<const PencilShape&>(shape);
+		AlignPool(pool);
+		record.mPoints = pool.size();
+		record.mPointCount = static_cast<uint32_t>(pencil.GetPointCount());
+		pencil.GetPoints().GetDeltas(pool);
+		record.mPointSize = static_cast<uint32_t>(pool.size() - record.mPoints);
+		record.mRecordedCount = static_cast<uint32_t>(pencil.GetRecordedCount());
+		record.mTolerance = static_cast<float>(pencil.GetTolerance());
+		record.mLevelCount = static_cast<uint8_t>(pencil.GetLevelCount());
+		for (size_t level = 0; level < pencil.GetLevelCount(); level++)
+		{
+			AlignPool(pool);
+			size_t levelStart = pool.size();
+			LevelRecord levelRecord;
+			levelRecord.mTolerance = pencil.GetLevelTolerance(level);
+			levelRecord.mPointCount = static_cast<uint32_t>(pencil.GetLevelPoints(level).GetCount());
+			levelRecord.mPointSize = 0;
+			AppendRecord(pool, levelRecord);
+			pencil.GetLevelPoints(level).GetDeltas(pool);
+			levelRecord.mPointSize = static_cast<uint32_t>(pool.size() - levelStart - sizeof(LevelRecord));
+			std::memcpy(&pool[levelStart], &levelRecord, sizeof(LevelRecord));
+		}
+	}
+	AlignPool(pool);
+
+	Header header;
+	header.mMagic = MAGIC;
+	header.mVersion = VERSION;
+	header.mByteOrder = ENDIAN_CHECK;
+	header.mHeaderSize = sizeof(Header);
+	header.mWidth = size.GetWidth();
+	header.mHeight = size.GetHeight();
+	header.mStyleCount = static_cast<uint32_t>(styleRecords.size());
+	header.mShapeCount = static_cast<uint32_t>(shapeRecords.size());
+	// Every record size is a multiple of the alignment, so the sections
+	// follow each other without padding
+	header.mStyleOffset = Align(sizeof(Header));
+	header.mShapeOffset = header.mStyleOffset + styleRecords.size() * sizeof(StyleRecord);
+	header.mPoolOffset = header.mShapeOffset + shapeRecords.size() * sizeof(ShapeRecord);
+	header.mPoolSize = pool.size();
+
+	// Written to a temporary file next to the target and renamed over it
+	// once it's on disk, so a failed save leaves the old document intact
+	wxFile file;
+	wxString tempName = wxFileName::CreateTempFileName(filename, &file);
+	if (tempName.empty() || !file.IsOpened())
+	{
+		return false;
+	}
+	bool ok = file.Write(&header, sizeof(header)) == sizeof(header);
+	ok = ok && file.Write(styleRecords.data(), styleRecords.size() * sizeof(StyleRecord)) ==
+		styleRecords.size() * sizeof(StyleRecord);
+	ok = ok && file.Write(shapeRecords.data(), shapeRecords.size() * sizeof(ShapeRecord)) ==
+		shapeRecords.size() * sizeof(ShapeRecord);
+	ok = ok && file.Write(pool.data(), pool.size()) == pool.size();
+	// wxFile::Flush syncs the file
+	ok = ok && file.Flush();
+	ok = file.Close() && ok;
+	ok = ok && wxRenameFile(tempName, filename, true);
+	if (!ok)
+	{
+		wxRemoveFile(tempName);
+	}
+	return ok;
+}
+
+bool DocumentFile::Open(const wxString& filename)
+{
+	PROFILE_SCOPE("DocumentFile::Open");
+	if (!mFile.Open(filename))
+	{
+		return false;
+	}
+	uint64_t fileSize = mFile.GetSize();
+	const Header& header = GetHeader();
+	// Later versions may grow the header, but never move what's in it
+	bool ok = fileSize >= sizeof(Header) && header.mMagic == MAGIC && header.mVersion == VERSION &&
+		header.mByteOrder == ENDIAN_CHECK && header.mHeaderSize >= sizeof(Header) &&
+		header.mWidth >= 0 && header.mHeight >= 0 &&
+		CheckSection(header.mStyleOffset, header.mStyleCount, sizeof(StyleRecord), fileSize) &&
+		CheckSection(header.mShapeOffset, header.mShapeCount, sizeof(ShapeRecord), fileSize) &&
+		CheckSection(header.mPoolOffset, header.mPoolSize, 1, fileSize);
+
+	// Every document has the default style
+	const StyleRecord* styles = GetStyles();
+	ok = ok && header.mStyleCount > 0;
+	for (uint32_t i = 0; ok && i < header.mStyleCount; i++)
+	{
+		ok = styles[i].mPenWidth >= 0 && IsPlainPenStyle(styles[i].mPenStyle) &&
+			IsPlainBrushStyle(styles[i].mBrushStyle);
+	}
+
+	const ShapeRecord* shapes = GetShapes();
+	for (uint32_t i = 0; ok && i < header.mShapeCount; i++)
+	{
+		const ShapeRecord& record = shapes[i];
+		ok = record.mKind <= SK_Pencil && record.mStyle < header.mStyleCount &&
+			(record.mKind != SK_Pencil || CheckStroke(record));
+	}
+
+	if (!ok)
+	{
+		mFile.Close();
+	}
+	return ok;
+}
+
+bool DocumentFile::CheckStroke(const ShapeRecord& record) const
+{
+	const unsigned char* pool = GetPool();
+	uint64_t poolSize = GetHeader().mPoolSize;
+	if (!CheckDeltas(pool, poolSize, record.mPoints, record.mPointSize, record.mPointCount) ||
+		!std::isfinite(record.mTolerance))
+	{
+		return false;
+	}
+	uint64_t offset = record.mPoints + record.mPointSize;
+	for (uint8_t i = 0; i < record.mLevelCount; i++)
+	{
+		offset = Align(offset);
+		if (offset > poolSize || poolSize - offset < sizeof(LevelRecord))
+		{
+			return false;
+		}
+		const LevelRecord& level = *reinterpret_cast<const LevelRecord*>(pool + offset);
+		offset += sizeof(LevelRecord);
+		if (!CheckDeltas(pool, poolSize, offset, level.mPointSize, level.mPointCount) ||
+			!std::isfinite(level.mTolerance))
+		{
+			return false;
+		}
+		offset += level.mPointSize;
+	}
+	return true;
+}
+
+void DocumentFile::RestoreStroke(const ShapeRecord& record, PencilShape& pencil) const
+{
+	const unsigned char* pool = GetPool();
+	pencil.Restore(pool + record.mPoints, record.mPointSize, record.mPointCount,
+		record.mRecordedCount, record.mTolerance);
+	uint64_t offset = record.mPoints + record.mPointSize;
+	for (uint8_t i = 0; i < record.mLevelCount; i++)
+	{
+		offset = Align(offset);
+		const LevelRecord& level = *reinterpret_cast<const LevelRecord*>(pool + offset);
+		offset += sizeof(LevelRecord);
+		pencil.RestoreLevel(level.mTolerance, pool + offset, level.mPointSize, level.mPointCount);
+		offset += level.mPointSize;
+	}
+}
@@ -0,0 +1,126 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <wx/gdicmn.h>
+#include <wx/string.h>
+#include "MappedFile.h"
+#include "Shape.h"
+#include "StyleTable.h"
+
+// Native document format (.pdoc), laid out so a saved document can be
+// mapped and read in place instead of parsed:
+//
+//   Header | StyleRecord * style count | ShapeRecord * shape count | point pool
+//
+// Records are fixed width and every section starts on an 8 byte boundary.
+// Values are in the byte order of the machine that wrote them, which is
+// little-endian for every platform the app builds for; the header says
+// which one it was. Shapes are stored in draw order. Pencil strokes keep
+// their points in the pool in the same delta encoding PointStream uses in
+// memory, followed by a LevelRecord and the points of each coarser level
+// of detail, so loading a stroke is a copy rather than a decode.
+class DocumentFile
+{
+public:
+	static const uint32_t MAGIC = 0x434f4450; // "PDOC"
+	static const uint32_t VERSION = 1;
+	// Reads back as 0x04030201 if the byte order doesn't match
+	static const uint32_t ENDIAN_CHECK = 0x01020304;
+
+	struct Header
+	{
+		uint32_t mMagic;
+		uint32_t mVersion;
+		uint32_t mByteOrder;
+		uint32_t mHeaderSize;
+		// Document size in pixels
+		int32_t mWidth;
+		int32_t mHeight;
+		uint32_t mStyleCount;
+		uint32_t mShapeCount;
+		// Byte offsets of the sections from the start of the file
+		uint64_t mStyleOffset;
+		uint64_t mShapeOffset;
+		uint64_t mPoolOffset;
+		uint64_t mPoolSize;
+	};
+
+	struct StyleRecord
+	{
+		uint32_t mPenColour;
+		int32_t mPenWidth;
+		int32_t mPenStyle;
+		uint32_t mBrushColour;
+		int32_t mBrushStyle;
+		uint32_t mReserved;
+	};
+
+	struct ShapeRecord
+	{
+		// ShapeKind
+		uint8_t mKind;
+		// Pencil levels of detail after the points in the pool
+		uint8_t mLevelCount;
+		uint16_t mReserved;
+		// Index into the style records
+		uint32_t mStyle;
+		// Shape::GetGeometry and the offset, as x, y pairs
+		int32_t mStart[2];
+		int32_t mEnd[2];
+		int32_t mTopLeft[2];
+		int32_t mBotRight[2];
+		int32_t mOffset[2];
+		// Pencil only: where the stroke's deltas start, from the start of
+		// the pool, and how many points and bytes they take
+		uint64_t mPoints;
+		uint32_t mPointCount;
+		uint32_t mPointSize;
+		uint32_t mRecordedCount;
+		float mTolerance;
+	};
+
+	// Precedes each level's deltas in the pool
+	struct LevelRecord
+	{
+		double mTolerance;
+		uint32_t mPointCount;
+		uint32_t mPointSize;
+	};
+
+	// Styles that draw without any extra data (dashes, stipple bitmaps),
+	// the only ones a document can hold
+	static bool IsPlainPenStyle(int32_t style);
+
+	static bool IsPlainBrushStyle(int32_t style);
+
+	// Writes size, the style table and the shapes, in the order given
+	static bool Save(const wxString& filename, const wxSize& size, const StyleTable& styles,
+		const std::vector<const Shape*>& shapes);
+
+	// Maps filename and checks that every record and stroke stays inside
+	// it, so the getters below can be used without any more checks.
+	// Returns false if it isn't a document this version can read.
+	bool Open(const wxString& filename);
+
+	const Header& GetHeader() const { return *reinterpret_cast<const Header*>(mFile.GetData()); }
+
+	const StyleRecord* GetStyles() const
+	{
+		return reinterpret_cast<const StyleRecord*>(mFile.GetData() + GetHeader().mStyleOffset);
+	}
+
+	const ShapeRecord* GetShapes() const
+	{
+		return reinterpret_cast<const ShapeRecord*>(mFile.GetData() + GetHeader().mShapeOffset);
+	}
+	// Copies a pencil record's points and levels of detail into pencil,
+	// which already has the record's geometry
+	void RestoreStroke(const ShapeRecord& record, PencilShape& pencil) const;
+private:
+	// Checks a pencil record's points and levels against the pool
+	bool CheckStroke(const ShapeRecord& record) const;
+
+	const unsigned char* GetPool() const { return mFile.GetData() + GetHeader().mPoolOffset; }
+
+	MappedFile mFile;
+};
@@ -0,0 +1,529 @@
+#include "DocumentJournal.h"
+#include "BinaryRecord.h"
+#include "Command.h"
+#include "DocumentFile.h"
+#include "PaintModel.h"
+#include "Profiler.h"
+#include <wx/dir.h>
+#include <wx/filefn.h>
+#include <wx/filename.h>
+#include <wx/process.h>
+#include <wx/stdpaths.h>
+#include <wx/utils.h>
+#include <algorithm>
+#include <cmath>
+#include <utility>
+
+// Needed for odr-uses
+const uint64_t DocumentJournal::COMPACT_SIZE;
+
+namespace
+{
+	const char* const SNAPSHOT_EXT = ".psnp";
+	const char* const JOURNAL_EXT = ".pjrn";
+
+	enum JournalRecordType
+	{
+		JR_Command,
+		JR_Undo,
+		JR_Redo,
+		JR_Jump,
+		JR_Begin,
+		JR_Commit,
+	};
+
+	wxString GetRecoveryDir()
+	{
+		return wxStandardPaths::Get().GetUserDataDir() + wxFILE_SEP_PATH + "Recovery";
+	}
+
+	wxString GetStem(const wxString& session, unsigned long generation)
+	{
+		return session + wxString::Format("-%lu", generation);
+	}
+
+	// Generations of a session that have a journal, newest first
+	void GetGenerations(const wxString& session, std::vector<unsigned long>& generations)
+	{
+		generations.clear();
+		wxFileName name(session);
+		wxArrayString files;
+		wxDir::GetAllFiles(name.GetPath(), &files, name.GetFullName() + "-*" + JOURNAL_EXT, wxDIR_FILES);
+		for (auto& file : files)
+		{
+			unsigned long generation = 0;
+			if (wxFileName(file).GetName().AfterLast('-').ToULong(&generation))
+			{
+				generations.push_back(generation);
+			}
+		}
+		std::sort(generations.rbegin(), generations.rend());
+	}
+
+	// The journal goes first, so there's never a journal without the
+	// snapshot it applies to
+	void RemoveFiles(const wxString& stem)
+	{
+		if (stem.empty())
+		{
+			return;
+		}
+		if (wxFileExists(stem + JOURNAL_EXT))
+		{
+			wxRemoveFile(stem + JOURNAL_EXT);
+		}
+		if (wxFileExists(stem + SNAPSHOT_EXT))
+		{
+			wxRemoveFile(stem + SNAPSHOT_EXT);
+		}
+	}
+}
+
+DocumentJournal::DocumentJournal()
+: mGeneration(0)
+, mCancel(false)
+, mDone(false)
+, mWritten(false)
+{
+}
+
+DocumentJournal::~DocumentJournal()
+{
+	// Whatever generations are on disk can still recover the document
+	mCancel = true;
+	if (mThread.joinable())
+	{
+		mThread.join();
+	}
+}
+
+bool DocumentJournal::Start(PaintModel& model)
+{
+	PROFILE_SCOPE("DocumentJournal::Start");
+	// None of the previous document's generations can be replayed into
+	// this one
+	Discard();
+	return BeginGeneration(model);
+}
+
+bool DocumentJournal::Compact(PaintModel& model)
+{
+	PROFILE_SCOPE("DocumentJournal::Compact");
+	FinishSnapshot();
+	// The current generation stays until the new one's snapshot is written
+	return BeginGeneration(model);
+}
+
+void DocumentJournal::Discard()
+{
+	mCancel = true;
+	FinishSnapshot();
+	mJournal.Close();
+	for (auto& stem : mStems)
+	{
+		RemoveFiles(stem);
+	}
+	mStems.clear();
+	if (!mOrphan.empty())
+	{
+		RemoveSession(mOrphan);
+		mOrphan.clear();
+	}
+}
+
+bool DocumentJournal::NeedsCompaction()
+{
+	if (mDone)
+	{
+		FinishSnapshot();
+	}
+	return !mThread.joinable() && mJournal.IsOpened() && mJournal.GetSize() >= COMPACT_SIZE;
+}
+
+void DocumentJournal::RecordCommand(Command& command, const StyleTable& styles, StyleId style,
+	uint32_t time)
+{
+	if (!mJournal.IsOpened())
+	{
+		return;
+	}
+	std::shared_ptr<Shape> shape = command.GetShape();
+	const wxPen& pen = styles.GetPen(style);
+	const wxBrush& brush = styles.GetBrush(style);
+	Journal::Record record;
+	RecordWriter writer(record);
+	writer.Put(static_cast<uint8_t>(JR_Command));
+	writer.Put(static_cast<uint8_t>(command.GetType()));
+	writer.Put(static_cast<uint32_t>(shape->GetId()));
+	writer.Put(time);
+	writer.PutPoint(command.GetStartPoint());
+	writer.PutPoint(command.GetEndPoint());
+	writer.Put(static_cast<uint32_t>(pen.GetColour().GetRGBA()));
+	writer.Put(static_cast<uint32_t>(pen.GetWidth()));
+	writer.Put(static_cast<uint32_t>(pen.GetStyle()));
+	writer.Put(static_cast<uint32_t>(brush.GetColour().GetRGBA()));
+	writer.Put(static_cast<uint32_t>(brush.GetStyle()));
+	if (command.GetType() == CM_DrawPencil)
+	{
+		// The tolerance to simplify with, followed by every sample as drawn
+		const PencilShape& pencil = static_cast<const PencilShape&>(*shape);
+		writer.PutDouble(pencil.GetTolerance());
+		writer.Put(static_cast<uint32_t>(pencil.GetPointCount()));
+		pencil.GetPoints().GetDeltas(record);
+	}
+	mJournal.Append(record);
+}
+
+void DocumentJournal::RecordUndo()
+{
+	Journal::Record record;
+	RecordWriter(record).Put(static_cast<uint8_t>(JR_Undo));
+	mJournal.Append(record);
+}
+
+void DocumentJournal::RecordRedo()
+{
+	Journal::Record record;
+	RecordWriter(record).Put(static_cast<uint8_t>(JR_Redo));
+	mJournal.Append(record);
+}
+
+void DocumentJournal::RecordJump(long steps)
+{
+	Journal::Record record;
+	RecordWriter writer(record);
+	writer.Put(static_cast<uint8_t>(JR_Jump));
+	writer.Put(static_cast<uint32_t>(steps));
+	mJournal.Append(record);
+}
+
+void DocumentJournal::RecordBegin()
+{
+	Journal::Record record;
+	RecordWriter(record).Put(static_cast<uint8_t>(JR_Begin));
+	mJournal.Append(record);
+}
+
+void DocumentJournal::RecordCommit()
+{
+	Journal::Record record;
+	RecordWriter(record).Put(static_cast<uint8_t>(JR_Commit));
+	mJournal.Append(record);
+}
+
+void DocumentJournal::FindOrphans(std::vector<wxString>& sessions)
+{
+	sessions.clear();
+	wxString dir = GetRecoveryDir();
+	if (!wxDirExists(dir))
+	{
+		return;
+	}
+	wxArrayString files;
+	wxDir::GetAllFiles(dir, &files, wxString("session-*") + JOURNAL_EXT, wxDIR_FILES);
+	std::vector<std::pair<time_t, wxString>> found;
+	for (auto& file : files)
+	{
+		wxFileName name(file);
+		// session-<pid>-<generation>
+		wxString pidText = name.GetName().AfterFirst('-').BeforeFirst('-');
+		unsigned long pid = 0;
+		if (!pidText.ToULong(&pid) || pid == wxGetProcessId() || wxProcess::Exists(static_cast<int>(pid)))
+		{
+			continue;
+		}
+		wxString session = name.GetPath() + wxFILE_SEP_PATH + "session-" + pidText;
+		time_t modified = name.GetModificationTime().GetTicks();
+		auto iter = std::find_if(found.begin(), found.end(),
+			[&session](const std::pair<time_t, wxString>& entry) { return entry.second == session; });
+		if (iter == found.end())
+		{
+			found.push_back(std::make_pair(modified, session));
+		}
+		else
+		{
+			iter->first = std::max(iter->first, modified);
+		}
+	}
+	std::sort(found.rbegin(), found.rend());
+	for (auto& entry : found)
+	{
+		sessions.push_back(entry.second);
+	}
+}
+
+bool DocumentJournal::Recover(const wxString& session, PaintModel& model)
+{
+	PROFILE_SCOPE("DocumentJournal::Recover");
+	// A crash while a snapshot was being written leaves it incomplete, but
+	// then the generations before it are still there
+	std::vector<unsigned long> generations;
+	GetGenerations(session, generations);
+	size_t base = 0;
+	while (base < generations.size() && !model.LoadSession(GetStem(session, generations[base]) + SNAPSHOT_EXT))
+	{
+		base++;
+	}
+	if (base == generations.size())
+	{
+		return false;
+	}
+
+	// Replaying mustn't record anything into the journal being recovered
+	DocumentJournal* journal = model.GetJournal();
+	model.SetJournal(nullptr);
+	// The snapshot's own journal, then the newer ones, oldest first
+	generations.erase(generations.begin() + base + 1, generations.end());
+	std::reverse(generations.begin(), generations.end());
+	bool replaying = true;
+	for (auto generation : generations)
+	{
+		std::vector<Journal::Record> records;
+		replaying = replaying && Journal::Read(GetStem(session, generation) + JOURNAL_EXT, records);
+		for (size_t i = 0; replaying && i < records.size(); i++)
+		{
+			replaying = Replay(records[i], model);
+		}
+	}
+	// A transaction the crash cut short keeps what it got to
+	while (model.IsInTransaction())
+	{
+		model.CommitTransaction();
+	}
+	model.SetJournal(journal);
+
+	// Without a snapshot of its own, the document can still be recovered
+	// from the orphan next time
+	if (Start(model))
+	{
+		mOrphan = session;
+	}
+	return true;
+}
+
+void DocumentJournal::RemoveSession(const wxString& session)
+{
+	// Journals first, as in RemoveFiles. Snapshots whose journal is gone
+	// go too.
+	wxFileName name(session);
+	const char* const extensions[] = { JOURNAL_EXT, SNAPSHOT_EXT };
+	for (auto extension : extensions)
+	{
+		wxArrayString files;
+		wxDir::GetAllFiles(name.GetPath(), &files, name.GetFullName() + "-*" + extension, wxDIR_FILES);
+		for (auto& file : files)
+		{
+			wxRemoveFile(file);
+		}
+	}
+}
+
+bool DocumentJournal::Replay(const Journal::Record& record, PaintModel& model)
+{
+	RecordReader reader(record);
+	uint8_t type = 0;
+	if (!reader.Get(type))
+	{
+		return false;
+	}
+	if (type == JR_Undo)
+	{
+		if (!reader.IsAtEnd() || !model.CanUndo())
+		{
+			return false;
+		}
+		model.Undo();
+		return true;
+	}
+	if (type == JR_Redo)
+	{
+		if (!reader.IsAtEnd() || !model.CanRedo())
+		{
+			return false;
+		}
+		model.Redo();
+		return true;
+	}
+	if (type == JR_Jump)
+	{
+		uint32_t steps = 0;
+		if (!reader.Get(steps) || !reader.IsAtEnd())
+		{
+			return false;
+		}
+		long target = static_cast<long>(model.GetRevision()) + static_cast<int32_t>(steps);
+		if (target < 0 || static_cast<size_t>(target) > model.GetLastRevision())
+		{
+			return false;
+		}
+		return model.GoToRevision(static_cast<size_t>(target));
+	}
+	if (type == JR_Begin)
+	{
+		if (!reader.IsAtEnd() || model.IsInTransaction())
+		{
+			return false;
+		}
+		model.BeginTransaction();
+		return true;
+	}
+	if (type == JR_Commit)
+	{
+		if (!reader.IsAtEnd() || !model.IsInTransaction())
+		{
+			return false;
+		}
+		model.CommitTransaction();
+		return true;
+	}
+
+	uint8_t kind = 0;
+	uint32_t id = 0, time = 0;
+	wxPoint start, end;
+	uint32_t penColour = 0, penWidth = 0, penStyle = 0, brushColour = 0, brushStyle = 0;
+	if (type != JR_Command || !reader.Get(kind) || !reader.Get(id) || !reader.Get(time) || !reader.GetPoint(start) ||
+		!reader.GetPoint(end) || !reader.Get(penColour) || !reader.Get(penWidth) || !reader.Get(penStyle) ||
+		!reader.Get(brushColour) || !reader.Get(brushStyle) || kind > CM_SetBrush ||
+		static_cast<int32_t>(penWidth) < 0 || !DocumentFile::IsPlainPenStyle(static_cast<int32_t>(penStyle)) ||
+		!DocumentFile::IsPlainBrushStyle(static_cast<int32_t>(brushStyle)))
+	{
+		return false;
+	}
+	CommandType command = static_cast<CommandType>(kind);
+	bool drawing = command == CM_DrawLine || command == CM_DrawEllipse || command == CM_DrawRect ||
+		command == CM_DrawPencil;
+	// Drawing adds a shape with the next ID, every other command acts on
+	// the selection
+	if ((model.GetShape(id) == nullptr) != drawing)
+	{
+		return false;
+	}
+
+	PointStream points;
+	double tolerance = 0.0;
+	if (command == CM_DrawPencil)
+	{
+		uint32_t count = 0;
+		if (!reader.GetDouble(tolerance) || !reader.Get(count))
+		{
+			return false;
+		}
+		size_t size = 0;
+		const unsigned char* deltas = reader.GetRest(size);
+		if (!std::isfinite(tolerance) || tolerance < 0.0 || count == 0 ||
+			!PointStream::CheckDeltas(deltas, size, count))
+		{
+			return false;
+		}
+		points.Assign(start, end, deltas, size, count);
+	}
+	else if (!reader.IsAtEnd())
+	{
+		return false;
+	}
+
+	wxColour colour;
+	colour.SetRGBA(penColour);
+	wxPen pen(colour, static_cast<int>(penWidth), static_cast<wxPenStyle>(penStyle));
+	colour.SetRGBA(brushColour);
+	model.SetPenAndBrush(pen, wxBrush(colour, static_cast<wxBrushStyle>(brushStyle)));
+	if (!drawing)
+	{
+		model.SelectShape(static_cast<ShapeId>(id));
+	}
+	model.SetTime(time);
+
+	if (command == CM_DrawPencil)
+	{
+		double simplifyTolerance = model.GetSimplifyTolerance();
+		model.SetSimplifyTolerance(tolerance);
+		model.CreateCommand(command, start);
+		model.SetSimplifyTolerance(simplifyTolerance);
+		PointStream::Reader reader(points);
+		wxPoint point;
+		// The first sample is the start point
+		reader.Next(point);
+		while (reader.Next(point))
+		{
+			model.UpdateCommand(point);
+		}
+	}
+	else
+	{
+		model.CreateCommand(command, start);
+		// Only drawing and moving follow the mouse
+		if (drawing || command == CM_Move)
+		{
+			model.UpdateCommand(end);
+		}
+	}
+	model.FinalizeCommand();
+	return true;
+}
+
+bool DocumentJournal::BeginGeneration(PaintModel& model)
+{
+	wxString stem = MakeStem();
+	mJournal.Close();
+	if (stem.empty() || !mJournal.Create(stem + JOURNAL_EXT))
+	{
+		RemoveFiles(stem);
+		Discard();
+		return false;
+	}
+	mStems.push_back(stem);
+	// Nothing is recorded between capturing the model and opening the
+	// journal, so the journal starts right where the snapshot does
+	mSnapshot.reset(new SessionSnapshot());
+	model.CaptureSession(*mSnapshot);
+	mCancel = false;
+	mDone = false;
+	mWritten = false;
+	mThread = std::thread(&DocumentJournal::WriteSnapshot, this, stem + SNAPSHOT_EXT);
+	return true;
+}
+
+void DocumentJournal::WriteSnapshot(const wxString& filename)
+{
+	mWritten = mSnapshot->Write(filename, mCancel);
+	mDone = true;
+}
+
+void DocumentJournal::FinishSnapshot()
+{
+	if (!mThread.joinable())
+	{
+		return;
+	}
+	mThread.join();
+	mSnapshot.reset();
+	if (!mWritten)
+	{
+		// The generations before keep the document recoverable, and the
+		// next compaction tries again
+		return;
+	}
+	// Oldest first, as in RemoveFiles, so what's left is always a snapshot
+	// followed by the journals that apply to it
+	while (mStems.size() > 1)
+	{
+		RemoveFiles(mStems.front());
+		mStems.erase(mStems.begin());
+	}
+	if (!mOrphan.empty())
+	{
+		RemoveSession(mOrphan);
+		mOrphan.clear();
+	}
+}
+
+wxString DocumentJournal::MakeStem()
+{
+	wxString dir = GetRecoveryDir();
+	if (!wxDirExists(dir) && !wxFileName::Mkdir(dir, wxS_DIR_DEFAULT, wxPATH_MKDIR_FULL))
+	{
+		return wxString();
+	}
+	mGeneration++;
+	return GetStem(dir + wxFILE_SEP_PATH + wxString::Format("session-%lu", wxGetProcessId()), mGeneration);
+}
@@ -0,0 +1,118 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <thread>
+#include <vector>
+#include <wx/string.h>
+#include "Journal.h"
+#include "SessionSnapshot.h"
+#include "StyleTable.h"
+
+class Command;
+class PaintModel;
+
+// Keeps the open document recoverable after a crash. Starting a journal
+// takes a SessionSnapshot of the document and its undo/redo history
+// (.psnp), and every command finalized after that, along with every undo,
+// redo and jump through the history and where each transaction begins and
+// is committed, is appended to a Journal next to it (.pjrn). Replaying the
+// journal over the snapshot rebuilds the document and its history.
+//
+// Once the journal grows past COMPACT_SIZE, a new generation is started:
+// the model is captured and a new, empty journal opened on the UI thread,
+// and the snapshot is written on a background thread. Until it's done, the
+// older generations stay on disk, and the document is recovered from the
+// oldest one's snapshot followed by every journal in order.
+//
+// The files of a generation are named session-<pid>-<generation> and
+// live in the user data directory. They're removed when the app exits
+// normally, so any left behind by a process that isn't running anymore
+// come from a crash.
+class DocumentJournal
+{
+public:
+	// Journal size that makes the model take a new snapshot
+	static const uint64_t COMPACT_SIZE = 64 * 1024 * 1024;
+
+	DocumentJournal();
+	// Waits for a snapshot being written, leaving the files on disk
+	~DocumentJournal();
+	// Starts journaling model, a new document, in place of the previous
+	// one, whose files are removed. Call with no command or transaction in
+	// progress. Returns false, leaving nothing recorded, if the journal
+	// can't be created.
+	bool Start(PaintModel& model);
+	// Starts a new generation of the same document, so the journal stops
+	// growing. Call with no command or transaction in progress.
+	bool Compact(PaintModel& model);
+	// Closes the journal and removes every file of the session, along with
+	// the orphan it was recovered from
+	void Discard();
+	// Appends command, which is about to be finalized at time; styles is
+	// the model's style table and style its current style. The time lets a
+	// replay merge the command with the one before it if the model did.
+	void RecordCommand(Command& command, const StyleTable& styles, StyleId style, uint32_t time);
+
+	void RecordUndo();
+
+	void RecordRedo();
+	// Records PaintModel::GoToRevision moving by steps revisions, which are
+	// negative going back
+	void RecordJump(long steps);
+	// Records the outermost PaintModel::BeginTransaction
+	void RecordBegin();
+	// Records the outermost PaintModel::CommitTransaction
+	void RecordCommit();
+
+	// True once the journal is past COMPACT_SIZE and no snapshot is being
+	// written anymore. Also removes the generations a snapshot that's
+	// been written makes unnecessary.
+	bool NeedsCompaction();
+	// Sessions left behind by processes that aren't running anymore, most
+	// recent first
+	static void FindOrphans(std::vector<wxString>& sessions);
+	// Loads the latest complete snapshot of an orphaned session into model
+	// and replays the journals from its generation on, then starts
+	// journaling the recovered document. The orphan's files are removed
+	// once the recovered document's first snapshot is written. Records past
+	// the first one that can't be replayed are dropped. Returns false,
+	// leaving the orphan alone, if there's nothing to recover.
+	bool Recover(const wxString& session, PaintModel& model);
+	// Removes every file of an orphaned session
+	static void RemoveSession(const wxString& session);
+
+	// Disallow copy/assignment
+	DocumentJournal(const DocumentJournal&) = delete;
+	DocumentJournal& operator=(const DocumentJournal&) = delete;
+private:
+	// Applies a record made by one of the Record methods; returns false if
+	// it doesn't fit the model's state
+	static bool Replay(const Journal::Record& record, PaintModel& model);
+	// Opens a new generation's journal and captures model for its
+	// snapshot, which is written on mThread
+	bool BeginGeneration(PaintModel& model);
+	// Runs on mThread
+	void WriteSnapshot(const wxString& filename);
+	// Waits for the snapshot being written, if any. Once one is written,
+	// the generations before it and the orphan it was recovered from are
+	// removed.
+	void FinishSnapshot();
+	// Path of the next generation's files, without the extension
+	wxString MakeStem();
+
+	Journal mJournal;
+	// Generations the document is recovered from, oldest first, without
+	// the extension
+	std::vector<wxString> mStems;
+	unsigned long mGeneration;
+	// Session the document was recovered from, if any
+	wxString mOrphan;
+	// Snapshot of the newest generation, while it's being written
+	std::unique_ptr<SessionSnapshot> mSnapshot;
+	std::thread mThread;
+	std::atomic<bool> mCancel;
+	// Set by mThread once it's done, along with whether it succeeded
+	std::atomic<bool> mDone;
+	std::atomic<bool> mWritten;
+};
@@ -0,0 +1,312 @@
+#include "DrawList.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <cstdlib>
+#include <unordered_set>
+
+// Most rectangles drawn in one DrawPolyPolygon call
+static const size_t MAX_RECT_BATCH = 64;
+
+// Shapes smaller than this many device pixels (pen included) are drawn
+// as dots when zoomed out
+static const double LOD_PIXELS = 2.0;
+
+class DrawList::DotBatch
+{
+public:
+	DotBatch(wxDC& dc)
+	: mScale(1.0)
+	, mPenWidth(0)
+	{
+		double scaleX = 1.0;
+		double scaleY = 1.0;
+		dc.GetUserScale(&scaleX, &scaleY);
+		mScale = std::min(scaleX, scaleY);
+		// At 100% or more every shape is at least as big as it'd be as a dot
+		mEnabled = mScale < 1.0;
+		mLimit = LOD_PIXELS / mScale;
+		mDotSize = std::max(1, static_cast<int>(std::ceil(1.0 / mScale)));
+	}
+	
+	void Begin(const wxPen& pen)
+	{
+		mPenWidth = pen.IsTransparent() ? 0 : pen.GetWidth();
+	}
+	// Returns whether bounds is too small to draw, in which case a dot
+	// takes its place unless its pixel already has one
+	bool Add(const wxRect& bounds)
+	{
+		if (!mEnabled || bounds.width + mPenWidth >= mLimit || bounds.height + mPenWidth >= mLimit)
+		{
+			return false;
+		}
+		long long x = static_cast<long long>(std::floor((bounds.x + bounds.width * 0.5) * mScale));
+		long long y = static_cast<long long>(std::floor((bounds.y + bounds.height * 0.5) * mScale));
+		// Shift the unsigned bits, since shifting a negative x is undefined
+		uint64_t key = (static_cast<uint64_t>(static_cast<uint32_t>(x)) << 32) | static_cast<uint32_t>(y);
+		if (mUsed.insert(key).second)
+		{
+			// Snap to the device pixel so neighbouring dots don't overlap
+			wxPoint topLeft(static_cast<int>(std::floor(x / mScale)), static_cast<int>(std::floor(y / mScale)));
+			mPoints.push_back(topLeft);
+			mPoints.push_back(topLeft + wxPoint(mDotSize, 0));
+			mPoints.push_back(topLeft + wxPoint(mDotSize, mDotSize));
+			mPoints.push_back(topLeft + wxPoint(0, mDotSize));
+		}
+		return true;
+	}
+	// Draws the dots in the run's pen colour (its brush if it has no
+	// pen) and starts over for the next run
+	void Flush(wxDC& dc, const wxPen& pen, const wxBrush& brush)
+	{
+		if (!mPoints.empty() && (!pen.IsTransparent() || !brush.IsTransparent()))
+		{
+			dc.SetPen(*wxTRANSPARENT_PEN);
+			dc.SetBrush(wxBrush(pen.IsTransparent() ? brush.GetColour() : pen.GetColour()));
+			std::vector<int> counts;
+			for (size_t first = 0; first < mPoints.size(); first += MAX_RECT_BATCH * 4)
+			{
+				size_t count = std::min(MAX_RECT_BATCH * 4, mPoints.size() - first) / 4;
+				counts.assign(count, 4);
+				dc.DrawPolyPolygon(static_cast<int>(count), counts.data(), &mPoints[first],
+					0, 0, wxWINDING_RULE);
+			}
+		}
+		mPoints.clear();
+		mUsed.clear();
+	}
+private:
+	double mScale;
+	bool mEnabled;
+	// Largest size, in document pixels, that still gets a dot
+	double mLimit;
+	// Document pixels covered by one device pixel
+	int mDotSize;
+	int mPenWidth;
+	// Device pixels that already have a dot in this run
+	std::unordered_set<uint64_t> mUsed;
+	// Four corners per dot
+	std::vector<wxPoint> mPoints;
+};
+
+DrawList::DrawList()
+: mCount(0)
+{
+	
+}
+
+void DrawList::Clear()
+{
+	mRects.clear();
+	mEllipses.clear();
+	mLines.clear();
+	mPencils.clear();
+	mRuns.clear();
+	mCount = 0;
+}
+
+void DrawList::Add(const Shape& shape)
+{
+	ShapeKind kind = shape.GetKind();
+	StyleId style = shape.GetStyle();
+	unsigned int index = 0;
+	
+	wxPoint topLeft;
+	wxPoint botRight;
+	shape.GetBounds(topLeft, botRight);
+	switch (kind)
+	{
+		case SK_Rect:
+			index = static_cast<unsigned int>(mRects.size());
+			mRects.push_back(wxRect(topLeft, botRight));
+			break;
+		case SK_Ellipse:
+			index = static_cast<unsigned int>(mEllipses.size());
+			mEllipses.push_back(wxRect(topLeft, botRight));
+			break;
+		case SK_Line:
+		{
+			wxPoint start;
+			wxPoint end;
+			static_cast<const LineShape&>(shape).GetEndpoints(start, end);
+			index = static_cast<unsigned int>(mLines.size() / 2);
+			mLines.push_back(start);
+			mLines.push_back(end);
+			break;
+		}
+		case SK_Pencil:
+			index = static_cast<unsigned int>(mPencils.size());
+			mPencils.push_back(static_cast<const PencilShape*>(&shape));
+			break;
+	}
+	
+	if (!mRuns.empty() && mRuns.back().mKind == kind && mRuns.back().mStyle == style)
+	{
+		mRuns.back().mCount++;
+	}
+	else
+	{
+		Run run;
+		run.mKind = kind;
+		run.mStyle = style;
+		run.mFirst = index;
+		run.mCount = 1;
+		mRuns.push_back(run);
+	}
+	mCount++;
+}
+
+void DrawList::Draw(wxDC& dc, const StyleTable& styles) const
+{
+	DotBatch dots(dc);
+	for (auto& run : mRuns)
+	{
+		const wxPen& pen = styles.GetPen(run.mStyle);
+		const wxBrush& brush = styles.GetBrush(run.mStyle);
+		dc.SetPen(pen);
+		dc.SetBrush(brush);
+		dots.Begin(pen);
+		switch (run.mKind)
+		{
+			case SK_Rect:
+			{
+				PROFILE_SCOPE("DrawList::Draw rects");
+				DrawRects(dc, run, !brush.IsTransparent(), dots);
+				break;
+			}
+			case SK_Ellipse:
+			{
+				PROFILE_SCOPE("DrawList::Draw ellipses");
+				for (unsigned int i = run.mFirst; i < run.mFirst + run.mCount; i++)
+				{
+					if (!dots.Add(mEllipses[i]))
+					{
+						dc.DrawEllipse(mEllipses[i]);
+					}
+				}
+				break;
+			}
+			case SK_Line:
+			{
+				PROFILE_SCOPE("DrawList::Draw lines");
+				DrawLines(dc, run, dots);
+				break;
+			}
+			case SK_Pencil:
+			{
+				PROFILE_SCOPE("DrawList::Draw pencils");
+				for (unsigned int i = run.mFirst; i < run.mFirst + run.mCount; i++)
+				{
+					wxPoint topLeft;
+					wxPoint botRight;
+					mPencils[i]->GetBounds(topLeft, botRight);
+					if (!dots.Add(wxRect(topLeft, botRight)))
+					{
+						mPencils[i]->DrawPoints(dc);
+					}
+				}
+				break;
+			}
+		}
+		dots.Flush(dc, pen, brush);
+	}
+}
+
+void DrawList::DrawRects(wxDC& dc, const Run& run, bool filled, DotBatch& dots) const
+{
+	if (run.mCount == 1)
+	{
+		if (!dots.Add(mRects[run.mFirst]))
+		{
+			dc.DrawRectangle(mRects[run.mFirst]);
+		}
+		return;
+	}
+	
+	// A poly-polygon fills every rectangle before stroking any outline, so
+	// an outline would show through a filled rectangle drawn over it.
+	// Start a new batch whenever a filled rectangle overlaps the batch.
+	std::vector<wxPoint> points;
+	std::vector<int> counts;
+	points.reserve(std::min<size_t>(run.mCount, MAX_RECT_BATCH) * 4);
+	size_t batchStart = run.mFirst;
+	
+	auto flush = [&]()
+	{
+		if (!counts.empty())
+		{
+			dc.DrawPolyPolygon(static_cast<int>(counts.size()), counts.data(), points.data(),
+				0, 0, wxWINDING_RULE);
+			points.clear();
+			counts.clear();
+		}
+	};
+	
+	for (size_t i = run.mFirst; i < run.mFirst + run.mCount; i++)
+	{
+		const wxRect& rect = mRects[i];
+		if (dots.Add(rect))
+		{
+			continue;
+		}
+		bool overlaps = false;
+		if (filled)
+		{
+			for (size_t j = batchStart; j < i && !overlaps; j++)
+			{
+				overlaps = rect.Intersects(mRects[j]);
+			}
+		}
+		if (overlaps || counts.size() == MAX_RECT_BATCH)
+		{
+			flush();
+			batchStart = i;
+		}
+		points.push_back(rect.GetTopLeft());
+		points.push_back(rect.GetTopRight());
+		points.push_back(rect.GetBottomRight());
+		points.push_back(rect.GetBottomLeft());
+		counts.push_back(4);
+	}
+	flush();
+}
+
+void DrawList::DrawLines(wxDC& dc, const Run& run, DotBatch& dots) const
+{
+	// Lines of the same style can be drawn in any order, so chain the
+	// ones that share an endpoint into a single polyline
+	std::vector<wxPoint> chain;
+	auto flush = [&]()
+	{
+		if (chain.size() == 2)
+		{
+			dc.DrawLine(chain[0], chain[1]);
+		}
+		else if (chain.size() > 2)
+		{
+			dc.DrawLines(static_cast<int>(chain.size()), chain.data());
+		}
+		chain.clear();
+	};
+	
+	for (size_t i = run.mFirst; i < run.mFirst + run.mCount; i++)
+	{
+		const wxPoint& start = mLines[i * 2];
+		const wxPoint& end = mLines[i * 2 + 1];
+		wxRect bounds(std::min(start.x, end.x), std::min(start.y, end.y),
+			std::abs(end.x - start.x), std::abs(end.y - start.y));
+		if (dots.Add(bounds))
+		{
+			continue;
+		}
+		if (chain.empty() || chain.back() != start)
+		{
+			flush();
+			chain.push_back(start);
+		}
+		chain.push_back(end);
+	}
+	flush();
+}
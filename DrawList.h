@@ -0,0 +1,57 @@
+#pragma once
+#include <vector>
+#include <wx/dc.h>
+#include "Shape.h"
+#include "StyleTable.h"
+
+// Structure-of-arrays snapshot of a sequence of shapes, in draw order.
+// Geometry is kept in one array per shape kind and styles are referenced
+// by their StyleTable handle, so consecutive shapes of the same kind and
+// style can be drawn as one run with a single pen/brush change.
+class DrawList
+{
+public:
+	DrawList();
+	
+	void Clear();
+	// Appends a shape on top of everything added so far
+	void Add(const Shape& shape);
+	// Draws every shape, one run at a time. When the DC is scaled down,
+	// shapes less than two device pixels across are drawn as dots, at
+	// most one per device pixel and run.
+	void Draw(wxDC& dc, const StyleTable& styles) const;
+	
+	size_t GetCount() const { return mCount; }
+	
+	size_t GetRunCount() const { return mRuns.size(); }
+private:
+	// Consecutive shapes of the same kind and style
+	struct Run
+	{
+		ShapeKind mKind;
+		StyleId mStyle;
+		// Index of the first shape in the array for mKind
+		unsigned int mFirst;
+		unsigned int mCount;
+	};
+	
+	// Collects the dots standing in for shapes too small to draw
+	class DotBatch;
+	
+	void DrawRects(wxDC& dc, const Run& run, bool filled, DotBatch& dots) const;
+	
+	void DrawLines(wxDC& dc, const Run& run, DotBatch& dots) const;
+	
+	// Geometry per shape kind
+	std::vector<wxRect> mRects;
+	std::vector<wxRect> mEllipses;
+	// Start and end point of each line
+	std::vector<wxPoint> mLines;
+	// Freehand strokes keep their points in the shape itself; the owner
+	// of the list must rebuild it before any of these shapes go away
+	std::vector<const PencilShape*> mPencils;
+	// Draw order
+	std::vector<Run> mRuns;
+	// Total number of shapes
+	size_t mCount;
+};
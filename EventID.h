@@ -12,5 +12,19 @@ enum EventID
 	ID_SetPenWidth,
 	ID_SetBrushColor,
 	ID_Unselect,
-	ID_Delete
+	ID_Delete,
+	ID_CancelExport,
+	ID_ExportProgress,
+	ID_ExportDone,
+	ID_CancelImport,
+	ID_ImportProgress,
+	ID_ImportPreview,
+	ID_ImportDone,
+	ID_RecordInput,
+	ID_ShowTimings,
+	ID_ResetTimings,
+	ID_RecordTrace,
+	ID_TimingsTimer,
+	ID_SetHistoryBudget,
+	ID_HistorySlider
 };
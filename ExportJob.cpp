@@ -0,0 +1,113 @@
+#include "ExportJob.h"
+#include "Profiler.h"
+#include "TileRenderer.h"
+#include "PngWriter.h"
+#include <wx/image.h>
+#include <wx/filefn.h>
+
+namespace
+{
+	// Share of the progress bar taken by rasterizing; encoding gets the rest
+	const int RENDER_PERCENT = 40;
+}
+
+ExportJob::ExportJob(PaintModel& model, const wxSize& size, const wxString& filename,
+	wxBitmapType type, wxEvtHandler* handler, int progressID, int doneID)
+: mFilename(filename)
+, mType(type)
+, mHandler(handler)
+, mProgressID(progressID)
+, mDoneID(doneID)
+, mCancel(false)
+, mLastPercent(-1)
+{
+	mSnapshot.Capture(model, size);
+}
+
+ExportJob::~ExportJob()
+{
+	Cancel();
+	if (mThread.joinable())
+	{
+		mThread.join();
+	}
+}
+
+void ExportJob::Start()
+{
+	mThread = std::thread(&ExportJob::Run, this);
+}
+
+void ExportJob::ReportProgress(int percent)
+{
+	// Tiles and bands finish on several threads; only one of them gets
+	// to report each new value
+	int last = mLastPercent;
+	while (percent > last)
+	{
+		if (mLastPercent.compare_exchange_weak(last, percent))
+		{
+			wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, mProgressID);
+			event->SetInt(percent);
+			wxQueueEvent(mHandler, event);
+			return;
+		}
+	}
+}
+
+void ExportJob::Run()
+{
+	Result result = ER_Done;
+	RasterImage raster(mSnapshot.GetSize().GetWidth(), mSnapshot.GetSize().GetHeight());
+	TileRenderer renderer;
+	bool rendered = renderer.Render(mSnapshot, raster, &mCancel, [this](size_t done, size_t total)
+	{
+		ReportProgress(static_cast<int>(done * RENDER_PERCENT / total));
+	});
+	
+	if (!rendered)
+	{
+		result = ER_Cancelled;
+	}
+	else if (mType == wxBITMAP_TYPE_PNG)
+	{
+		PngWriter writer;
+		bool written = writer.Write(raster, mFilename, &mCancel, [this](size_t done, size_t total)
+		{
+			ReportProgress(RENDER_PERCENT + static_cast<int>(done * (100 - RENDER_PERCENT) / total));
+		});
+		if (!written)
+		{
+			result = mCancel ? ER_Cancelled : ER_Failed;
+		}
+	}
+	else
+	{
+		// wx's JPEG and BMP encoders are single threaded and can't be
+		// interrupted, so cancelling only helps up to this point
+		PROFILE_SCOPE("ExportJob wx encode");
+		wxImage image = raster.ToImage();
+		if (mCancel)
+		{
+			result = ER_Cancelled;
+		}
+		else if (!image.SaveFile(mFilename, mType))
+		{
+			result = ER_Failed;
+		}
+		else if (mCancel)
+		{
+			wxRemoveFile(mFilename);
+			result = ER_Cancelled;
+		}
+	}
+	
+	if (result == ER_Done)
+	{
+		ReportProgress(100);
+	}
+	wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, mDoneID);
+	event->SetInt(result);
+	event->SetString(mFilename);
+	wxQueueEvent(mHandler, event);
+}
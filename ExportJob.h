@@ -0,0 +1,56 @@
+#pragma once
+#include <atomic>
+#include <thread>
+#include <wx/event.h>
+#include <wx/string.h>
+#include <wx/bitmap.h>
+#include "RenderSnapshot.h"
+
+class PaintModel;
+
+// Exports a snapshot of the model to an image file on a background
+// thread: rasterizes it with TileRenderer, then encodes it (PNG with
+// PngWriter, anything else through wxImage). Progress and the outcome
+// are sent to the handler as wxThreadEvents with the IDs given, so the
+// UI stays responsive and the model can keep changing meanwhile.
+class ExportJob
+{
+public:
+	// How the job ended, sent as the int of the done event
+	enum Result
+	{
+		ER_Done,
+		ER_Failed,
+		ER_Cancelled
+	};
+	
+	// Snapshots the model; call on the UI thread
+	ExportJob(PaintModel& model, const wxSize& size, const wxString& filename,
+		wxBitmapType type, wxEvtHandler* handler, int progressID, int doneID);
+	// Cancels the job if it's still running and waits for it to stop
+	~ExportJob();
+	
+	void Start();
+	// Asks the job to stop as soon as possible; the done event still comes
+	void Cancel() { mCancel = true; }
+	
+	const wxString& GetFilename() const { return mFilename; }
+	
+	// Disallow copy/assignment
+	ExportJob(const ExportJob&) = delete;
+	ExportJob& operator=(const ExportJob&) = delete;
+private:
+	void Run();
+	// Sends overall progress in percent, skipping repeats
+	void ReportProgress(int percent);
+	
+	RenderSnapshot mSnapshot;
+	wxString mFilename;
+	wxBitmapType mType;
+	wxEvtHandler* mHandler;
+	int mProgressID;
+	int mDoneID;
+	std::atomic<bool> mCancel;
+	std::atomic<int> mLastPercent;
+	std::thread mThread;
+};
@@ -0,0 +1,102 @@
+#include "HistoryCheckpoints.h"
+#include <algorithm>
+#include <iterator>
+#include <utility>
+
+// Needed for odr-uses
+const size_t HistoryCheckpoints::MIN_INTERVAL;
+const size_t HistoryCheckpoints::SHAPES_PER_COMMAND;
+
+namespace
+{
+	size_t GetBytes(const HistoryCheckpoints::Checkpoint& checkpoint)
+	{
+		return sizeof(std::pair<const size_t, HistoryCheckpoints::Checkpoint>) +
+			checkpoint.capacity() * sizeof(HistoryCheckpoints::ShapeState);
+	}
+}
+
+HistoryCheckpoints::HistoryCheckpoints()
+: mMemoryUsage(0)
+{
+}
+
+bool HistoryCheckpoints::IsDue(size_t revision, size_t shapeCount, size_t budget) const
+{
+	if (mMemoryUsage + GetBytes(Checkpoint()) + shapeCount * sizeof(ShapeState) > budget)
+	{
+		return false;
+	}
+	size_t at = 0;
+	if (Find(revision, at) == nullptr)
+	{
+		// Anything is better than undoing all the way
+		return true;
+	}
+	return revision - at >= std::max(MIN_INTERVAL, shapeCount / SHAPES_PER_COMMAND);
+}
+
+void HistoryCheckpoints::Add(size_t revision, Checkpoint&& checkpoint)
+{
+	auto result = mCheckpoints.insert(std::make_pair(revision, Checkpoint()));
+	if (!result.second)
+	{
+		mMemoryUsage -= GetBytes(result.first->second);
+	}
+	result.first->second = std::move(checkpoint);
+	mMemoryUsage += GetBytes(result.first->second);
+}
+
+const HistoryCheckpoints::Checkpoint* HistoryCheckpoints::Find(size_t revision, size_t& at) const
+{
+	auto iter = mCheckpoints.upper_bound(revision);
+	if (iter == mCheckpoints.begin())
+	{
+		return nullptr;
+	}
+	--iter;
+	at = iter->first;
+	return &iter->second;
+}
+
+void HistoryCheckpoints::Truncate(size_t revision)
+{
+	auto first = mCheckpoints.upper_bound(revision);
+	for (auto iter = first; iter != mCheckpoints.end(); ++iter)
+	{
+		mMemoryUsage -= GetBytes(iter->second);
+	}
+	mCheckpoints.erase(first, mCheckpoints.end());
+}
+
+bool HistoryCheckpoints::GetFurthest(size_t revision, size_t& distance) const
+{
+	if (mCheckpoints.empty())
+	{
+		return false;
+	}
+	size_t at = FindFurthest(revision)->first;
+	distance = at < revision ? revision - at : at - revision;
+	return true;
+}
+
+void HistoryCheckpoints::DropFurthest(size_t revision)
+{
+	if (mCheckpoints.empty())
+	{
+		return;
+	}
+	auto iter = FindFurthest(revision);
+	mMemoryUsage -= GetBytes(iter->second);
+	mCheckpoints.erase(iter);
+}
+
+HistoryCheckpoints::CheckpointMap::const_iterator HistoryCheckpoints::FindFurthest(size_t revision) const
+{
+	// It's either the first or the last
+	auto first = mCheckpoints.begin();
+	auto last = std::prev(mCheckpoints.end());
+	size_t firstDistance = first->first < revision ? revision - first->first : first->first - revision;
+	size_t lastDistance = last->first < revision ? revision - last->first : last->first - revision;
+	return firstDistance >= lastDistance ? first : last;
+}
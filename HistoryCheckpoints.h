@@ -0,0 +1,70 @@
+#pragma once
+#include <map>
+#include <vector>
+#include "Shape.h"
+
+// Which shapes were in the model at points along the undo history, and
+// where and how, so the model can jump to a revision by putting the shapes
+// of the nearest checkpoint below it back the way they were and redoing the
+// few commands in between, without touching any of the commands on the way.
+// A revision is the number of commands done.
+//
+// Checkpoints hold shape IDs rather than the shapes, since a shape only the
+// history holds may be spilled to disk and made again under the same ID.
+// They're spaced further apart as the document grows, so taking one costs
+// about as much as the commands since the last one. Their memory counts
+// against the model's history budget, and the ones furthest from the
+// current revision are dropped to stay under it.
+class HistoryCheckpoints
+{
+public:
+	// Fewest commands between two checkpoints
+	static const size_t MIN_INTERVAL = 256;
+	// Most shapes a checkpoint copies per command since the last one
+	static const size_t SHAPES_PER_COMMAND = 16;
+
+	HistoryCheckpoints();
+
+	// A shape in the model at a checkpoint, as it was then
+	struct ShapeState
+	{
+		ShapeId mId;
+		wxPoint mOffset;
+		StyleId mStyle;
+	};
+
+	// The shapes in the model at a revision, in draw order
+	typedef std::vector<ShapeState> Checkpoint;
+
+	// Whether a checkpoint of a model with shapeCount shapes should be
+	// taken at revision, which it isn't if the checkpoints would hold more
+	// than budget bytes with it
+	bool IsDue(size_t revision, size_t shapeCount, size_t budget) const;
+
+	void Add(size_t revision, Checkpoint&& checkpoint);
+	// Returns the latest checkpoint at or before revision and puts its
+	// revision in at, or returns nullptr if there's none
+	const Checkpoint* Find(size_t revision, size_t& at) const;
+	// Drops the checkpoints after revision, once the commands that led
+	// to them are gone
+	void Truncate(size_t revision);
+
+	// Puts in distance how many revisions the checkpoint furthest from
+	// revision is away from it. Returns false if there's none.
+	bool GetFurthest(size_t revision, size_t& distance) const;
+	// Drops the checkpoint furthest from revision, the older one on a tie
+	void DropFurthest(size_t revision);
+
+	void Clear() { mCheckpoints.clear(); mMemoryUsage = 0; }
+	// Bytes held by the checkpoints
+	size_t GetMemoryUsage() const { return mMemoryUsage; }
+private:
+	// Checkpoints by revision
+	typedef std::map<size_t, Checkpoint> CheckpointMap;
+
+	// The checkpoint furthest from revision; there has to be one
+	CheckpointMap::const_iterator FindFurthest(size_t revision) const;
+
+	CheckpointMap mCheckpoints;
+	size_t mMemoryUsage;
+};
@@ -0,0 +1,236 @@
+#include "ImportJob.h"
+#include "Profiler.h"
+#include <wx/image.h>
+#include <wx/wfstream.h>
+#include <cmath>
+#include <algorithm>
+#include <functional>
+
+namespace
+{
+	// Share of the progress bar taken by the preview; the full decode
+	// and tiling get the rest
+	const int PREVIEW_PERCENT = 20;
+	// Where the full decode ends and tiling begins
+	const int DECODE_PERCENT = 70;
+	// The preview is decoded at no more than this fraction of the canvas
+	// size, which makes libjpeg use its fastest 1/8 scale for any image
+	// that's much bigger than the canvas
+	const int PREVIEW_DIVISOR = 4;
+
+	// Passes reads through to another stream, reporting how far into it
+	// they got, and fails them once cancel is set so that a decoder stops
+	// part way through the file instead of finishing it
+	class CancellableInputStream : public wxFilterInputStream
+	{
+	public:
+		typedef std::function<void(wxFileOffset)> ProgressFunc;
+
+		CancellableInputStream(wxInputStream& stream, const std::atomic<bool>& cancel,
+			ProgressFunc progress)
+		: wxFilterInputStream(stream)
+		, mCancel(cancel)
+		, mProgress(progress)
+		{
+		}
+
+		wxFileOffset GetLength() const override { return m_parent_i_stream->GetLength(); }
+		bool IsSeekable() const override { return m_parent_i_stream->IsSeekable(); }
+	protected:
+		size_t OnSysRead(void* buffer, size_t size) override
+		{
+			if (mCancel)
+			{
+				m_lasterror = wxSTREAM_READ_ERROR;
+				return 0;
+			}
+			size_t count = m_parent_i_stream->Read(buffer, size).LastRead();
+			m_lasterror = m_parent_i_stream->GetLastError();
+			mProgress(m_parent_i_stream->TellI());
+			return count;
+		}
+
+		// Decoders seek back after sniffing the header
+		wxFileOffset OnSysSeek(wxFileOffset pos, wxSeekMode mode) override
+		{
+			return m_parent_i_stream->SeekI(pos, mode);
+		}
+
+		wxFileOffset OnSysTell() const override { return m_parent_i_stream->TellI(); }
+	private:
+		const std::atomic<bool>& mCancel;
+		ProgressFunc mProgress;
+	};
+}
+
+ImportJob::ImportJob(const wxString& filename, wxBitmapType type, const wxSize& canvasSize,
+	wxEvtHandler* handler, int progressID, int previewID, int doneID)
+: mFilename(filename)
+, mType(type)
+, mCanvasSize(canvasSize)
+, mHandler(handler)
+, mProgressID(progressID)
+, mPreviewID(previewID)
+, mDoneID(doneID)
+, mCancel(false)
+, mLastPercent(-1)
+{
+}
+
+ImportJob::~ImportJob()
+{
+	Cancel();
+	if (mThread.joinable())
+	{
+		mThread.join();
+	}
+}
+
+void ImportJob::Start()
+{
+	mThread = std::thread(&ImportJob::Run, this);
+}
+
+void ImportJob::ReportProgress(int percent)
+{
+	if (percent > mLastPercent)
+	{
+		mLastPercent = percent;
+		wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, mProgressID);
+		event->SetInt(percent);
+		wxQueueEvent(mHandler, event);
+	}
+}
+
+void ImportJob::SendImage(int id, int result, std::shared_ptr<TiledImage> image)
+{
+	wxThreadEvent* event = new wxThreadEvent(wxEVT_THREAD, id);
+	event->SetInt(result);
+	event->SetString(mFilename);
+	event->SetPayload(image);
+	wxQueueEvent(mHandler, event);
+}
+
+std::shared_ptr<TiledImage> ImportJob::MakeTiles(wxImage& image, int firstPercent, int lastPercent)
+{
+	PROFILE_SCOPE("ImportJob::MakeTiles");
+	std::shared_ptr<TiledImage> tiles = std::make_shared<TiledImage>();
+	bool ok = tiles->Create(image, &mCancel, [=](size_t done, size_t total)
+	{
+		ReportProgress(firstPercent + static_cast<int>(done * (lastPercent - firstPercent) / total));
+	});
+	image.Destroy();
+	return ok ? tiles : std::shared_ptr<TiledImage>();
+}
+
+bool ImportJob::Decode(wxImage& image, const wxSize& maxSize, int firstPercent, int lastPercent)
+{
+	PROFILE_SCOPE("ImportJob::Decode");
+	wxFileInputStream file(mFilename);
+	if (!file.IsOk())
+	{
+		return false;
+	}
+	wxFileOffset length = file.GetLength();
+	CancellableInputStream stream(file, mCancel, [=](wxFileOffset pos)
+	{
+		if (length > 0)
+		{
+			ReportProgress(firstPercent +
+				static_cast<int>(pos * (lastPercent - firstPercent) / length));
+		}
+	});
+
+	if (maxSize.GetWidth() > 0 && maxSize.GetHeight() > 0)
+	{
+		image.SetOption(wxIMAGE_OPTION_MAX_WIDTH, maxSize.GetWidth());
+		image.SetOption(wxIMAGE_OPTION_MAX_HEIGHT, maxSize.GetHeight());
+	}
+	return image.LoadFile(stream, mType) && !mCancel;
+}
+
+wxImage ImportJob::StretchPreview(const wxImage& preview) const
+{
+	int fullWidth = preview.GetWidth();
+	int fullHeight = preview.GetHeight();
+	if (preview.HasOption(wxIMAGE_OPTION_ORIGINAL_WIDTH))
+	{
+		fullWidth = preview.GetOptionInt(wxIMAGE_OPTION_ORIGINAL_WIDTH);
+		fullHeight = preview.GetOptionInt(wxIMAGE_OPTION_ORIGINAL_HEIGHT);
+	}
+
+	// The image is drawn unscaled at the origin, so only this much of it
+	// is ever seen
+	int width = std::min(fullWidth, mCanvasSize.GetWidth());
+	int height = std::min(fullHeight, mCanvasSize.GetHeight());
+	double scaleX = static_cast<double>(preview.GetWidth()) / fullWidth;
+	double scaleY = static_cast<double>(preview.GetHeight()) / fullHeight;
+	wxRect source(0, 0,
+		std::max(1, std::min(preview.GetWidth(), static_cast<int>(std::ceil(width * scaleX)))),
+		std::max(1, std::min(preview.GetHeight(), static_cast<int>(std::ceil(height * scaleY)))));
+	return preview.GetSubImage(source).Scale(width, height, wxIMAGE_QUALITY_BILINEAR);
+}
+
+void ImportJob::Run()
+{
+	Result result = IR_Done;
+	bool decoded = false;
+	wxImage image;
+	std::shared_ptr<TiledImage> tiles;
+
+	// Only libjpeg can decode at a reduced size; for anything else a
+	// preview would cost as much as the image itself
+	if (mType == wxBITMAP_TYPE_JPEG && mCanvasSize.GetWidth() > 0 && mCanvasSize.GetHeight() > 0)
+	{
+		wxImage preview;
+		wxSize maxSize(std::max(1, mCanvasSize.GetWidth() / PREVIEW_DIVISOR),
+			std::max(1, mCanvasSize.GetHeight() / PREVIEW_DIVISOR));
+		if (Decode(preview, maxSize, 0, PREVIEW_PERCENT))
+		{
+			if (preview.HasOption(wxIMAGE_OPTION_ORIGINAL_WIDTH) &&
+				(preview.GetOptionInt(wxIMAGE_OPTION_ORIGINAL_WIDTH) != preview.GetWidth() ||
+				 preview.GetOptionInt(wxIMAGE_OPTION_ORIGINAL_HEIGHT) != preview.GetHeight()))
+			{
+				wxImage stretched = StretchPreview(preview);
+				preview.Destroy();
+				std::shared_ptr<TiledImage> previewTiles = MakeTiles(stretched, PREVIEW_PERCENT, PREVIEW_PERCENT);
+				if (previewTiles)
+				{
+					SendImage(mPreviewID, IR_Done, previewTiles);
+				}
+			}
+			else
+			{
+				// Small enough that it wasn't reduced; it's the real thing
+				image = preview;
+				preview.Destroy();
+				decoded = true;
+			}
+		}
+	}
+
+	if (!decoded && !mCancel)
+	{
+		decoded = Decode(image, wxSize(0, 0), mLastPercent < 0 ? 0 : PREVIEW_PERCENT, DECODE_PERCENT);
+	}
+	if (decoded && !mCancel)
+	{
+		tiles = MakeTiles(image, DECODE_PERCENT, 100);
+	}
+	image.Destroy();
+
+	if (mCancel)
+	{
+		result = IR_Cancelled;
+		tiles.reset();
+	}
+	else if (!tiles)
+	{
+		result = IR_Failed;
+	}
+	else
+	{
+		ReportProgress(100);
+	}
+	SendImage(mDoneID, result, tiles);
+}
@@ -0,0 +1,74 @@
+#pragma once
+#include <atomic>
+#include <memory>
+#include <thread>
+#include <wx/event.h>
+#include <wx/string.h>
+#include <wx/bitmap.h>
+#include <wx/gdicmn.h>
+#include "TiledImage.h"
+
+// Decodes an image file on a background thread. JPEGs are first decoded
+// at a fraction of their size, which takes a fraction of the time, and
+// sent as a preview stretched over the part of the canvas the image will
+// cover; the full resolution image follows. Both are split into a
+// TiledImage before they're sent, so the decoded pixels are freed on
+// this thread. Progress, the preview and the outcome are sent to the
+// handler as wxThreadEvents with the IDs given; the images travel as
+// std::shared_ptr<TiledImage> payloads.
+class ImportJob
+{
+public:
+	// How the job ended, sent as the int of the done event
+	enum Result
+	{
+		IR_Done,
+		IR_Failed,
+		IR_Cancelled
+	};
+
+	// canvasSize is the part of the image that is visible, used to size
+	// the preview
+	ImportJob(const wxString& filename, wxBitmapType type, const wxSize& canvasSize,
+		wxEvtHandler* handler, int progressID, int previewID, int doneID);
+	// Cancels the job if it's still running and waits for it to stop
+	~ImportJob();
+
+	void Start();
+	// Asks the job to stop as soon as possible; the done event still
+	// comes, but events already queued should be ignored
+	void Cancel() { mCancel = true; }
+	bool IsCancelled() const { return mCancel; }
+
+	const wxString& GetFilename() const { return mFilename; }
+
+	// Disallow copy/assignment
+	ImportJob(const ImportJob&) = delete;
+	ImportJob& operator=(const ImportJob&) = delete;
+private:
+	void Run();
+	// Decodes the file, stopping early if cancelled; maxSize of 0x0
+	// decodes at full size
+	bool Decode(wxImage& image, const wxSize& maxSize, int firstPercent, int lastPercent);
+	// Scales the part of a reduced size decode that lands on the canvas
+	// back up to canvas pixels
+	wxImage StretchPreview(const wxImage& preview) const;
+	// Sends overall progress in percent, skipping repeats
+	void ReportProgress(int percent);
+	// Tiles image and frees it; returns null if that failed or the job
+	// was cancelled
+	std::shared_ptr<TiledImage> MakeTiles(wxImage& image, int firstPercent, int lastPercent);
+	// Queues an event carrying image, which may be null
+	void SendImage(int id, int result, std::shared_ptr<TiledImage> image);
+
+	wxString mFilename;
+	wxBitmapType mType;
+	wxSize mCanvasSize;
+	wxEvtHandler* mHandler;
+	int mProgressID;
+	int mPreviewID;
+	int mDoneID;
+	std::atomic<bool> mCancel;
+	int mLastPercent;
+	std::thread mThread;
+};
@@ -0,0 +1,230 @@
+#include "InputController.h"
+#include "PaintModel.h"
+
+InputController::InputController(std::shared_ptr<PaintModel> model)
+: mModel(model)
+, mRecording(nullptr)
+, mApplying(nullptr)
+, mStart(std::chrono::steady_clock::now())
+, mTool(ID_Selector)
+, mOverSelection(false)
+{
+}
+
+void InputController::Apply(const InputEvent& event)
+{
+	mApplying = &event;
+	switch (event.mType)
+	{
+		case IE_LeftDown:
+			LeftDown(event.mPoint);
+			break;
+		case IE_LeftUp:
+			LeftUp(event.mPoint);
+			break;
+		case IE_Move:
+			MouseMove(event.mPoint);
+			break;
+		case IE_SelectTool:
+			SelectTool(static_cast<EventID>(event.mValue));
+			break;
+		case IE_Undo:
+			Undo();
+			break;
+		case IE_Redo:
+			Redo();
+			break;
+		case IE_GoToRevision:
+			GoToRevision(event.mValue);
+			break;
+		case IE_Unselect:
+			Unselect();
+			break;
+		case IE_Delete:
+			Delete();
+			break;
+		case IE_SetPenColor:
+		{
+			wxColour colour;
+			colour.SetRGBA(event.mValue);
+			SetPenColor(colour);
+			break;
+		}
+		case IE_SetPenWidth:
+			SetPenWidth(static_cast<int>(event.mValue));
+			break;
+		case IE_SetBrushColor:
+		{
+			wxColour colour;
+			colour.SetRGBA(event.mValue);
+			SetBrushColor(colour);
+			break;
+		}
+		case IE_New:
+			New();
+			break;
+		default:
+			break;
+	}
+	mApplying = nullptr;
+}
+
+void InputController::SelectTool(EventID tool)
+{
+	Record(IE_SelectTool, wxPoint(), static_cast<uint32_t>(tool));
+	mTool = tool;
+	// Every tool brings its own cursor, which is never the move cursor
+	mOverSelection = false;
+}
+
+void InputController::LeftDown(const wxPoint& point)
+{
+	Record(IE_LeftDown, point);
+	if (mOverSelection)
+	{
+		mModel->CreateCommand(CM_Move, point);
+	}
+	switch (mTool)
+	{
+		case ID_DrawRect:
+			mModel->UnSelectShape();
+			mModel->CreateCommand(CM_DrawRect, point);
+			break;
+		case ID_DrawEllipse:
+			mModel->UnSelectShape();
+			mModel->CreateCommand(CM_DrawEllipse, point);
+			break;
+		case ID_DrawLine:
+			mModel->UnSelectShape();
+			mModel->CreateCommand(CM_DrawLine, point);
+			break;
+		case ID_DrawPencil:
+			mModel->UnSelectShape();
+			mModel->CreateCommand(CM_DrawPencil, point);
+			break;
+		case ID_Selector:
+			mModel->SelectShape(point);
+			break;
+		default:
+			break;
+	}
+}
+
+bool InputController::LeftUp(const wxPoint& point)
+{
+	Record(IE_LeftUp, point);
+	if (!mModel->HasActiveCommand())
+	{
+		return false;
+	}
+	mModel->UpdateCommand(point);
+	mModel->FinalizeCommand();
+	return true;
+}
+
+bool InputController::MouseMove(const wxPoint& point)
+{
+	Record(IE_Move, point);
+	bool hovering = false;
+	std::shared_ptr<RectShape> selectedShape = std::dynamic_pointer_cast<RectShape>(mModel->GetSelectedShape());
+	if (selectedShape != nullptr)
+	{
+		mOverSelection = selectedShape->GetSelectionRectangle().Contains(point);
+		hovering = true;
+	}
+	if (mModel->HasActiveCommand())
+	{
+		mModel->UpdateCommand(point);
+	}
+	return hovering;
+}
+
+void InputController::Undo()
+{
+	Record(IE_Undo);
+	mModel->Undo();
+}
+
+void InputController::Redo()
+{
+	Record(IE_Redo);
+	mModel->Redo();
+}
+
+void InputController::GoToRevision(size_t revision)
+{
+	Record(IE_GoToRevision, wxPoint(), static_cast<uint32_t>(revision));
+	mModel->GoToRevision(revision);
+}
+
+void InputController::Unselect()
+{
+	Record(IE_Unselect);
+	mModel->UnSelectShape();
+}
+
+void InputController::Delete()
+{
+	Record(IE_Delete);
+	mModel->DeleteCommand();
+}
+
+void InputController::SetPenColor(const wxColour& colour)
+{
+	Record(IE_SetPenColor, wxPoint(), colour.GetRGBA());
+	mModel->SetPenColor(colour);
+	if (mModel->GetSelectedShape() != nullptr)
+	{
+		mModel->SetPenCommand();
+	}
+}
+
+void InputController::SetPenWidth(int width)
+{
+	Record(IE_SetPenWidth, wxPoint(), static_cast<uint32_t>(width));
+	mModel->SetPenWidth(width);
+	if (mModel->GetSelectedShape() != nullptr)
+	{
+		mModel->SetPenCommand();
+	}
+}
+
+void InputController::SetBrushColor(const wxColour& colour)
+{
+	Record(IE_SetBrushColor, wxPoint(), colour.GetRGBA());
+	mModel->SetBrushColor(colour);
+	if (mModel->GetSelectedShape() != nullptr)
+	{
+		mModel->SetBrushCommand();
+	}
+}
+
+void InputController::New()
+{
+	Record(IE_New);
+	mModel->New();
+}
+
+void InputController::Record(InputEventType type, const wxPoint& point, uint32_t value)
+{
+	if (mRecording != nullptr)
+	{
+		mRecording->Add(type, point, value);
+	}
+	uint32_t time = 0;
+	if (mApplying != nullptr)
+	{
+		time = mApplying->mTime;
+	}
+	else if (mRecording != nullptr)
+	{
+		// The same time a replay will get
+		time = mRecording->GetEvents().back().mTime;
+	}
+	else
+	{
+		time = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+			std::chrono::steady_clock::now() - mStart).count());
+	}
+	mModel->SetTime(time);
+}
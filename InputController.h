@@ -0,0 +1,75 @@
+#pragma once
+#include <chrono>
+#include <memory>
+#include <wx/colour.h>
+#include <wx/gdicmn.h>
+#include "EventID.h"
+#include "InputRecording.h"
+
+class PaintModel;
+
+// Turns mouse, toolbar and menu input into model edits. The frame feeds
+// it the user's input and replays feed it recorded events, so both drive
+// the model the exact same way. Only the model is touched here; the frame
+// repaints and updates its menus and cursor afterwards.
+//
+// Every call also gives the model the time, which decides whether moves
+// and restyles merge (see PaintModel::FinalizeCommand). Recorded events
+// carry their own time, so a replay merges them as they were merged
+// when they were recorded.
+class InputController
+{
+public:
+	InputController(std::shared_ptr<PaintModel> model);
+	// While set, every call is also added to the recording
+	void SetRecording(InputRecording* recording) { mRecording = recording; }
+
+	InputRecording* GetRecording() { return mRecording; }
+	// Dispatches a recorded event to the call that produced it
+	void Apply(const InputEvent& event);
+
+	void SelectTool(EventID tool);
+
+	EventID GetTool() const { return mTool; }
+	// Starts drawing with the current tool, moving the selection if the
+	// mouse is over it, or selects the shape under point
+	void LeftDown(const wxPoint& point);
+	// Finishes the active command; returns false if there was none
+	bool LeftUp(const wxPoint& point);
+	// Grows the active command and tracks whether the mouse is over the
+	// selection; returns false if nothing is selected to be over, in which
+	// case IsOverSelection keeps its old value
+	bool MouseMove(const wxPoint& point);
+	// True if the next LeftDown moves the selection
+	bool IsOverSelection() const { return mOverSelection; }
+
+	void Undo();
+
+	void Redo();
+	// Undoes or redoes until the model is at revision
+	void GoToRevision(size_t revision);
+
+	void Unselect();
+
+	void Delete();
+	// Changes the current pen or brush, and the selection's if there is one
+	void SetPenColor(const wxColour& colour);
+
+	void SetPenWidth(int width);
+
+	void SetBrushColor(const wxColour& colour);
+	// Clears the document
+	void New();
+private:
+	// Adds the event to the recording, if any, and gives the model its time
+	void Record(InputEventType type, const wxPoint& point = wxPoint(), uint32_t value = 0);
+
+	std::shared_ptr<PaintModel> mModel;
+	InputRecording* mRecording;
+	// Event being applied, if any
+	const InputEvent* mApplying;
+	// Clock for calls that aren't recorded or replayed
+	std::chrono::steady_clock::time_point mStart;
+	EventID mTool;
+	bool mOverSelection;
+};
@@ -0,0 +1,201 @@
+#include "InputRecording.h"
+#include <wx/file.h>
+#include <algorithm>
+
+namespace
+{
+	const unsigned char MAGIC[4] = { 'P', 'R', 'E', 'C' };
+	// Bumped whenever the encoding changes; older files are refused
+	const unsigned char VERSION = 1;
+
+	const char* TYPE_NAMES[IE_Count] =
+	{
+		"left_down", "left_up", "move", "select_tool", "undo", "redo",
+		"unselect", "delete", "set_pen_color", "set_pen_width", "set_brush_color", "new",
+		"go_to_revision"
+	};
+
+	bool HasPoint(InputEventType type)
+	{
+		return type == IE_LeftDown || type == IE_LeftUp || type == IE_Move;
+	}
+
+	bool HasValue(InputEventType type)
+	{
+		return type == IE_SelectTool || type == IE_SetPenColor || type == IE_SetPenWidth ||
+			type == IE_SetBrushColor || type == IE_GoToRevision;
+	}
+
+	// Same zigzag/varint scheme as PointStream
+	uint32_t ZigZag(int value)
+	{
+		return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	}
+
+	int UnZigZag(uint32_t value)
+	{
+		return static_cast<int>((value >> 1) ^ (~(value & 1) + 1));
+	}
+
+	void PutVarint(std::vector<unsigned char>& data, uint32_t value)
+	{
+		while (value >= 0x80)
+		{
+			data.push_back(static_cast<unsigned char>(value | 0x80));
+			value >>= 7;
+		}
+		data.push_back(static_cast<unsigned char>(value));
+	}
+
+	bool GetVarint(const std::vector<unsigned char>& data, size_t& pos, uint32_t& value)
+	{
+		value = 0;
+		for (int shift = 0; shift < 35; shift += 7)
+		{
+			if (pos >= data.size())
+			{
+				return false;
+			}
+			unsigned char byte = data[pos++];
+			value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			if (!(byte & 0x80))
+			{
+				return true;
+			}
+		}
+		return false;
+	}
+}
+
+InputRecording::InputRecording()
+: mStart(std::chrono::steady_clock::now())
+{
+}
+
+void InputRecording::Start()
+{
+	mEvents.clear();
+	mStart = std::chrono::steady_clock::now();
+}
+
+void InputRecording::Add(InputEventType type, const wxPoint& point, uint32_t value)
+{
+	InputEvent event;
+	event.mType = type;
+	event.mTime = static_cast<uint32_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+		std::chrono::steady_clock::now() - mStart).count());
+	event.mPoint = HasPoint(type) ? point : wxPoint();
+	event.mValue = HasValue(type) ? value : 0;
+	mEvents.push_back(event);
+}
+
+bool InputRecording::Save(const wxString& filename) const
+{
+	std::vector<unsigned char> data(MAGIC, MAGIC + sizeof(MAGIC));
+	data.push_back(VERSION);
+	PutVarint(data, static_cast<uint32_t>(mEvents.size()));
+	uint32_t time = 0;
+	wxPoint point;
+	for (const InputEvent& event : mEvents)
+	{
+		data.push_back(static_cast<unsigned char>(event.mType));
+		PutVarint(data, event.mTime - time);
+		time = event.mTime;
+		if (HasPoint(event.mType))
+		{
+			PutVarint(data, ZigZag(event.mPoint.x - point.x));
+			PutVarint(data, ZigZag(event.mPoint.y - point.y));
+			point = event.mPoint;
+		}
+		if (HasValue(event.mType))
+		{
+			PutVarint(data, event.mValue);
+		}
+	}
+
+	wxFile file;
+	if (!file.Create(filename, true))
+	{
+		return false;
+	}
+	bool ok = file.Write(data.data(), data.size()) == data.size();
+	ok = file.Close() && ok;
+	if (!ok)
+	{
+		wxRemoveFile(filename);
+	}
+	return ok;
+}
+
+bool InputRecording::Load(const wxString& filename)
+{
+	mEvents.clear();
+	wxFile file(filename);
+	if (!file.IsOpened())
+	{
+		return false;
+	}
+	wxFileOffset length = file.Length();
+	if (length < static_cast<wxFileOffset>(sizeof(MAGIC) + 1))
+	{
+		return false;
+	}
+	std::vector<unsigned char> data(static_cast<size_t>(length));
+	if (file.Read(data.data(), data.size()) != static_cast<ssize_t>(data.size()) ||
+		!std::equal(MAGIC, MAGIC + sizeof(MAGIC), data.begin()) || data[sizeof(MAGIC)] != VERSION)
+	{
+		return false;
+	}
+
+	size_t pos = sizeof(MAGIC) + 1;
+	uint32_t count = 0;
+	if (!GetVarint(data, pos, count))
+	{
+		return false;
+	}
+	std::vector<InputEvent> events;
+	// Every event takes at least two bytes, which bounds a corrupt count
+	events.reserve(std::min<size_t>(count, (data.size() - pos) / 2));
+	InputEvent event;
+	event.mTime = 0;
+	wxPoint point;
+	for (uint32_t i = 0; i < count; i++)
+	{
+		uint32_t delta = 0;
+		if (pos >= data.size() || data[pos] >= IE_Count)
+		{
+			return false;
+		}
+		event.mType = static_cast<InputEventType>(data[pos++]);
+		if (!GetVarint(data, pos, delta))
+		{
+			return false;
+		}
+		event.mTime += delta;
+		event.mPoint = wxPoint();
+		event.mValue = 0;
+		if (HasPoint(event.mType))
+		{
+			uint32_t x = 0, y = 0;
+			if (!GetVarint(data, pos, x) || !GetVarint(data, pos, y))
+			{
+				return false;
+			}
+			point.x += UnZigZag(x);
+			point.y += UnZigZag(y);
+			event.mPoint = point;
+		}
+		if (HasValue(event.mType) && !GetVarint(data, pos, event.mValue))
+		{
+			return false;
+		}
+		events.push_back(event);
+	}
+	mEvents.swap(events);
+	return true;
+}
+
+const char* InputRecording::GetTypeName(InputEventType type)
+{
+	return type < IE_Count ? TYPE_NAMES[type] : "unknown";
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <vector>
+#include <wx/gdicmn.h>
+#include <wx/string.h>
+
+enum InputEventType
+{
+	IE_LeftDown,
+	IE_LeftUp,
+	IE_Move,
+	IE_SelectTool,
+	IE_Undo,
+	IE_Redo,
+	IE_Unselect,
+	IE_Delete,
+	IE_SetPenColor,
+	IE_SetPenWidth,
+	IE_SetBrushColor,
+	IE_New,
+	IE_GoToRevision,
+	IE_Count
+};
+
+// One piece of user input, with mouse positions in document coordinates
+// so zooming and panning while recording don't matter
+struct InputEvent
+{
+	InputEventType mType;
+	// Milliseconds since the recording started
+	uint32_t mTime;
+	// Mouse position for the mouse events
+	wxPoint mPoint;
+	// Tool ID, pen width, colour as 0xAABBGGRR or revision, depending on
+	// the type
+	uint32_t mValue;
+};
+
+// Stream of input events, saved to and loaded from a compact file: each
+// event is a type byte followed by variable-length fields, with times
+// and mouse positions stored as deltas from the event before, so a
+// typical mouse move takes four bytes.
+class InputRecording
+{
+public:
+	InputRecording();
+	// Drops every event and restarts the clock
+	void Start();
+
+	void Add(InputEventType type, const wxPoint& point = wxPoint(), uint32_t value = 0);
+
+	const std::vector<InputEvent>& GetEvents() const { return mEvents; }
+
+	bool IsEmpty() const { return mEvents.empty(); }
+
+	bool Save(const wxString& filename) const;
+	// Replaces the events with the file's; returns false, leaving the
+	// recording empty, if the file can't be read or isn't a recording
+	bool Load(const wxString& filename);
+	// Name of each event type, as used in replay reports
+	static const char* GetTypeName(InputEventType type);
+private:
+	std::vector<InputEvent> mEvents;
+	std::chrono::steady_clock::time_point mStart;
+};
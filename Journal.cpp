@@ -0,0 +1,192 @@
+#include "Journal.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <zlib.h>
+
+namespace
+{
+	const unsigned char MAGIC[4] = { 'P', 'J', 'R', 'N' };
+	// Bumped whenever the framing changes; older files are refused
+	const unsigned char VERSION = 1;
+	// Magic, version and padding
+	const size_t HEADER_SIZE = 8;
+	// Length and CRC32 of the payload, little-endian
+	const size_t FRAME_SIZE = 8;
+
+	void PutUint32(std::vector<unsigned char>& data, uint32_t value)
+	{
+		for (int i = 0; i < 4; i++)
+		{
+			data.push_back(static_cast<unsigned char>(value >> (i * 8)));
+		}
+	}
+
+	uint32_t GetUint32(const unsigned char* data)
+	{
+		return static_cast<uint32_t>(data[0]) | static_cast<uint32_t>(data[1]) << 8 |
+			static_cast<uint32_t>(data[2]) << 16 | static_cast<uint32_t>(data[3]) << 24;
+	}
+
+	uint32_t GetCrc(const unsigned char* data, size_t size)
+	{
+		return static_cast<uint32_t>(crc32(crc32(0L, Z_NULL, 0), data, static_cast<uInt>(size)));
+	}
+}
+
+Journal::Journal()
+: mAppendedCount(0)
+, mSyncedCount(0)
+, mSize(0)
+, mFailed(false)
+, mStop(false)
+{
+}
+
+Journal::~Journal()
+{
+	Close();
+}
+
+bool Journal::Create(const wxString& filename)
+{
+	Close();
+	std::vector<unsigned char> header(MAGIC, MAGIC + sizeof(MAGIC));
+	header.push_back(VERSION);
+	header.resize(HEADER_SIZE, 0);
+	if (!mFile.Create(filename, true) || mFile.Write(header.data(), header.size()) != header.size() ||
+		!mFile.Flush())
+	{
+		mFile.Close();
+		return false;
+	}
+	mFilename = filename;
+	mAppendedCount = 0;
+	mSyncedCount = 0;
+	mSize = header.size();
+	mFailed = false;
+	mStop = false;
+	mThread = std::thread(&Journal::Run, this);
+	return true;
+}
+
+void Journal::Append(const Record& record)
+{
+	if (!IsOpened())
+	{
+		return;
+	}
+	std::lock_guard<std::mutex> lock(mMutex);
+	PutUint32(mPending, static_cast<uint32_t>(record.size()));
+	PutUint32(mPending, GetCrc(record.data(), record.size()));
+	mPending.insert(mPending.end(), record.begin(), record.end());
+	mAppendedCount++;
+	mSize += FRAME_SIZE + record.size();
+	mQueued.notify_one();
+}
+
+bool Journal::Flush()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	uint64_t target = mAppendedCount;
+	mSynced.wait(lock, [this, target]() { return mSyncedCount >= target || mFailed || !mThread.joinable(); });
+	return !mFailed;
+}
+
+void Journal::Close()
+{
+	if (!mThread.joinable())
+	{
+		return;
+	}
+	{
+		std::lock_guard<std::mutex> lock(mMutex);
+		mStop = true;
+		mQueued.notify_one();
+	}
+	// The thread writes out everything still queued before it stops
+	mThread.join();
+	mFile.Close();
+}
+
+uint64_t Journal::GetSize() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mSize;
+}
+
+void Journal::Run()
+{
+	std::unique_lock<std::mutex> lock(mMutex);
+	for (;;)
+	{
+		mQueued.wait(lock, [this]() { return mStop || !mPending.empty(); });
+		if (mPending.empty())
+		{
+			break;
+		}
+		// Everything queued while the last batch was being synced goes
+		// out together, under a single sync
+		std::vector<unsigned char> batch;
+		batch.swap(mPending);
+		uint64_t count = mAppendedCount;
+		bool failed = mFailed;
+		lock.unlock();
+		if (!failed)
+		{
+			PROFILE_SCOPE("Journal write and sync");
+			failed = mFile.Write(batch.data(), batch.size()) != batch.size() || !mFile.Flush();
+		}
+		lock.lock();
+		// Once a write fails, later records could end up after a hole, so
+		// nothing more is written
+		mFailed = failed;
+		mSyncedCount = count;
+		mSynced.notify_all();
+	}
+}
+
+bool Journal::Read(const wxString& filename, std::vector<Record>& records)
+{
+	records.clear();
+	Reader reader;
+	if (!reader.Open(filename))
+	{
+		return false;
+	}
+	Record record;
+	while (reader.Next(record))
+	{
+		records.push_back(record);
+	}
+	return true;
+}
+
+bool Journal::Reader::Open(const wxString& filename)
+{
+	unsigned char header[HEADER_SIZE];
+	if (!mFile.Open(filename))
+	{
+		return false;
+	}
+	mLength = mFile.Length();
+	return mLength >= static_cast<wxFileOffset>(HEADER_SIZE) &&
+		mFile.Read(header, HEADER_SIZE) == static_cast<ssize_t>(HEADER_SIZE) &&
+		std::equal(MAGIC, MAGIC + sizeof(MAGIC), header) && header[sizeof(MAGIC)] == VERSION;
+}
+
+bool Journal::Reader::Next(Record& record)
+{
+	unsigned char frame[FRAME_SIZE];
+	if (!mFile.IsOpened() || mFile.Read(frame, FRAME_SIZE) != static_cast<ssize_t>(FRAME_SIZE))
+	{
+		return false;
+	}
+	uint32_t size = GetUint32(frame);
+	uint32_t crc = GetUint32(frame + 4);
+	if (static_cast<wxFileOffset>(size) > mLength - mFile.Tell())
+	{
+		return false;
+	}
+	record.resize(size);
+	return mFile.Read(record.data(), size) == static_cast<ssize_t>(size) && GetCrc(record.data(), size) == crc;
+}
@@ -0,0 +1,85 @@
+#pragma once
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <wx/file.h>
+#include <wx/string.h>
+
+// Append-only log of opaque records that survives crashes. Append only
+// queues a record; a background thread writes whatever has queued up
+// since its last write in one go and syncs the file once for the whole
+// batch (group commit), so the UI never waits on the disk. Each record
+// is framed with its length and a CRC32, so a record torn by a crash is
+// detected and dropped along with anything after it.
+class Journal
+{
+public:
+	typedef std::vector<unsigned char> Record;
+
+	// Reads the records of a journal one at a time, for files too big to
+	// read in one go
+	class Reader
+	{
+	public:
+		Reader()
+		: mLength(0)
+		{
+		}
+		// Returns false if the file can't be read or isn't a journal
+		bool Open(const wxString& filename);
+		// Reads the next record, returning false at the end of the file or
+		// at the first record that is incomplete or corrupt
+		bool Next(Record& record);
+	private:
+		wxFile mFile;
+		wxFileOffset mLength;
+	};
+
+	Journal();
+	// Writes out and syncs whatever is still queued
+	~Journal();
+	// Starts a new, empty journal at filename, replacing any file there
+	bool Create(const wxString& filename);
+	// Queues a record to be written and synced
+	void Append(const Record& record);
+	// Blocks until every record appended so far is synced; returns false
+	// if a write or sync has failed
+	bool Flush();
+	// Flushes and closes the file
+	void Close();
+
+	bool IsOpened() const { return mThread.joinable(); }
+	// Bytes written or queued so far, including the header
+	uint64_t GetSize() const;
+
+	const wxString& GetFilename() const { return mFilename; }
+	// Reads every intact record of the journal at filename, stopping at
+	// the first one that is incomplete or corrupt. Returns false if the
+	// file can't be read or isn't a journal.
+	static bool Read(const wxString& filename, std::vector<Record>& records);
+
+	// Disallow copy/assignment
+	Journal(const Journal&) = delete;
+	Journal& operator=(const Journal&) = delete;
+private:
+	void Run();
+
+	wxString mFilename;
+	wxFile mFile;
+	std::thread mThread;
+	mutable std::mutex mMutex;
+	// Signalled when records are queued or the thread should stop
+	std::condition_variable mQueued;
+	// Signalled when a batch has been synced
+	std::condition_variable mSynced;
+	// Framed records waiting for the thread
+	std::vector<unsigned char> mPending;
+	// Records appended and records synced since Create
+	uint64_t mAppendedCount;
+	uint64_t mSyncedCount;
+	uint64_t mSize;
+	bool mFailed;
+	bool mStop;
+};
@@ -0,0 +1,110 @@
+#include "MappedFile.h"
+#ifdef __WXMSW__
+#include <wx/msw/wrapwin.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+MappedFile::MappedFile()
+: mData(nullptr)
+, mSize(0)
+#ifdef __WXMSW__
+, mMapping(nullptr)
+#endif
+{
+}
+
+MappedFile::~MappedFile()
+{
+	Close();
+}
+
+#ifdef __WXMSW__
+bool MappedFile::Open(const wxString& filename)
+{
+	Close();
+	HANDLE file = ::CreateFileW(filename.wc_str(), GENERIC_READ, FILE_SHARE_READ, nullptr,
+		OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+	if (file == INVALID_HANDLE_VALUE)
+	{
+		return false;
+	}
+	LARGE_INTEGER size;
+	if (!::GetFileSizeEx(file, &size) || size.QuadPart <= 0 ||
+		static_cast<unsigned long long>(size.QuadPart) > static_cast<size_t>(-1))
+	{
+		::CloseHandle(file);
+		return false;
+	}
+	// The mapping keeps the file open by itself
+	HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr);
+	::CloseHandle(file);
+	if (mapping == nullptr)
+	{
+		return false;
+	}
+	void* data = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+	if (data == nullptr)
+	{
+		::CloseHandle(mapping);
+		return false;
+	}
+	mMapping = mapping;
+	mData = static_cast<const unsigned char*>(data);
+	mSize = static_cast<size_t>(size.QuadPart);
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+	{
+		::UnmapViewOfFile(mData);
+		::CloseHandle(mMapping);
+	}
+	mData = nullptr;
+	mSize = 0;
+	mMapping = nullptr;
+}
+#else
+bool MappedFile::Open(const wxString& filename)
+{
+	Close();
+	int file = ::open(filename.fn_str(), O_RDONLY);
+	if (file < 0)
+	{
+		return false;
+	}
+	struct stat info;
+	if (::fstat(file, &info) != 0 || info.st_size <= 0 ||
+		static_cast<unsigned long long>(info.st_size) > static_cast<size_t>(-1))
+	{
+		::close(file);
+		return false;
+	}
+	size_t size = static_cast<size_t>(info.st_size);
+	// The mapping keeps the file open by itself
+	void* data = ::mmap(nullptr, size, PROT_READ, MAP_PRIVATE, file, 0);
+	::close(file);
+	if (data == MAP_FAILED)
+	{
+		return false;
+	}
+	mData = static_cast<const unsigned char*>(data);
+	mSize = size;
+	return true;
+}
+
+void MappedFile::Close()
+{
+	if (mData != nullptr)
+	{
+		::munmap(const_cast<unsigned char*>(mData), mSize);
+	}
+	mData = nullptr;
+	mSize = 0;
+}
+#endif
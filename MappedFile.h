@@ -0,0 +1,33 @@
+#pragma once
+#include <cstddef>
+#include <wx/string.h>
+
+// Read-only view of a whole file mapped into memory, so it can be read in
+// place without copying it into buffers first. Pages are only read from
+// disk as they're touched.
+class MappedFile
+{
+public:
+	MappedFile();
+	~MappedFile();
+	// Maps filename, unmapping whatever was mapped before; returns false
+	// if it can't be opened or is empty
+	bool Open(const wxString& filename);
+
+	void Close();
+
+	const unsigned char* GetData() const { return mData; }
+
+	size_t GetSize() const { return mSize; }
+
+	// Disallow copy/assignment
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+private:
+	const unsigned char* mData;
+	size_t mSize;
+#ifdef __WXMSW__
+	// File mapping object handle
+	void* mMapping;
+#endif
+};
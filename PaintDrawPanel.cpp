@@ -2,50 +2,332 @@
 #include <wx/dcclient.h>
 #include <wx/sizer.h>
 #include <wx/dcbuffer.h>
+#include <wx/dcmemory.h>
 #include "PaintModel.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdlib>
+
+// Past this many damaged rectangles, repainting their bounding box
+// is cheaper than culling the shapes once per rectangle
+static const size_t MAX_DAMAGE_RECTS = 8;
+
+static const int DEFAULT_FRAME_RATE = 60;
 
 BEGIN_EVENT_TABLE(PaintDrawPanel, wxPanel)
 	EVT_PAINT(PaintDrawPanel::PaintEvent)
+	EVT_TIMER(wxID_ANY, PaintDrawPanel::OnRenderTimer)
 END_EVENT_TABLE()
 
 
 PaintDrawPanel::PaintDrawPanel(wxFrame* parent)
 : wxPanel(parent)
+, mCommittedVersion(0)
+, mRenderTimer(this)
+, mLastFrameTime(0)
+, mFrameInterval(1000 / DEFAULT_FRAME_RATE)
 {
-	
+	mFrameClock.Start();
 }
 
 void PaintDrawPanel::PaintEvent(wxPaintEvent & evt)
 {
+	PROFILE_SCOPE("PaintDrawPanel::PaintEvent");
+	SetupBitmap();
 	wxBufferedPaintDC dc(this, mBitmap);
 	Render(dc);
+	mLastFrameTime = mFrameClock.Time();
 }
 
 void PaintDrawPanel::PaintNow()
 {
+	PROFILE_SCOPE("PaintDrawPanel::PaintNow");
+	// Whatever was scheduled gets drawn by this frame
+	mRenderTimer.Stop();
+	mLastFrameTime = mFrameClock.Time();
+	
 	wxClientDC dc(this);
-	wxBufferedDC bdc(&dc, mBitmap);
-	Render(bdc);
+	// The back buffer can only be patched if it shows the same view
+	bool bufferValid = mBitmap.IsOk() && mBitmap.GetSize() == GetSize() &&
+		mBufferViewport == mViewport;
+	if (mModel && bufferValid && mModel->HasStrokeOnlyDamage())
+	{
+		RenderStroke(dc);
+	}
+	else if (mModel && bufferValid && !mModel->IsFullyDamaged())
+	{
+		RenderDamage(dc);
+	}
+	else
+	{
+		SetupBitmap();
+		wxBufferedDC bdc(&dc, mBitmap);
+		Render(bdc);
+	}
 }
 
-void PaintDrawPanel::Render(wxDC& dc)
+void PaintDrawPanel::RequestPaint()
 {
-	// Clear
-	dc.SetBackground(*wxWHITE_BRUSH);
-	dc.Clear();
+	if (mRenderTimer.IsRunning())
+	{
+		// Already scheduled; the model keeps accumulating damage until then
+		return;
+	}
 	
+	long elapsed = mFrameClock.Time() - mLastFrameTime;
+	if (elapsed >= mFrameInterval)
+	{
+		PaintNow();
+	}
+	else
+	{
+		mRenderTimer.Start(static_cast<int>(mFrameInterval - elapsed), wxTIMER_ONE_SHOT);
+	}
+}
+
+void PaintDrawPanel::SetFrameRate(int framesPerSecond)
+{
+	mFrameInterval = 1000 / std::max(framesPerSecond, 1);
+}
+
+void PaintDrawPanel::OnRenderTimer(wxTimerEvent& event)
+{
+	PaintNow();
+}
+
+void PaintDrawPanel::ZoomBy(double factor, const wxPoint& anchor)
+{
+	mViewport.SetZoom(mViewport.GetZoom() * factor, anchor);
+	RequestPaint();
+}
+
+void PaintDrawPanel::ZoomBy(double factor)
+{
+	wxSize size = GetSize();
+	ZoomBy(factor, wxPoint(size.GetWidth() / 2, size.GetHeight() / 2));
+}
+
+void PaintDrawPanel::PanBy(const wxPoint& delta)
+{
+	mViewport.Pan(delta);
+	RequestPaint();
+}
+
+void PaintDrawPanel::ResetView()
+{
+	mViewport.SetIdentity();
+	RequestPaint();
+}
+
+void PaintDrawPanel::Render(wxDC& dc)
+{
+	PROFILE_SCOPE("PaintDrawPanel::Render");
 	if (mModel)
 	{
-		mModel->DrawShapes(dc);
+		UpdateCommittedLayer();
+	}
+	
+	if (mModel && mCommittedLayer.IsOk())
+	{
+		// The committed layer is opaque, so it doubles as the clear
+		dc.DrawBitmap(mCommittedLayer, wxPoint(0, 0));
+		mViewport.ApplyTo(dc);
+		mModel->DrawActiveShapes(dc);
+		Viewport::ResetDC(dc);
+		mModel->ClearDamage();
+		mBufferViewport = mViewport;
+	}
+	else
+	{
+		// Clear
+		dc.SetBackground(*wxWHITE_BRUSH);
+		dc.Clear();
+	}
+}
+
+void PaintDrawPanel::RenderDamage(wxDC& dc)
+{
+	PROFILE_SCOPE("PaintDrawPanel::RenderDamage");
+	std::vector<wxRect> rects;
+	GetDamageRects(rects);
+	UpdateCommittedLayer();
+	
+	// Composite the damaged parts into the back buffer, then only
+	// copy those parts to the screen
+	wxMemoryDC bufferDC(mBitmap);
+	for (auto& rect : rects)
+	{
+		// Clip in panel pixels, before the view's scale applies
+		bufferDC.SetClippingRegion(rect);
+		bufferDC.DrawBitmap(mCommittedLayer, wxPoint(0, 0));
+		wxRect documentRect = mViewport.ToDocument(rect);
+		mViewport.ApplyTo(bufferDC);
+		mModel->DrawActiveShapes(bufferDC, true, &documentRect);
+		Viewport::ResetDC(bufferDC);
+		bufferDC.DestroyClippingRegion();
+		dc.Blit(rect.x, rect.y, rect.width, rect.height, &bufferDC, rect.x, rect.y);
+	}
+	mModel->ClearDamage();
+}
+
+void PaintDrawPanel::RenderStroke(wxDC& dc)
+{
+	PROFILE_SCOPE("PaintDrawPanel::RenderStroke");
+	wxMemoryDC bufferDC(mBitmap);
+	mViewport.ApplyTo(bufferDC);
+	mModel->DrawStrokeSegments(bufferDC);
+	Viewport::ResetDC(bufferDC);
+	wxRect rect = mViewport.ToPanel(mModel->GetDamage().GetBox()).Inflate(1).Intersect(wxRect(GetSize()));
+	if (!rect.IsEmpty())
+	{
+		dc.Blit(rect.x, rect.y, rect.width, rect.height, &bufferDC, rect.x, rect.y);
+	}
+	mModel->ClearDamage();
+}
+
+void PaintDrawPanel::GetDamageRects(std::vector<wxRect>& rects)
+{
+	wxRect canvas(GetSize());
+	const wxRegion& damage = mModel->GetDamage();
+	for (wxRegionIterator iter(damage); iter; ++iter)
+	{
+		// Rounding and anti-aliasing at other zooms can reach one more pixel
+		wxRect rect = mViewport.ToPanel(iter.GetRect()).Inflate(1).Intersect(canvas);
+		if (!rect.IsEmpty())
+		{
+			rects.push_back(rect);
+		}
+	}
+	
+	if (rects.size() > MAX_DAMAGE_RECTS)
+	{
+		rects.clear();
+		rects.push_back(mViewport.ToPanel(damage.GetBox()).Inflate(1).Intersect(canvas));
+	}
+}
+
+void PaintDrawPanel::UpdateCommittedLayer()
+{
+	PROFILE_SCOPE("PaintDrawPanel::UpdateCommittedLayer");
+	wxSize size = GetSize();
+	if (size.GetWidth() <= 0 || size.GetHeight() <= 0)
+	{
+		return;
+	}
+	bool resized = !mCommittedLayer.IsOk() || mCommittedLayer.GetSize() != size;
+	bool changed = mCommittedVersion != mModel->GetCommittedVersion();
+	bool moved = mCommittedViewport != mViewport;
+	if (!resized && !changed && !moved)
+	{
+		return;
+	}
+	
+	if (resized)
+	{
+		mCommittedLayer.Create(size);
+	}
+	
+	// Every change to the committed shapes also damages the area they
+	// cover, and a pan only exposes strips along the edges, so usually
+	// only part of the layer has to be re-rasterized
+	std::vector<wxRect> rects;
+	bool full = resized || (changed && mModel->IsFullyDamaged()) ||
+		(moved && mCommittedViewport.GetZoom() != mViewport.GetZoom());
+	if (!full && moved)
+	{
+		wxPoint delta = mViewport.GetOffset() - mCommittedViewport.GetOffset();
+		full = !ScrollCommittedLayer(delta, rects);
+	}
+	if (!full && changed)
+	{
+		GetDamageRects(rects);
+	}
+	
+	wxMemoryDC dc(mCommittedLayer);
+	if (full)
+	{
+		rects.clear();
+		rects.push_back(wxRect(size));
+	}
+	DrawCommittedRects(dc, rects);
+	mCommittedVersion = mModel->GetCommittedVersion();
+	mCommittedViewport = mViewport;
+}
+
+bool PaintDrawPanel::ScrollCommittedLayer(const wxPoint& delta, std::vector<wxRect>& exposed)
+{
+	wxSize size = mCommittedLayer.GetSize();
+	int width = size.GetWidth();
+	int height = size.GetHeight();
+	if (std::abs(delta.x) >= width || std::abs(delta.y) >= height)
+	{
+		return false;
+	}
+	
+	// Blitting a bitmap onto itself isn't safe everywhere, so shift it
+	// into the scratch bitmap and swap the two
+	if (!mScrollLayer.IsOk() || mScrollLayer.GetSize() != size)
+	{
+		mScrollLayer.Create(size);
+	}
+	{
+		wxMemoryDC source(mCommittedLayer);
+		wxMemoryDC target(mScrollLayer);
+		target.Blit(delta.x, delta.y, width, height, &source, 0, 0);
+	}
+	wxBitmap scrolled = mScrollLayer;
+	mScrollLayer = mCommittedLayer;
+	mCommittedLayer = scrolled;
+	
+	if (delta.x > 0)
+	{
+		exposed.push_back(wxRect(0, 0, delta.x, height));
+	}
+	else if (delta.x < 0)
+	{
+		exposed.push_back(wxRect(width + delta.x, 0, -delta.x, height));
+	}
+	if (delta.y > 0)
+	{
+		exposed.push_back(wxRect(0, 0, width, delta.y));
+	}
+	else if (delta.y < 0)
+	{
+		exposed.push_back(wxRect(0, height + delta.y, width, -delta.y));
+	}
+	return true;
+}
+
+void PaintDrawPanel::DrawCommittedRects(wxDC& dc, const std::vector<wxRect>& rects)
+{
+	for (auto& rect : rects)
+	{
+		// Clip and clear in panel pixels, then draw in the document
+		dc.SetClippingRegion(rect);
+		dc.SetPen(*wxWHITE_PEN);
+		dc.SetBrush(*wxWHITE_BRUSH);
+		dc.DrawRectangle(rect);
+		wxRect documentRect = mViewport.ToDocument(rect);
+		mViewport.ApplyTo(dc);
+		mModel->DrawCommittedShapes(dc, &documentRect);
+		Viewport::ResetDC(dc);
+		dc.DestroyClippingRegion();
 	}
 }
 
 void PaintDrawPanel::SetModel(std::shared_ptr<class PaintModel> model)
 {
 	mModel = model;
+	// Force the committed layer to be rebuilt from the new model
+	mCommittedLayer = wxBitmap();
 }
 
 void PaintDrawPanel::SetupBitmap()
 {
-	mBitmap.Create(GetSize());
+	wxSize size = GetSize();
+	if (size.GetWidth() > 0 && size.GetHeight() > 0 &&
+		(!mBitmap.IsOk() || mBitmap.GetSize() != size))
+	{
+		mBitmap.Create(size);
+	}
 }
@@ -3,8 +3,12 @@
 #include <wx/panel.h>
 #include <wx/frame.h>
 #include <wx/bitmap.h>
+#include <wx/timer.h>
+#include <wx/stopwatch.h>
 #include <string>
 #include <memory>
+#include <vector>
+#include "Viewport.h"
 
 class PaintDrawPanel : public wxPanel
 {
@@ -13,17 +17,70 @@ public:
  
 	void PaintEvent(wxPaintEvent & evt);
 	void PaintNow();
+	// Schedules a repaint; requests that come in faster than the frame
+	// rate are coalesced into a single PaintNow
+	void RequestPaint();
+	// Maximum number of frames per second that RequestPaint renders
+	void SetFrameRate(int framesPerSecond);
+	
+	void OnRenderTimer(wxTimerEvent& event);
  
 	void Render(wxDC& dc);
+	// Repaints only the areas the model reported as damaged
+	void RenderDamage(wxDC& dc);
+	// Draws only the newest segments of the active stroke on top of the
+	// back buffer, which already holds the rest of the frame
+	void RenderStroke(wxDC& dc);
 
 	void SetModel(std::shared_ptr<class PaintModel> model);
 	void SetupBitmap();
+	// Re-rasterizes the committed layer if the model changed since last time
+	void UpdateCommittedLayer();
+	// Returns the damaged rectangles in panel pixels, clipped to the panel
+	void GetDamageRects(std::vector<wxRect>& rects);
+	// Shifts the committed layer by delta pixels and returns the strips
+	// that scrolled into view, or false if nothing is left to reuse
+	bool ScrollCommittedLayer(const wxPoint& delta, std::vector<wxRect>& exposed);
+	// Re-rasterizes the committed shapes under each rectangle (panel pixels)
+	void DrawCommittedRects(wxDC& dc, const std::vector<wxRect>& rects);
+	
+	const Viewport& GetViewport() const { return mViewport; }
+	// Converts a panel position, like a mouse event's, to the document
+	wxPoint ToDocument(const wxPoint& point) const { return mViewport.ToDocument(point); }
+	// Multiplies the zoom, keeping the document point under anchor put
+	void ZoomBy(double factor, const wxPoint& anchor);
+	// Zooms around the middle of the panel
+	void ZoomBy(double factor);
+	// Moves the view by delta panel pixels
+	void PanBy(const wxPoint& delta);
+	// Back to 100% with the document origin in the top left corner
+	void ResetView();
 	
 	DECLARE_EVENT_TABLE()
 	
 public:
 	// Buffer that stores current drawing as bitmap
 	wxBitmap mBitmap;
+	// Raster of every finalized shape, blitted under the active shape
+	wxBitmap mCommittedLayer;
+	// Model version the committed layer was rasterized from
+	unsigned int mCommittedVersion;
+	// Scratch bitmap the committed layer is scrolled into when panning
+	wxBitmap mScrollLayer;
+	// Maps the document onto the panel
+	Viewport mViewport;
+	// Viewport the committed layer was rasterized with
+	Viewport mCommittedViewport;
+	// Viewport the back buffer was last fully rendered with
+	Viewport mBufferViewport;
+	// Fires for requests that came in too soon after the last frame
+	wxTimer mRenderTimer;
+	// Running since the panel was created, used to pace frames
+	wxStopWatch mFrameClock;
+	// mFrameClock time of the last frame, in milliseconds
+	long mLastFrameTime;
+	// Minimum time between frames, in milliseconds
+	int mFrameInterval;
 	// Variables here
 	std::shared_ptr<class PaintModel> mModel;
 };
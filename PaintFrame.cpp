@@ -6,32 +6,74 @@
 #include <wx/sizer.h>
 #include <wx/filedlg.h>
 #include <wx/toolbar.h>
+#include <wx/slider.h>
 #include <wx/image.h>
 #include <wx/colordlg.h>
 #include <wx/textdlg.h>
 #include <wx/filedlg.h>
 #include <wx/valnum.h>
-#include <wx/wfstream.h>
 #include <wx/dcmemory.h>
 #include "PaintDrawPanel.h"
 #include "PaintModel.h"
+#include "DocumentJournal.h"
+#include "ExportJob.h"
+#include "ImportJob.h"
+#include "InputController.h"
+#include "InputRecording.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cmath>
+#include <vector>
+
+// Zoom factor of one View>Zoom In or mouse wheel notch
+static const double ZOOM_STEP = 1.25;
+// Panel pixels scrolled by one mouse wheel notch
+static const int SCROLL_STEP = 40;
+#ifdef PAINT_PROFILING
+// How often the timings in the status bar are refreshed
+static const int TIMINGS_INTERVAL = 500;
+// Sections listed in the status bar
+static const size_t TIMINGS_SECTIONS = 4;
+#endif
 
 wxBEGIN_EVENT_TABLE(PaintFrame, wxFrame)
 	EVT_MENU(wxID_EXIT, PaintFrame::OnExit)
 	EVT_MENU(wxID_NEW, PaintFrame::OnNew)
+	EVT_MENU(wxID_OPEN, PaintFrame::OnOpen)
+	EVT_MENU(wxID_SAVE, PaintFrame::OnSave)
+	EVT_MENU(wxID_SAVEAS, PaintFrame::OnSave)
 	EVT_MENU(ID_Import, PaintFrame::OnImport)
 	EVT_TOOL(ID_Import, PaintFrame::OnImport)
 	EVT_MENU(ID_Export, PaintFrame::OnExport)
 	EVT_TOOL(ID_Export, PaintFrame::OnExport)
+	EVT_MENU(ID_CancelExport, PaintFrame::OnCancelExport)
+	EVT_THREAD(ID_ExportProgress, PaintFrame::OnExportProgress)
+	EVT_THREAD(ID_ExportDone, PaintFrame::OnExportDone)
+	EVT_MENU(ID_CancelImport, PaintFrame::OnCancelImport)
+	EVT_THREAD(ID_ImportProgress, PaintFrame::OnImportProgress)
+	EVT_THREAD(ID_ImportPreview, PaintFrame::OnImportPreview)
+	EVT_THREAD(ID_ImportDone, PaintFrame::OnImportDone)
+	EVT_MENU(ID_RecordInput, PaintFrame::OnRecordInput)
 	EVT_MENU(wxID_UNDO, PaintFrame::OnUndo)
 	EVT_TOOL(wxID_UNDO, PaintFrame::OnUndo)
 	EVT_MENU(wxID_REDO, PaintFrame::OnRedo)
 	EVT_TOOL(wxID_REDO, PaintFrame::OnRedo)
+	EVT_SLIDER(ID_HistorySlider, PaintFrame::OnHistorySlider)
 	EVT_MENU(ID_Unselect, PaintFrame::OnUnselect)
 	EVT_MENU(ID_Delete, PaintFrame::OnDelete)
+	EVT_MENU(ID_SetHistoryBudget, PaintFrame::OnSetHistoryBudget)
 	EVT_MENU(ID_SetPenColor, PaintFrame::OnSetPenColor)
 	EVT_MENU(ID_SetPenWidth, PaintFrame::OnSetPenWidth)
 	EVT_MENU(ID_SetBrushColor, PaintFrame::OnSetBrushColor)
+	EVT_MENU(wxID_ZOOM_IN, PaintFrame::OnZoom)
+	EVT_MENU(wxID_ZOOM_OUT, PaintFrame::OnZoom)
+	EVT_MENU(wxID_ZOOM_100, PaintFrame::OnZoom)
+#ifdef PAINT_PROFILING
+	EVT_MENU(ID_ShowTimings, PaintFrame::OnShowTimings)
+	EVT_MENU(ID_ResetTimings, PaintFrame::OnResetTimings)
+	EVT_MENU(ID_RecordTrace, PaintFrame::OnRecordTrace)
+	EVT_TIMER(ID_TimingsTimer, PaintFrame::OnTimingsTimer)
+#endif
 	// The different draw modes
 	EVT_TOOL(ID_Selector, PaintFrame::OnSelectTool)
 	EVT_TOOL(ID_DrawLine, PaintFrame::OnSelectTool)
@@ -56,8 +98,31 @@ PaintFrame::PaintFrame(const wxString& title, const wxPoint& pos, const wxSize&
 
 	Show(true);
 	
-	SetMinSize(GetSize());
-	SetMaxSize(GetSize());
+	// The window can be resized and the view zoomed or panned, but the
+	// document keeps the size the canvas started with
+	mModel->SetSize(mPanel->GetSize());
+	
+	if (!RecoverDocument())
+	{
+		StartJournal();
+	}
+}
+
+PaintFrame::~PaintFrame()
+{
+	// Exiting normally, so there's nothing to recover
+	mModel->SetJournal(nullptr);
+	mJournal->Discard();
+	if(mExportJob)
+	{
+		mExportJob->Cancel();
+		mExportJob.reset();
+	}
+	if(mImportJob)
+	{
+		mImportJob->Cancel();
+		mImportJob.reset();
+	}
 }
 
 void PaintFrame::SetupMenu()
@@ -65,11 +130,24 @@ void PaintFrame::SetupMenu()
 	// File menu
 	mFileMenu = new wxMenu();
 	mFileMenu->Append(wxID_NEW);
+	mFileMenu->Append(wxID_OPEN);
+	mFileMenu->Append(wxID_SAVE);
+	mFileMenu->Append(wxID_SAVEAS);
+	mFileMenu->AppendSeparator();
 	mFileMenu->Append(ID_Export, "Export...",
 		"Export current drawing to image file.");
+	mFileMenu->Append(ID_CancelExport, "Cancel Export",
+		"Stop the export that is running.");
+	mFileMenu->Enable(ID_CancelExport, false);
 	mFileMenu->AppendSeparator();
 	mFileMenu->Append(ID_Import, "Import...",
 		"Import image into file.");
+	mFileMenu->Append(ID_CancelImport, "Cancel Import",
+		"Stop the import that is running.");
+	mFileMenu->Enable(ID_CancelImport, false);
+	mFileMenu->AppendSeparator();
+	mFileMenu->AppendCheckItem(ID_RecordInput, "Record Input",
+		"Record mouse and menu input to a file that paint-replay can play back.");
 	mFileMenu->Append(wxID_EXIT);
 
 	// Edit menu
@@ -82,6 +160,9 @@ void PaintFrame::SetupMenu()
 	mEditMenu->AppendSeparator();
 	mEditMenu->Append(ID_Delete, "Delete\tDel",
 		"Delete the current selection");
+	mEditMenu->AppendSeparator();
+	mEditMenu->Append(ID_SetHistoryBudget, "History Memory...",
+		"Set how much memory undo history can use before it's moved to disk.");
 	
 	mEditMenu->Enable(wxID_UNDO, false);
 	mEditMenu->Enable(wxID_REDO, false);
@@ -95,12 +176,33 @@ void PaintFrame::SetupMenu()
 	mColorMenu->AppendSeparator();
 	mColorMenu->Append(ID_SetBrushColor, "Brush Color...", "Set brush color");
 
+	// View menu
+	mViewMenu = new wxMenu();
+	mViewMenu->Append(wxID_ZOOM_IN, "Zoom In\tCtrl+=", "Zoom in on the middle of the view.");
+	mViewMenu->Append(wxID_ZOOM_OUT, "Zoom Out\tCtrl+-", "Zoom out from the middle of the view.");
+	mViewMenu->Append(wxID_ZOOM_100, "Actual Size\tCtrl+0", "Show the document at 100% from its top left corner.");
+#ifdef PAINT_PROFILING
+	mViewMenu->AppendSeparator();
+	mViewMenu->AppendCheckItem(ID_ShowTimings, "Show Timings",
+		"Time drawing and editing, showing the slowest parts in the status bar.");
+	mViewMenu->Append(ID_ResetTimings, "Reset Timings", "Forget the timings collected so far.");
+	mViewMenu->AppendCheckItem(ID_RecordTrace, "Record Trace",
+		"Record every timed call to a Chrome trace file.");
+	mTimingsTimer.SetOwner(this, ID_TimingsTimer);
+#endif
+
 	wxMenuBar* menuBar = new wxMenuBar();
 	menuBar->Append(mFileMenu, "&File");
 	menuBar->Append(mEditMenu, "&Edit");
 	menuBar->Append(mColorMenu, "&Colors");
+	menuBar->Append(mViewMenu, "&View");
 	SetMenuBar(menuBar);
+#ifdef PAINT_PROFILING
+	// The second field holds the timings
+	CreateStatusBar(2);
+#else
 	CreateStatusBar();
+#endif
 }
 
 void PaintFrame::SetupToolbar()
@@ -124,6 +226,10 @@ void PaintFrame::SetupToolbar()
 	mToolbar->AddTool(wxID_REDO, "Redo",
 		wxBitmap("Icons/Redo.png", wxBITMAP_TYPE_PNG),
 		"Redo");
+	mHistorySlider = new wxSlider(mToolbar, ID_HistorySlider, 0, 0, 1,
+		wxDefaultPosition, wxSize(160, -1), wxSL_HORIZONTAL);
+	mHistorySlider->SetToolTip("History");
+	mToolbar->AddControl(mHistorySlider, "History");
 	mToolbar->AddSeparator();
 
 	mToolbar->AddTool(ID_Selector, "Selector",
@@ -149,6 +255,7 @@ void PaintFrame::SetupToolbar()
 	// Both undo and redo are disabled initially
 	mToolbar->EnableTool(wxID_UNDO, false);
 	mToolbar->EnableTool(wxID_REDO, false);
+	mHistorySlider->Enable(false);
 }
 
 void PaintFrame::UpdateUndoRedoButtons()
@@ -172,6 +279,16 @@ void PaintFrame::UpdateUndoRedoButtons()
         mToolbar->EnableTool(wxID_UNDO, false);
         mEditMenu->Enable(wxID_UNDO, false);
     }
+    
+    // A slider can't have an empty range, so one with no history to
+    // move through is disabled instead
+    int last = static_cast<int>(mModel->GetLastRevision());
+    if(mHistorySlider->GetMax() != std::max(last, 1))
+    {
+        mHistorySlider->SetRange(0, std::max(last, 1));
+    }
+    mHistorySlider->SetValue(static_cast<int>(mModel->GetRevision()));
+    mHistorySlider->Enable(last > 0);
 }
 void PaintFrame::SetupModelAndView()
 {
@@ -184,9 +301,14 @@ void PaintFrame::SetupModelAndView()
 	mPanel->Bind(wxEVT_LEFT_DOWN, &PaintFrame::OnMouseButton, this);
 	mPanel->Bind(wxEVT_LEFT_UP, &PaintFrame::OnMouseButton, this);
 	mPanel->Bind(wxEVT_MOTION, &PaintFrame::OnMouseMove, this);
+	mPanel->Bind(wxEVT_MIDDLE_DOWN, &PaintFrame::OnMouseButton, this);
+	mPanel->Bind(wxEVT_MOUSEWHEEL, &PaintFrame::OnMouseWheel, this);
 
 	// Create the model
 	mModel = std::make_shared<PaintModel>();
+	mInput.reset(new InputController(mModel));
+	mJournal.reset(new DocumentJournal());
+	mModel->SetJournal(mJournal.get());
 	mPanel->SetModel(mModel);
 	SetSizer(sizer);
 
@@ -200,8 +322,103 @@ void PaintFrame::OnExit(wxCommandEvent& event)
 
 void PaintFrame::OnNew(wxCommandEvent& event)
 {
-	mModel->New();
+	NewDocument();
+}
+
+void PaintFrame::NewDocument()
+{
+	CancelImport();
+	mInput->New();
+	StartJournal();
+	mDocumentPath.clear();
+	mPanel->ResetView();
+	UpdateZoomStatus();
+	mPanel->PaintNow();
+	UpdateUndoRedoButtons();
+}
+
+void PaintFrame::StartJournal()
+{
+	if (!mJournal->Start(*mModel))
+	{
+		wxLogWarning("Cannot write recovery files; this drawing can't be recovered if the app crashes.");
+	}
+}
+
+bool PaintFrame::RecoverDocument()
+{
+	std::vector<wxString> sessions;
+	DocumentJournal::FindOrphans(sessions);
+	for (auto& session : sessions)
+	{
+		int answer = wxMessageBox("ProPaint didn't exit normally last time. Recover the drawing that was open?",
+			"Recover Drawing", wxYES_NO | wxCANCEL | wxICON_QUESTION, this);
+		if (answer == wxCANCEL)
+		{
+			// Asked again next time
+			break;
+		}
+		if (answer != wxYES)
+		{
+			DocumentJournal::RemoveSession(session);
+			continue;
+		}
+		if (!mJournal->Recover(session, *mModel))
+		{
+			wxLogError("Cannot recover the drawing.");
+			continue;
+		}
+		mPanel->ResetView();
+		UpdateZoomStatus();
+		mPanel->PaintNow();
+		UpdateUndoRedoButtons();
+		SetStatusText("Recovered drawing");
+		return true;
+	}
+	return false;
+}
+
+void PaintFrame::OnOpen(wxCommandEvent& event)
+{
+	wxFileDialog openFileDialog(this, _("Open Document"), "", "",
+		"Paint documents (*.pdoc)|*.pdoc", wxFD_OPEN|wxFD_FILE_MUST_EXIST);
+	if (openFileDialog.ShowModal() == wxID_CANCEL)
+	{
+		return;
+	}
+	CancelImport();
+	if (!mModel->LoadDocument(openFileDialog.GetPath()))
+	{
+		wxLogError("Cannot open file '%s'.", openFileDialog.GetPath());
+		return;
+	}
+	StartJournal();
+	mDocumentPath = openFileDialog.GetPath();
+	mPanel->ResetView();
+	UpdateZoomStatus();
 	mPanel->PaintNow();
+	UpdateUndoRedoButtons();
+	SetStatusText("Opened " + mDocumentPath);
+}
+
+void PaintFrame::OnSave(wxCommandEvent& event)
+{
+	if (event.GetId() == wxID_SAVEAS || mDocumentPath.empty())
+	{
+		wxFileDialog saveFileDialog(this, _("Save Document"), "", "",
+			"Paint documents (*.pdoc)|*.pdoc", wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+		if (saveFileDialog.ShowModal() == wxID_CANCEL)
+		{
+			return;
+		}
+		mDocumentPath = saveFileDialog.GetPath();
+	}
+	if (!mModel->SaveDocument(mDocumentPath))
+	{
+		wxLogError("Cannot save file '%s'.", mDocumentPath);
+		return;
+	}
+	SetStatusText("Saved " + mDocumentPath);
 }
 
 std::string PaintFrame::GetFileExt(const std::string& s) {
@@ -224,36 +441,82 @@ void PaintFrame::OnExport(wxCommandEvent& event)
         return;     // the user changed idea...
     
     mModel->SetFilename(saveFileDialog.GetPath());
-    mModel->SetSize(mPanel->GetSize());
     
     std::string ext = GetFileExt(saveFileDialog.GetPath().ToStdString());
-    
-    wxBitmap bitmap;
-    // Create the bitmap of the specified wxSize
-    bitmap.Create(mModel->GetSize());
-    // Create a memory DC to draw to the bitmap
-    wxMemoryDC dc(bitmap);
-    // Clear the background color
-    dc.SetBackground(*wxWHITE_BRUSH);
-    dc.Clear();
-    // Draw all the shapes (make sure not the selection!)
-    mModel->UnSelectShape();
-    mModel->DrawShapes(dc);
+    wxBitmapType type;
     if(ext == "png")
     {
-        // Write the bitmap with the specified file name and wxBitmapType
-        bitmap.SaveFile(mModel->GetFilename(), wxBITMAP_TYPE_PNG);
+        type = wxBITMAP_TYPE_PNG;
     }
     else if(ext == "bmp")
     {
-        bitmap.SaveFile(mModel->GetFilename(), wxBITMAP_TYPE_BMP);
+        type = wxBITMAP_TYPE_BMP;
     }
     else if(ext == "jpeg" || ext == "jpg")
     {
-        bitmap.SaveFile(mModel->GetFilename(), wxBITMAP_TYPE_JPEG);
+        type = wxBITMAP_TYPE_JPEG;
+    }
+    else
+    {
+        return;
+    }
+    
+    // Snapshot all the shapes (make sure not the selection!), then
+    // rasterize and encode them in the background
+    mModel->UnSelectShape();
+    mPanel->PaintNow();
+    mExportJob.reset(new ExportJob(*mModel, mModel->GetSize(), mModel->GetFilename(), type,
+        this, ID_ExportProgress, ID_ExportDone));
+    mExportJob->Start();
+    SetStatusText("Exporting...");
+    UpdateExportButtons();
+}
+
+void PaintFrame::OnCancelExport(wxCommandEvent& event)
+{
+    if(mExportJob)
+    {
+        mExportJob->Cancel();
+        SetStatusText("Cancelling export...");
+    }
+}
+
+void PaintFrame::OnExportProgress(wxThreadEvent& event)
+{
+    if(mExportJob)
+    {
+        SetStatusText(wxString::Format("Exporting... %d%%", event.GetInt()));
     }
 }
 
+void PaintFrame::OnExportDone(wxThreadEvent& event)
+{
+    // The thread has sent its last event, so this doesn't block
+    mExportJob.reset();
+    UpdateExportButtons();
+    switch(event.GetInt())
+    {
+        case ExportJob::ER_Done:
+            SetStatusText("Exported " + event.GetString());
+            break;
+        case ExportJob::ER_Cancelled:
+            SetStatusText("Export cancelled");
+            break;
+        default:
+            SetStatusText("");
+            wxLogError("Cannot save file '%s'.", event.GetString());
+            break;
+    }
+}
+
+void PaintFrame::UpdateExportButtons()
+{
+    bool exporting = mExportJob != nullptr;
+    mFileMenu->Enable(ID_Export, !exporting);
+    mToolbar->EnableTool(ID_Export, !exporting);
+    mFileMenu->Enable(ID_CancelExport, exporting);
+}
+
 void PaintFrame::OnImport(wxCommandEvent& event)
 {
     wxFileDialog
@@ -262,47 +525,175 @@ void PaintFrame::OnImport(wxCommandEvent& event)
     if (openFileDialog.ShowModal() == wxID_CANCEL)
         return;     // the user changed idea...
     
-    // proceed loading the file chosen by the user;
-    // this can be done with e.g. wxWidgets input streams:
-    wxFileInputStream input_stream(openFileDialog.GetPath());
-    if (!input_stream.IsOk())
-    {
-        wxLogError("Cannot open file '%s'.", openFileDialog.GetPath());
-        return;
-    }
-    
     std::string ext = GetFileExt(openFileDialog.GetPath().ToStdString());
     mModel->SetFilename(openFileDialog.GetPath());
     
-    if(!mModel->GetBitmap().IsOk())
+    if(!mModel->GetImage())
     {
+        wxBitmapType type;
         if(ext == "png")
         {
-            // Write the bitmap with the specified file name and wxBitmapType
-            mModel->LoadBitmap(mModel->GetFilename(), wxBITMAP_TYPE_PNG);
+            type = wxBITMAP_TYPE_PNG;
         }
         else if(ext == "bmp")
         {
-            mModel->LoadBitmap(mModel->GetFilename(), wxBITMAP_TYPE_BMP);
+            type = wxBITMAP_TYPE_BMP;
         }
         else if(ext == "jpeg" || ext == "jpg")
         {
-            mModel->LoadBitmap(mModel->GetFilename(), wxBITMAP_TYPE_JPEG);
+            type = wxBITMAP_TYPE_JPEG;
         }
+        else
+        {
+            return;
+        }
+        
+        // Decode in the background so the user can keep drawing; the
+        // image shows up in OnImportPreview/OnImportDone
+        mImportJob.reset(new ImportJob(mModel->GetFilename(), type, mModel->GetSize(),
+            this, ID_ImportProgress, ID_ImportPreview, ID_ImportDone));
+        mImportJob->Start();
+        SetStatusText("Importing...");
+        UpdateImportButtons();
     }
-    mPanel->PaintNow();
+}
+
+void PaintFrame::OnCancelImport(wxCommandEvent& event)
+{
+    CancelImport();
+    SetStatusText("Import cancelled");
+}
+
+void PaintFrame::OnImportProgress(wxThreadEvent& event)
+{
+    if(mImportJob && !mImportJob->IsCancelled())
+    {
+        SetStatusText(wxString::Format("Importing... %d%%", event.GetInt()));
+    }
+}
+
+void PaintFrame::OnImportPreview(wxThreadEvent& event)
+{
+    // Previews queued before a cancel must not bring the image back
+    if(mImportJob && !mImportJob->IsCancelled())
+    {
+        mModel->SetImage(event.GetPayload<std::shared_ptr<TiledImage>>());
+        mPanel->RequestPaint();
+    }
+}
+
+void PaintFrame::OnImportDone(wxThreadEvent& event)
+{
+    if(!mImportJob)
+    {
+        return;
+    }
+    // The thread has sent its last event, so this doesn't block
+    bool cancelled = mImportJob->IsCancelled();
+    mImportJob.reset();
+    UpdateImportButtons();
+    if(cancelled)
+    {
+        return;
+    }
+    
+    if(event.GetInt() == ImportJob::IR_Done)
+    {
+        mModel->SetImage(event.GetPayload<std::shared_ptr<TiledImage>>());
+        SetStatusText("Imported " + event.GetString());
+    }
+    else
+    {
+        // Don't leave a preview of an image that couldn't be read
+        mModel->SetImage(nullptr);
+        SetStatusText("");
+        wxLogError("Cannot open file '%s'.", event.GetString());
+    }
+    mPanel->RequestPaint();
+}
+
+void PaintFrame::CancelImport()
+{
+    if(mImportJob && !mImportJob->IsCancelled())
+    {
+        // The job is only started while there's no bitmap, so whatever
+        // is there now is its preview
+        mImportJob->Cancel();
+        mModel->SetImage(nullptr);
+        mPanel->RequestPaint();
+        UpdateImportButtons();
+    }
+}
+
+void PaintFrame::UpdateImportButtons()
+{
+    // A cancelled job still has events queued, so the next import
+    // has to wait for its done event
+    bool importing = mImportJob != nullptr;
+    mFileMenu->Enable(ID_Import, !importing);
+    mToolbar->EnableTool(ID_Import, !importing);
+    mFileMenu->Enable(ID_CancelImport, importing && !mImportJob->IsCancelled());
+}
+
+void PaintFrame::OnRecordInput(wxCommandEvent& event)
+{
+	if (event.IsChecked())
+	{
+		// Replays start from an empty document, so the recording does too
+		if (mModel->CanUndo() || mModel->CanRedo())
+		{
+			if (wxMessageBox("Recording starts with a new drawing. Discard the current one?",
+				"Record Input", wxYES_NO | wxICON_QUESTION, this) != wxYES)
+			{
+				mFileMenu->Check(ID_RecordInput, false);
+				return;
+			}
+		}
+		mRecording.reset(new InputRecording());
+		mRecording->Start();
+		mInput->SetRecording(mRecording.get());
+		// Replays can't open documents, so neither can recordings
+		mFileMenu->Enable(wxID_OPEN, false);
+		NewDocument();
+		SelectTool(mInput->GetTool());
+		SetStatusText("Recording input...");
+		return;
+	}
+
+	mInput->SetRecording(nullptr);
+	mFileMenu->Enable(wxID_OPEN, true);
+	std::unique_ptr<InputRecording> recording = std::move(mRecording);
+	SetStatusText(wxString::Format("Recorded %lu events",
+		static_cast<unsigned long>(recording->GetEvents().size())));
+	wxFileDialog saveFileDialog(this, _("Save Input Recording"), "", "",
+		"Input recordings (*.prec)|*.prec", wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+	if (saveFileDialog.ShowModal() == wxID_CANCEL)
+	{
+		return;
+	}
+	if (!recording->Save(saveFileDialog.GetPath()))
+	{
+		wxLogError("Cannot save file '%s'.", saveFileDialog.GetPath());
+	}
 }
 
 void PaintFrame::OnUndo(wxCommandEvent& event)
 {
-    mModel->Undo();
+    mInput->Undo();
     mPanel->PaintNow();
     UpdateUndoRedoButtons();
 }
 
 void PaintFrame::OnRedo(wxCommandEvent& event)
 {
-    mModel->Redo();
+    mInput->Redo();
+    mPanel->PaintNow();
+    UpdateUndoRedoButtons();
+}
+
+void PaintFrame::OnHistorySlider(wxCommandEvent& event)
+{
+    mInput->GoToRevision(static_cast<size_t>(event.GetInt()));
     mPanel->PaintNow();
     UpdateUndoRedoButtons();
 }
@@ -310,16 +701,38 @@ void PaintFrame::OnRedo(wxCommandEvent& event)
 void PaintFrame::OnUnselect(wxCommandEvent& event)
 {
     mEditMenu->Enable(ID_Unselect, false);
-    mModel->UnSelectShape();
+    mInput->Unselect();
     mPanel->PaintNow();
 }
 
 void PaintFrame::OnDelete(wxCommandEvent& event)
 {
-    mModel->DeleteCommand();
+    mInput->Delete();
     mEditMenu->Enable(ID_Delete, false);
     mEditMenu->Enable(ID_Unselect, false);
     mPanel->PaintNow();
+    UpdateUndoRedoButtons();
+}
+
+void PaintFrame::OnSetHistoryBudget(wxCommandEvent& event)
+{
+    const size_t megabyte = 1024 * 1024;
+    wxString caption;
+    wxTextEntryDialog dialog(this, wxString("Please enter the undo history memory in MB, between 0 and 2048"), caption,
+        wxString::Format("%u", static_cast<unsigned>(mModel->GetHistoryBudget() / megabyte)), wxTextEntryDialogStyle, wxDefaultPosition);
+    
+    wxIntegerValidator<int> validator;
+    validator.SetRange(0, 2048);
+    dialog.SetValidator(validator);
+    
+    if(dialog.ShowModal() == wxID_OK)
+    {
+        int value = atoi(dialog.GetValue().c_str());
+        if(value >= 0 && value <= 2048)
+        {
+            mModel->SetHistoryBudget(static_cast<size_t>(value) * megabyte);
+        }
+    }
 }
 
 void PaintFrame::OnSetPenColor(wxCommandEvent& event)
@@ -330,13 +743,10 @@ void PaintFrame::OnSetPenColor(wxCommandEvent& event)
     if (dialog.ShowModal() == wxID_OK)
     {
         // Use dialog.GetColourData() to get the color picked
-        mModel->SetPenColor(dialog.GetColourData().GetColour());
-        if(mModel->GetSelectedShape() != nullptr)
-        {
-            mModel->SetPenCommand();
-        }
+        mInput->SetPenColor(dialog.GetColourData().GetColour());
     }
     mPanel->PaintNow();
+    UpdateUndoRedoButtons();
 }
 
 void PaintFrame::OnSetPenWidth(wxCommandEvent& event)
@@ -353,14 +763,11 @@ void PaintFrame::OnSetPenWidth(wxCommandEvent& event)
         int value = atoi(dialog.GetValue().c_str());
         if(value > 0 && value < 11)
            {
-               mModel->SetPenWidth(value);
-               if(mModel->GetSelectedShape() != nullptr)
-               {
-                   mModel->SetPenCommand();
-               }
+               mInput->SetPenWidth(value);
            }
     }
     mPanel->PaintNow();
+    UpdateUndoRedoButtons();
 }
 
 void PaintFrame::OnSetBrushColor(wxCommandEvent& event)
@@ -371,60 +778,45 @@ void PaintFrame::OnSetBrushColor(wxCommandEvent& event)
     if (dialog.ShowModal() == wxID_OK)
     {
         // Use dialog.GetColourData() to get the color picked
-        mModel->SetBrushColor(dialog.GetColourData().GetColour());
-        if(mModel->GetSelectedShape() != nullptr)
-        {
-            mModel->SetBrushCommand();
-        }
+        mInput->SetBrushColor(dialog.GetColourData().GetColour());
     }
     mPanel->PaintNow();
+    UpdateUndoRedoButtons();
 }
 
 void PaintFrame::OnMouseButton(wxMouseEvent& event)
 {
+	// The model works in document coordinates
+	wxPoint point = mPanel->ToDocument(event.GetPosition());
+	if (event.MiddleDown())
+	{
+		mPanPosition = event.GetPosition();
+		return;
+	}
 	if (event.LeftDown())
 	{
-        if(mCurrentCursor == CU_Move)
+        mInput->LeftDown(point);
+        mPanel->RequestPaint();
+        if(mInput->GetTool() == ID_Selector)
         {
-            mModel->CreateCommand(CM_Move, event.GetPosition());
-        }
-        switch (mCurrentTool) {
-            case ID_DrawRect:
-                mModel->UnSelectShape();
-                mModel->CreateCommand(CM_DrawRect, event.GetPosition());
-                mPanel->PaintNow();
-                break;
-            case ID_DrawEllipse:
-                mModel->UnSelectShape();
-                mModel->CreateCommand(CM_DrawEllipse, event.GetPosition());
-                mPanel->PaintNow();
-                break;
-            case ID_DrawLine:
-                mModel->UnSelectShape();
-                mModel->CreateCommand(CM_DrawLine, event.GetPosition());
-                mPanel->PaintNow();
-                break;
-            case ID_DrawPencil:
-                mModel->UnSelectShape();
-                mModel->CreateCommand(CM_DrawPencil, event.GetPosition());
-                mPanel->PaintNow();
-                break;
-            case ID_Selector:
-                mModel->SelectShape(event.GetPosition());
-                mPanel->PaintNow();
-                mEditMenu->Enable(ID_Unselect, true);
-                mEditMenu->Enable(ID_Delete, true);
-                break;
-            default:
-                break;
+            mEditMenu->Enable(ID_Unselect, true);
+            mEditMenu->Enable(ID_Delete, true);
         }
 	}
 	else if (event.LeftUp())
 	{
-        if(mModel->HasActiveCommand())
+        // The stroke being finished, if this ends one
+        std::shared_ptr<Shape> stroke = mModel->GetActiveShape();
+        if(mInput->LeftUp(point))
         {
-            mModel->UpdateCommand(event.GetPosition());
-            mModel->FinalizeCommand();
+            if(mInput->GetTool() == ID_DrawPencil && stroke != nullptr && stroke->GetKind() == SK_Pencil)
+            {
+                const PencilShape& pencil = static_cast<const PencilShape&>(*stroke);
+                SetStatusText(wxString::Format("Pencil points: %lu recorded, %lu kept",
+                    static_cast<unsigned long>(pencil.GetRecordedCount()),
+                    static_cast<unsigned long>(pencil.GetPointCount())));
+            }
+            mPanel->RequestPaint();
         }
     }
     
@@ -433,22 +825,114 @@ void PaintFrame::OnMouseButton(wxMouseEvent& event)
 
 void PaintFrame::OnMouseMove(wxMouseEvent& event)
 {
-    std::shared_ptr<RectShape> selectedShape = std::dynamic_pointer_cast<RectShape >(mModel->GetSelectedShape());
-    if(selectedShape != nullptr && selectedShape->GetSelectionRectangle().Contains(event.GetPosition()))
+    if(event.MiddleIsDown())
     {
-        SetCursor(CU_Move);
+        mPanel->PanBy(event.GetPosition() - mPanPosition);
+        mPanPosition = event.GetPosition();
+        return;
     }
-    else if(selectedShape != nullptr){
-        SetCursor(CU_Default);
+    
+    wxPoint point = mPanel->ToDocument(event.GetPosition());
+    if(mInput->MouseMove(point))
+    {
+        SetCursor(mInput->IsOverSelection() ? CU_Move : CU_Default);
     }
     
     if(mModel->HasActiveCommand())
     {
-        mModel->UpdateCommand(event.GetPosition());
-        mPanel->PaintNow();
+        mPanel->RequestPaint();
     }
 }
 
+void PaintFrame::OnMouseWheel(wxMouseEvent& event)
+{
+	double notches = static_cast<double>(event.GetWheelRotation()) / event.GetWheelDelta();
+	if (event.CmdDown())
+	{
+		mPanel->ZoomBy(std::pow(ZOOM_STEP, notches), event.GetPosition());
+		UpdateZoomStatus();
+	}
+	else
+	{
+		int distance = static_cast<int>(notches * SCROLL_STEP);
+		mPanel->PanBy(event.ShiftDown() ? wxPoint(distance, 0) : wxPoint(0, distance));
+	}
+}
+
+void PaintFrame::OnZoom(wxCommandEvent& event)
+{
+	switch (event.GetId())
+	{
+		case wxID_ZOOM_IN:
+			mPanel->ZoomBy(ZOOM_STEP);
+			break;
+		case wxID_ZOOM_OUT:
+			mPanel->ZoomBy(1.0 / ZOOM_STEP);
+			break;
+		default:
+			mPanel->ResetView();
+			break;
+	}
+	UpdateZoomStatus();
+}
+
+void PaintFrame::UpdateZoomStatus()
+{
+	SetStatusText(wxString::Format("Zoom: %d%%",
+		static_cast<int>(std::floor(mPanel->GetViewport().GetZoom() * 100.0 + 0.5))));
+}
+
+#ifdef PAINT_PROFILING
+void PaintFrame::OnShowTimings(wxCommandEvent& event)
+{
+	if (event.IsChecked())
+	{
+		Profiler::Get().SetEnabled(true);
+		mTimingsTimer.Start(TIMINGS_INTERVAL);
+	}
+	else
+	{
+		mTimingsTimer.Stop();
+		SetStatusText("", 1);
+		// A trace being recorded still needs the timings
+		Profiler::Get().SetEnabled(Profiler::Get().IsTracing());
+	}
+}
+
+void PaintFrame::OnResetTimings(wxCommandEvent& event)
+{
+	Profiler::Get().Reset();
+	SetStatusText("", 1);
+}
+
+void PaintFrame::OnRecordTrace(wxCommandEvent& event)
+{
+	if (event.IsChecked())
+	{
+		Profiler::Get().StartTrace();
+		return;
+	}
+
+	wxFileDialog saveFileDialog(this, _("Save Trace"), "", "trace.json",
+		"Chrome traces (*.json)|*.json", wxFD_SAVE|wxFD_OVERWRITE_PROMPT);
+	wxString filename;
+	if (saveFileDialog.ShowModal() != wxID_CANCEL)
+	{
+		filename = saveFileDialog.GetPath();
+	}
+	if (!Profiler::Get().StopTrace(filename))
+	{
+		wxLogError("Cannot save file '%s'.", filename);
+	}
+	Profiler::Get().SetEnabled(mViewMenu->IsChecked(ID_ShowTimings));
+}
+
+void PaintFrame::OnTimingsTimer(wxTimerEvent& event)
+{
+	SetStatusText(Profiler::Get().GetSummary(TIMINGS_SECTIONS), 1);
+}
+#endif
+
 void PaintFrame::ToggleTool(EventID toolID)
 {
 	// Deselect everything
@@ -459,8 +943,6 @@ void PaintFrame::ToggleTool(EventID toolID)
 
 	// Select the new tool
 	mToolbar->ToggleTool(toolID, true);
-
-	mCurrentTool = toolID;
 }
 
 void PaintFrame::SetCursor(CursorType type)
@@ -475,7 +957,12 @@ void PaintFrame::SetCursor(CursorType type)
 
 void PaintFrame::OnSelectTool(wxCommandEvent& event)
 {
-	EventID id = static_cast<EventID>(event.GetId());
+	SelectTool(static_cast<EventID>(event.GetId()));
+}
+
+void PaintFrame::SelectTool(EventID id)
+{
+	mInput->SelectTool(id);
 	ToggleTool(id);
 
 	// Select appropriate cursor
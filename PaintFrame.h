@@ -10,6 +10,8 @@ class PaintFrame : public wxFrame
 {
 public:
 	PaintFrame(const wxString& title, const wxPoint& pos, const wxSize& size);
+	// Waits for a running export to stop before the frame goes away
+	~PaintFrame();
 private:
 	// Helper setup function
 	void SetupMenu();
@@ -20,20 +22,57 @@ private:
 	void OnExit(wxCommandEvent& event);
 	// File>New event
 	void OnNew(wxCommandEvent& event);
+	// File>Open, for documents in the native format
+	void OnOpen(wxCommandEvent& event);
+	// File>Save and File>Save As
+	void OnSave(wxCommandEvent& event);
 	
 	// Export the drawing to an image
 	void OnExport(wxCommandEvent& event);
 	// Import an image into the drawing
 	void OnImport(wxCommandEvent& event);
+	// File>Cancel Export
+	void OnCancelExport(wxCommandEvent& event);
+	// Progress of the background export, in percent
+	void OnExportProgress(wxThreadEvent& event);
+	// The background export finished, failed or was cancelled
+	void OnExportDone(wxThreadEvent& event);
+	// Enables export or cancel depending on whether an export is running
+	void UpdateExportButtons();
+	// File>Cancel Import
+	void OnCancelImport(wxCommandEvent& event);
+	// Progress of the background import, in percent
+	void OnImportProgress(wxThreadEvent& event);
+	// A reduced resolution version of the image being imported
+	void OnImportPreview(wxThreadEvent& event);
+	// The full resolution image, or why there isn't one
+	void OnImportDone(wxThreadEvent& event);
+	// Stops the background import and takes its preview off the canvas
+	void CancelImport();
+	// Enables import or cancel depending on whether an import is running
+	void UpdateImportButtons();
+	// File>Record Input, which starts a recording or stops and saves it
+	void OnRecordInput(wxCommandEvent& event);
+	// Cancels any import and clears the document and the view
+	void NewDocument();
+	// Snapshots the document and journals its edits from here on
+	void StartJournal();
+	// Offers to recover the drawings of sessions that crashed; returns true
+	// if one was recovered into the model
+	bool RecoverDocument();
 
 	// Edit>Undo
 	void OnUndo(wxCommandEvent& event);
 	// Edit>Redo
 	void OnRedo(wxCommandEvent& event);
+	// Dragging the history slider on the toolbar
+	void OnHistorySlider(wxCommandEvent& event);
 	// Edit>Unselect
 	void OnUnselect(wxCommandEvent& event);
 	// Edit>Delete
 	void OnDelete(wxCommandEvent& event);
+	// Edit>History Memory...
+	void OnSetHistoryBudget(wxCommandEvent& event);
 
 	// Colors>Pen Color
 	void OnSetPenColor(wxCommandEvent& event);
@@ -42,6 +81,23 @@ private:
 	// Colors>Brush Color
 	void OnSetBrushColor(wxCommandEvent& event);
 	
+	// View>Zoom In, Zoom Out and Actual Size
+	void OnZoom(wxCommandEvent& event);
+	// Wheel scrolls the view, or zooms around the mouse with Ctrl held
+	void OnMouseWheel(wxMouseEvent& event);
+	// Shows the current zoom in the status bar
+	void UpdateZoomStatus();
+#ifdef PAINT_PROFILING
+	// View>Show Timings, which turns the profiler on or off
+	void OnShowTimings(wxCommandEvent& event);
+	// View>Reset Timings
+	void OnResetTimings(wxCommandEvent& event);
+	// View>Record Trace, which starts a Chrome trace or stops and saves it
+	void OnRecordTrace(wxCommandEvent& event);
+	// Puts the busiest profiler sections in the status bar
+	void OnTimingsTimer(wxTimerEvent& event);
+#endif
+	
 	// Event when the mouse button is clicked
 	void OnMouseButton(wxMouseEvent& event);
 	// Event when the mouse moves (inside draw panel)
@@ -49,6 +105,7 @@ private:
 
 	// Event when selecting a drawing tool
 	void OnSelectTool(wxCommandEvent& event);
+	void SelectTool(EventID toolID);
 	void ToggleTool(EventID toolID);
 
 	void SetCursor(CursorType type);
@@ -63,16 +120,36 @@ private:
 	CursorCache mCursors;
 
 	std::shared_ptr<class PaintModel> mModel;
+	// Export running in the background, if any
+	std::unique_ptr<class ExportJob> mExportJob;
+	// Import running in the background, if any
+	std::unique_ptr<class ImportJob> mImportJob;
+	// Turns input into model edits, recording it when asked to
+	std::unique_ptr<class InputController> mInput;
+	// Input recorded so far, while File>Record Input is checked
+	std::unique_ptr<class InputRecording> mRecording;
+	// Where File>Save writes the document; empty until it's saved or opened
+	wxString mDocumentPath;
+	// Keeps the document recoverable if the app crashes
+	std::unique_ptr<class DocumentJournal> mJournal;
 
 	// Menus
 	class wxMenu* mFileMenu;
 	class wxMenu* mEditMenu;
 	class wxMenu* mColorMenu;
+	class wxMenu* mViewMenu;
 	// Toolbar
 	class wxToolBar* mToolbar;
+	// Revision of the undo history the model is at, on the toolbar
+	class wxSlider* mHistorySlider;
 	// Panel for drawing
 	class PaintDrawPanel* mPanel;
 
-	EventID mCurrentTool;
     CursorType mCurrentCursor;
+    // Last mouse position (panel pixels) while panning with the middle button
+    wxPoint mPanPosition;
+#ifdef PAINT_PROFILING
+	// Refreshes the timings in the status bar while they're shown
+	wxTimer mTimingsTimer;
+#endif
 };
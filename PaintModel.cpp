@@ -1,76 +1,430 @@
 #include "PaintModel.h"
-#include <algorithm>
+#include "BinaryRecord.h"
+#include "DocumentFile.h"
+#include "DocumentJournal.h"
+#include "Journal.h"
+#include "Profiler.h"
 #include <wx/dcmemory.h>
+#include <wx/debug.h>
+#include <algorithm>
+
+// Default for SetHistoryBudget
+static const size_t HISTORY_BUDGET = 64 * 1024 * 1024;
+
+// Needed for odr-uses
+const uint32_t PaintModel::MERGE_WINDOW;
 
 PaintModel::PaintModel()
+: mShapeGridStale(false)
+, mCommittedListVersion(0)
+, mHistoryBudget(HISTORY_BUDGET)
+, mTransactionDepth(0)
+, mTime(0)
+, mLastCommandTime(0)
+, mMergeable(false)
+, mStyle(StyleTable::DEFAULT_STYLE)
+, mSimplifyTolerance(0.5)
+, mCommittedVersion(0)
+, mFullDamage(true)
+, mStrokeActive(false)
+, mStrokeOnlyDamage(false)
+, mJournal(nullptr)
 {
-    mPen = *wxBLACK_PEN;
-    mOldPen = mPen;
-    mBrush = *wxWHITE_BRUSH;
-    mOldBrush = mBrush;
+    
 }
 
 void PaintModel::LoadBitmap(wxString filename, wxBitmapType type)
 {
     New();
-    mBitmap.LoadFile(filename, type);
+    std::shared_ptr<TiledImage> image = std::make_shared<TiledImage>();
+    if(image->Create(wxImage(filename, type)))
+    {
+        mImage = image;
+    }
+    InvalidateCommitted();
+    DamageAll();
+}
+bool PaintModel::SaveDocument(const wxString& filename)
+{
+    std::vector<const Shape*> shapes;
+    GetDrawOrder(shapes);
+    return DocumentFile::Save(filename, mSize, mStyles, shapes);
+}
+
+bool PaintModel::LoadDocument(const wxString& filename)
+{
+    PROFILE_SCOPE("PaintModel::LoadDocument");
+    DocumentFile file;
+    if(!file.Open(filename))
+    {
+        return false;
+    }
+    New();
+    const DocumentFile::Header& header = file.GetHeader();
+    mSize = wxSize(header.mWidth, header.mHeight);
+    
+    // Equal styles in the file intern to the same handle here
+    const DocumentFile::StyleRecord* styles = file.GetStyles();
+    std::vector<StyleId> styleIds(header.mStyleCount);
+    for(size_t i = 0; i < styleIds.size(); i++)
+    {
+        const DocumentFile::StyleRecord& record = styles[i];
+        wxColour penColour;
+        penColour.SetRGBA(record.mPenColour);
+        wxColour brushColour;
+        brushColour.SetRGBA(record.mBrushColour);
+        styleIds[i] = mStyles.Intern(
+            wxPen(penColour, record.mPenWidth, static_cast<wxPenStyle>(record.mPenStyle)),
+            wxBrush(brushColour, static_cast<wxBrushStyle>(record.mBrushStyle)));
+    }
+    
+    // Shapes go straight into the registry; AddShape would damage and
+    // index each one on its own, and everything gets repainted anyway
+    const DocumentFile::ShapeRecord* shapes = file.GetShapes();
+    mShapes.Reserve(header.mShapeCount);
+    for(uint32_t i = 0; i < header.mShapeCount; i++)
+    {
+        const DocumentFile::ShapeRecord& record = shapes[i];
+        wxPoint start(record.mStart[0], record.mStart[1]);
+        std::shared_ptr<Shape> shape;
+        switch(record.mKind)
+        {
+            case SK_Rect:
+                shape = Make<RectShape>(start);
+                break;
+            case SK_Ellipse:
+                shape = Make<EllipseShape>(start);
+                break;
+            case SK_Line:
+                shape = Make<LineShape>(start);
+                break;
+            default:
+                shape = Make<PencilShape>(start);
+                break;
+        }
+        shape->SetGeometry(start, wxPoint(record.mEnd[0], record.mEnd[1]),
+            wxPoint(record.mTopLeft[0], record.mTopLeft[1]),
+            wxPoint(record.mBotRight[0], record.mBotRight[1]));
+        shape->SetOffset(wxPoint(record.mOffset[0], record.mOffset[1]));
+        shape->SetStyle(styleIds[record.mStyle], mStyles);
+        if(record.mKind == SK_Pencil)
+        {
+            file.RestoreStroke(record, static_cast<PencilShape&>(*shape));
+        }
+        mShapes.Add(shape);
+    }
+    mShapeGridStale = true;
+    InvalidateCommitted();
+    DamageAll();
+    return true;
+}
+
+void PaintModel::CaptureSession(SessionSnapshot& snapshot)
+{
+    PROFILE_SCOPE("PaintModel::CaptureSession");
+    std::vector<unsigned char> header;
+    RecordWriter writer(header);
+    writer.Put(static_cast<uint8_t>(SessionSnapshot::SR_Document));
+    writer.Put(static_cast<uint32_t>(mSize.GetWidth()));
+    writer.Put(static_cast<uint32_t>(mSize.GetHeight()));
+    writer.Put(static_cast<uint32_t>(mShapes.GetNextId()));
+    writer.Put(static_cast<uint32_t>(GetRevision()));
+    writer.Put(static_cast<uint32_t>(mStyle));
+    // Whether the next move or restyle can merge with the last command
+    writer.Put(static_cast<uint8_t>(mMergeable));
+    writer.Put(mLastCommandTime);
+    snapshot.Add(std::move(header));
+    
+    // Commands refer to styles by handle, so they go in handle order
+    for(StyleId style = 0; style < mStyles.GetCount(); style++)
+    {
+        const wxPen& pen = mStyles.GetPen(style);
+        const wxBrush& brush = mStyles.GetBrush(style);
+        std::vector<unsigned char> record;
+        RecordWriter writer(record);
+        writer.Put(static_cast<uint8_t>(SessionSnapshot::SR_Style));
+        writer.Put(static_cast<uint32_t>(pen.GetColour().GetRGBA()));
+        writer.Put(static_cast<uint32_t>(pen.GetWidth()));
+        writer.Put(static_cast<uint32_t>(pen.GetStyle()));
+        writer.Put(static_cast<uint32_t>(brush.GetColour().GetRGBA()));
+        writer.Put(static_cast<uint32_t>(brush.GetStyle()));
+        snapshot.Add(std::move(record));
+    }
+    for(auto& iter : mShapes.GetOrder())
+    {
+        std::vector<unsigned char> record;
+        RecordWriter writer(record);
+        writer.Put(static_cast<uint8_t>(SessionSnapshot::SR_Shape));
+        writer.Put(static_cast<uint32_t>(iter.second->GetId()));
+        CommandHistory::WriteShape(writer, *iter.second);
+        snapshot.Add(std::move(record));
+    }
+    mHistory.Capture(*this, snapshot);
+}
+
+bool PaintModel::LoadSession(const wxString& filename)
+{
+    PROFILE_SCOPE("PaintModel::LoadSession");
+    Journal::Reader reader;
+    Journal::Record record;
+    uint8_t type = 0, mergeable = 0;
+    uint32_t width = 0, height = 0, nextId = 0, revision = 0, style = 0, lastCommandTime = 0;
+    if(!reader.Open(filename) || !reader.Next(record))
+    {
+        return false;
+    }
+    RecordReader header(record);
+    if(!header.Get(type) || type != SessionSnapshot::SR_Document || !header.Get(width) || !header.Get(height) ||
+       !header.Get(nextId) || !header.Get(revision) || !header.Get(style) || !header.Get(mergeable) ||
+       !header.Get(lastCommandTime) || !header.IsAtEnd())
+    {
+        return false;
+    }
+    New();
+    mSize = wxSize(static_cast<int32_t>(width), static_cast<int32_t>(height));
+    mShapes.Reset(static_cast<ShapeId>(nextId));
+    
+    // Records come in the order CaptureSession adds them, up to the end
+    // record, which only a complete snapshot has
+    StyleId nextStyle = 0;
+    bool ok = true;
+    bool complete = false;
+    while(ok && !complete && reader.Next(record))
+    {
+        RecordReader fields(record);
+        ok = fields.Get(type);
+        if(!ok)
+        {
+            break;
+        }
+        if(type == SessionSnapshot::SR_Style)
+        {
+            uint32_t penColour = 0, penWidth = 0, penStyle = 0, brushColour = 0, brushStyle = 0;
+            ok = fields.Get(penColour) && fields.Get(penWidth) && fields.Get(penStyle) && fields.Get(brushColour) &&
+                fields.Get(brushStyle) && fields.IsAtEnd() && static_cast<int32_t>(penWidth) >= 0 &&
+                DocumentFile::IsPlainPenStyle(static_cast<int32_t>(penStyle)) &&
+                DocumentFile::IsPlainBrushStyle(static_cast<int32_t>(brushStyle));
+            if(ok)
+            {
+                wxColour colour;
+                colour.SetRGBA(penColour);
+                wxPen pen(colour, static_cast<int>(penWidth), static_cast<wxPenStyle>(penStyle));
+                colour.SetRGBA(brushColour);
+                // Every style has to get back the handle it had
+                ok = mStyles.Intern(pen, wxBrush(colour, static_cast<wxBrushStyle>(brushStyle))) == nextStyle++;
+            }
+        }
+        else if(type == SessionSnapshot::SR_Shape)
+        {
+            // Straight into the registry, as in LoadDocument
+            uint32_t id = 0;
+            ok = fields.Get(id);
+            std::shared_ptr<Shape> shape = ok ? CommandHistory::ReadShape(*this, fields) : nullptr;
+            ok = shape != nullptr && fields.IsAtEnd() && mShapes.Rebind(static_cast<ShapeId>(id), shape) &&
+                mShapes.Add(shape);
+        }
+        else if(type == SessionSnapshot::SR_HistoryShape || type == SessionSnapshot::SR_Command)
+        {
+            ok = mHistory.Restore(*this, record);
+        }
+        else
+        {
+            complete = type == SessionSnapshot::SR_End && fields.IsAtEnd();
+            ok = complete;
+        }
+    }
+    if(!complete || revision > mHistory.GetCount() || style >= mStyles.GetCount())
+    {
+        New();
+        return false;
+    }
+    mHistory.SetPosition(revision);
+    mStyle = static_cast<StyleId>(style);
+    mMergeable = mergeable != 0;
+    mLastCommandTime = lastCommandTime;
+    mShapeGridStale = true;
+    InvalidateCommitted();
+    DamageAll();
+    return true;
 }
+
 // Draws any shapes in the model to the provided DC (draw context)
 void PaintModel::DrawShapes(wxDC& dc, bool showSelection)
 {
-    if(mBitmap.IsOk())
+    PROFILE_SCOPE("PaintModel::DrawShapes");
+    DrawCommittedShapes(dc);
+    DrawActiveShapes(dc, showSelection);
+}
+
+void PaintModel::DrawShapes(SoftwareRenderer& renderer)
+{
+    PROFILE_SCOPE("PaintModel::DrawShapes (software)");
+    if(mImage)
     {
-        dc.DrawBitmap(mBitmap, wxPoint(0,0));
+        mImage->Draw(renderer);
     }
-    for(auto& iter : mShapes)
+    std::vector<const Shape*> shapes;
+    GetDrawOrder(shapes);
+    for(auto shape : shapes)
     {
-        iter->Draw(dc);
+        renderer.DrawShape(*shape, mStyles);
     }
-    if(mSelectedShape != nullptr)
+}
+
+void PaintModel::GetDrawOrder(std::vector<const Shape*>& shapes)
+{
+    // Same order as the wxDC path: committed shapes, then the active one
+    std::shared_ptr<Shape> active = GetActiveShape();
+    shapes.clear();
+    shapes.reserve(mShapes.GetCount());
+    for(auto& iter : mShapes.GetOrder())
+    {
+        if(iter.second != active)
+        {
+            shapes.push_back(iter.second.get());
+        }
+    }
+    if(active != nullptr)
+    {
+        shapes.push_back(active.get());
+    }
+}
+
+void PaintModel::DrawCommittedShapes(wxDC& dc, const wxRect* clip)
+{
+    PROFILE_SCOPE("PaintModel::DrawCommittedShapes");
+    if(mImage)
+    {
+        // Only the tiles under clip get read and drawn
+        mImage->Draw(dc, clip);
+    }
+    std::shared_ptr<Shape> active = GetActiveShape();
+    std::vector<const Shape*> shapes;
+    if(clip != nullptr)
+    {
+        GetShapeGrid().Query(*clip, shapes);
+    }
+    
+    // With everything in view the cached list draws the same shapes
+    if(clip == nullptr || shapes.size() >= mShapes.GetCount())
+    {
+        // Anything that changes the committed shapes bumps the version,
+        // which also keeps the list from outliving any shape it points to
+        if(mCommittedListVersion != mCommittedVersion || mCommittedList.GetCount() == 0)
+        {
+            mCommittedList.Clear();
+            for(auto& iter : mShapes.GetOrder())
+            {
+                if(iter.second != active)
+                {
+                    mCommittedList.Add(*iter.second);
+                }
+            }
+            mCommittedListVersion = mCommittedVersion;
+        }
+        mCommittedList.Draw(dc, mStyles);
+    }
+    else
+    {
+        DrawList list;
+        for(const Shape* shape : shapes)
+        {
+            if(shape != active.get())
+            {
+                list.Add(*shape);
+            }
+        }
+        list.Draw(dc, mStyles);
+    }
+}
+
+void PaintModel::DrawActiveShapes(wxDC& dc, bool showSelection, const wxRect* clip)
+{
+    PROFILE_SCOPE("PaintModel::DrawActiveShapes");
+    // The active shape is drawn on top of the committed layer while it is
+    // being edited, and drops back to its z-order once finalized.
+    // It is never culled, because the bounds of an unfinished shape
+    // aren't reliable (the clip still limits what actually gets touched).
+    std::shared_ptr<Shape> active = GetActiveShape();
+    if(active != nullptr)
+    {
+        active->Draw(dc, mStyles);
+    }
+    if(showSelection && mSelectedShape != nullptr &&
+       (clip == nullptr || clip->Intersects(mSelectedShape->GetDamageRect())))
     {
         mSelectedShape->DrawSelection(dc);
     }
 }
 
+std::shared_ptr<Shape> PaintModel::GetActiveShape()
+{
+    if(mActiveCommand != nullptr)
+    {
+        return mActiveCommand->GetShape();
+    }
+    return nullptr;
+}
+
 // Clear the current paint model and start fresh
 void PaintModel::New()
 {
     mActiveCommand.reset();
-    while(!mRedo.empty())
-    {
-        mRedo.pop();
-    }
-    while(!mUndo.empty())
+    mStrokeActive = false;
+    mHistory.Clear();
+    mCheckpoints.Clear();
+    mTransaction.reset();
+    mTransactionDepth = 0;
+    mMergeable = false;
+    mShapes.Clear();
+    mShapeGrid.Clear();
+    mShapeGridStale = false;
+    mStyles.Clear();
+    mStyle = StyleTable::DEFAULT_STYLE;
+    mSelectedShape.reset();
+    mSelection.reset();
+    mCommittedList.Clear();
+    mImage.reset();
+    // Nothing should point into the pool anymore, so drop all of it
+    // instead of keeping the old document's peak around. Anything still
+    // holding a shape or command of the old document keeps every block.
+    if(!mArena.Release())
     {
-        mUndo.pop();
+        wxFAIL_MSG(wxString::Format("%lu pool allocations outlived the document",
+            static_cast<unsigned long>(mArena.GetLiveCount())));
     }
-    mShapes.clear();
-    mPen = *wxBLACK_PEN;
-    mOldPen = mPen;
-    mBrush = *wxWHITE_BRUSH;
-    mOldBrush = mBrush;
-    mSelectedShape.reset();
-    mBitmap = wxBitmap();
+    InvalidateCommitted();
+    DamageAll();
 }
 
 // Add a shape to the paint model
-void PaintModel::AddShape(std::shared_ptr<Shape> shape)
+void PaintModel::AddShape(const std::shared_ptr<Shape>& shape)
 {
     UnSelectShape();
-    if (std::find(mShapes.begin(), mShapes.end(), shape) == mShapes.end())
+    // Shapes that were removed earlier go back to their old z position
+    if (mShapes.Add(shape))
     {
-        mShapes.emplace_back(shape);
+        if (!mShapeGridStale)
+        {
+            mShapeGrid.Insert(shape.get(), mShapes.GetZ(shape));
+        }
+        InvalidateCommitted();
+        DamageShape(shape);
     }
 }
 
 // Remove a shape from the paint model
-void PaintModel::RemoveShape(std::shared_ptr<Shape> shape)
+void PaintModel::RemoveShape(const std::shared_ptr<Shape>& shape)
 {
     UnSelectShape();
-	auto iter = std::find(mShapes.begin(), mShapes.end(), shape);
-	if (iter != mShapes.end())
+	if (mShapes.Remove(shape))
 	{
-		mShapes.erase(iter);
+		if (!mShapeGridStale)
+		{
+			mShapeGrid.Remove(shape.get());
+		}
+		InvalidateCommitted();
+		DamageShape(shape);
 	}
 }
 
@@ -86,23 +440,170 @@ bool PaintModel::HasActiveCommand()
 
 void PaintModel::CreateCommand(CommandType commandType, const wxPoint& start)
 {
+    UpdateCheckpoints();
+    // Commands on the selection may restyle or remove it
+    DamageShape(mSelectedShape);
     mActiveCommand = CommandFactory::Create(shared_from_this(), commandType, start);
-    while(!mRedo.empty())
-    {
-        mRedo.pop();
-    }
+    mStrokeActive = (commandType == CM_DrawPencil);
+    DamageShape(mActiveCommand->GetShape());
+    UpdateShapeIndex(mActiveCommand->GetShape());
+    // The active shape leaves the committed layer until it is finalized
+    InvalidateCommitted();
+    mHistory.Truncate(*this, GetRevision());
+    mCheckpoints.Truncate(GetRevision());
 }
 
 void PaintModel::UpdateCommand(wxPoint point)
 {
+    const std::shared_ptr<Shape>& shape = mActiveCommand->GetShape();
+    if(mStrokeActive)
+    {
+        // A stroke only grows by its new segment and the part drawn so far
+        // doesn't change, so keep this O(1): no full-shape damage and no
+        // re-binning, which FinalizeCommand takes care of
+        wxPoint last = mActiveCommand->GetEndPoint();
+        if(!mFullDamage)
+        {
+            mDamage.Union(shape->GetDamageRect(last, point));
+        }
+        if(mPendingStroke.empty())
+        {
+            mPendingStroke.push_back(last);
+        }
+        mPendingStroke.push_back(point);
+        mActiveCommand->Update(point);
+        return;
+    }
+    
+    DamageShape(shape);
+    if(shape != nullptr)
+    {
+        // Freehand shapes only grow by the newly added segment, which can
+        // fall outside of both the old and the new start/end bounds
+        AddDamage(shape->GetDamageRect(mActiveCommand->GetEndPoint(), point));
+    }
     mActiveCommand->Update(point);
+    DamageShape(shape);
+    UpdateShapeIndex(shape);
 }
 
 void PaintModel::FinalizeCommand()
 {
+    PROFILE_SCOPE("PaintModel::FinalizeCommand");
+    DamageShape(mActiveCommand->GetShape());
+    if(mJournal != nullptr)
+    {
+        // Recorded before Finalize simplifies pencil strokes, so a replay
+        // gets the same samples to simplify
+        mJournal->RecordCommand(*mActiveCommand, mStyles, mStyle, mTime);
+    }
     mActiveCommand->Finalize(shared_from_this());
-    mUndo.push(mActiveCommand);
+    DamageShape(mActiveCommand->GetShape());
+    UpdateShapeIndex(mActiveCommand->GetShape());
+    if(mTransaction != nullptr)
+    {
+        // Within a transaction everything is undone together anyway, so
+        // merging only saves memory and the time doesn't matter
+        if(!mTransaction->Merge(*mActiveCommand))
+        {
+            mTransaction->Add(mActiveCommand);
+        }
+    }
+    else
+    {
+        if(!MergeCommand(*mActiveCommand))
+        {
+            mHistory.Push(*this, mActiveCommand);
+        }
+        mMergeable = true;
+        mLastCommandTime = mTime;
+    }
     mActiveCommand = nullptr;
+    mStrokeActive = false;
+    InvalidateCommitted();
+    UpdateCheckpoints();
+    TrimHistory();
+    // Takes a new snapshot once the journal gets too long to replay
+    // quickly, which waits for the transaction to be committed
+    if(mTransaction == nullptr && mJournal != nullptr && mJournal->NeedsCompaction())
+    {
+        mJournal->Compact(*this);
+    }
+}
+
+bool PaintModel::MergeCommand(Command& command)
+{
+    // A clock that went back, as when a crashed session is recovered,
+    // wraps around to more than the window. Other commands never merge,
+    // so there's no reading the last one back from the spill file for them.
+    CommandType type = command.GetType();
+    if(!mMergeable || mTime - mLastCommandTime > MERGE_WINDOW ||
+       (type != CM_Move && type != CM_SetPen && type != CM_SetBrush) || GetRevision() == 0)
+    {
+        return false;
+    }
+    size_t index = GetRevision() - 1;
+    std::shared_ptr<Command> last = mHistory.Get(*this, index);
+    if(last == nullptr)
+    {
+        // What's left of the history starts over from revision 0
+        mCheckpoints.Clear();
+        return false;
+    }
+    if(!last->Merge(command))
+    {
+        return false;
+    }
+    mHistory.Changed(index);
+    // A checkpoint at this revision has the shape the way it was before
+    mCheckpoints.Truncate(index);
+    return true;
+}
+
+void PaintModel::BeginTransaction()
+{
+    if(mTransactionDepth++ > 0)
+    {
+        return;
+    }
+    mTransaction = Make<CompoundCommand>();
+    // Nothing from before the transaction is undone with it
+    mMergeable = false;
+    if(mJournal != nullptr)
+    {
+        mJournal->RecordBegin();
+    }
+}
+
+void PaintModel::CommitTransaction()
+{
+    if(mTransactionDepth == 0 || --mTransactionDepth > 0)
+    {
+        return;
+    }
+    std::shared_ptr<CompoundCommand> transaction = mTransaction;
+    mTransaction.reset();
+    if(mJournal != nullptr)
+    {
+        mJournal->RecordCommit();
+    }
+    const std::vector<std::shared_ptr<Command>>& commands = transaction->GetCommands();
+    if(commands.size() == 1)
+    {
+        mHistory.Push(*this, commands.front());
+    }
+    else if(!commands.empty())
+    {
+        mHistory.Push(*this, transaction);
+    }
+    // Whatever comes next is undone on its own
+    mMergeable = false;
+    UpdateCheckpoints();
+    TrimHistory();
+    if(mJournal != nullptr && mJournal->NeedsCompaction())
+    {
+        mJournal->Compact(*this);
+    }
 }
 
 void PaintModel::DeleteCommand()
@@ -114,6 +615,27 @@ void PaintModel::DeleteCommand()
     }
 }
 
+void PaintModel::SetPenWidth(int width)
+{
+    wxPen pen = GetPen();
+    pen.SetWidth(width);
+    mStyle = mStyles.Intern(pen, GetBrush());
+}
+
+void PaintModel::SetPenColor(wxColour color)
+{
+    wxPen pen = GetPen();
+    pen.SetColour(color);
+    mStyle = mStyles.Intern(pen, GetBrush());
+}
+
+void PaintModel::SetBrushColor(wxColour color)
+{
+    wxBrush brush = GetBrush();
+    brush.SetColour(color);
+    mStyle = mStyles.Intern(GetPen(), brush);
+}
+
 void PaintModel::SetPenCommand()
 {
     if(mSelectedShape != nullptr)
@@ -134,39 +656,455 @@ void PaintModel::SetBrushCommand()
 
 void PaintModel::Undo()
 {
-    if(CanUndo())
+    if(CanUndo() && UndoCommand())
     {
-        auto command = mUndo.top();
-        command->Undo(shared_from_this());
-        mRedo.push(command);
-        mUndo.pop();
+        if(mJournal != nullptr)
+        {
+            mJournal->RecordUndo();
+        }
+        UpdateCheckpoints();
+        TrimHistory();
     }
 }
 
 void PaintModel::Redo()
 {
-    if(CanRedo())
+    if(CanRedo() && RedoCommand())
+    {
+        if(mJournal != nullptr)
+        {
+            mJournal->RecordRedo();
+        }
+        UpdateCheckpoints();
+        TrimHistory();
+    }
+}
+
+bool PaintModel::UndoCommand()
+{
+    mMergeable = false;
+    size_t index = GetRevision() - 1;
+    auto command = mHistory.Get(*this, index);
+    if(command == nullptr)
+    {
+        // What's left of the history starts over from revision 0
+        mCheckpoints.Clear();
+        return false;
+    }
+    ApplyCommand(command, true);
+    mHistory.SetPosition(index);
+    InvalidateCommitted();
+    return true;
+}
+
+bool PaintModel::RedoCommand()
+{
+    mMergeable = false;
+    size_t index = GetRevision();
+    auto command = mHistory.Get(*this, index);
+    if(command == nullptr)
+    {
+        // Nothing past this revision is left
+        mCheckpoints.Truncate(GetRevision());
+        return false;
+    }
+    ApplyCommand(command, false);
+    mHistory.SetPosition(index + 1);
+    InvalidateCommitted();
+    return true;
+}
+
+void PaintModel::ApplyCommand(const std::shared_ptr<Command>& command, bool undo)
+{
+    if(command->GetType() == CM_Compound)
+    {
+        const std::vector<std::shared_ptr<Command>>& commands = static_cast<CompoundCommand&>(*command).GetCommands();
+        if(undo)
+        {
+            for(auto iter = commands.rbegin(); iter != commands.rend(); ++iter)
+            {
+                ApplyCommand(*iter, undo);
+            }
+        }
+        else
+        {
+            for(auto& child : commands)
+            {
+                ApplyCommand(child, undo);
+            }
+        }
+        return;
+    }
+    DamageShape(command->GetShape());
+    if(undo)
+    {
+        command->Undo(shared_from_this());
+    }
+    else
     {
-        auto command = mRedo.top();
         command->Redo(shared_from_this());
-        mUndo.push(command);
-        mRedo.pop();
+    }
+    DamageShape(command->GetShape());
+    UpdateShapeIndex(command->GetShape());
+}
+
+bool PaintModel::GoToRevision(size_t revision)
+{
+    PROFILE_SCOPE("PaintModel::GoToRevision");
+    if(HasActiveCommand() || IsInTransaction())
+    {
+        return false;
+    }
+    revision = std::min(revision, GetLastRevision());
+    size_t start = GetRevision();
+    // The current style ends up as undoing or redoing one command at a
+    // time would leave it, however the model gets there
+    StyleId style = mStyle;
+    mHistory.GetStepStyle(start, revision, style);
+    // Counted here rather than read off the history, since a command that
+    // can't be read back drops the ones before it
+    size_t reached = start;
+    size_t distance = revision > start ? revision - start : start - revision;
+    size_t at = 0;
+    const HistoryCheckpoints::Checkpoint* checkpoint = mCheckpoints.Find(revision, at);
+    if(checkpoint != nullptr && revision - at < distance && RestoreCheckpoint(*checkpoint))
+    {
+        // The commands between here and the checkpoint stay where they are
+        mHistory.SetPosition(at);
+        mMergeable = false;
+        reached = at;
+    }
+    
+    bool ok = true;
+    while(ok && reached != revision)
+    {
+        ok = reached < revision ? RedoCommand() : UndoCommand();
+        if(ok)
+        {
+            reached = reached < revision ? reached + 1 : reached - 1;
+        }
+    }
+    if(ok)
+    {
+        mStyle = style;
+    }
+    if(mJournal != nullptr && reached != start)
+    {
+        mJournal->RecordJump(static_cast<long>(reached) - static_cast<long>(start));
+    }
+    UpdateCheckpoints();
+    TrimHistory();
+    return ok;
+}
+
+void PaintModel::UpdateCheckpoints()
+{
+    if(HasActiveCommand() || IsInTransaction() || !mCheckpoints.IsDue(GetRevision(), mShapes.GetCount(), mHistoryBudget))
+    {
+        return;
+    }
+    PROFILE_SCOPE("PaintModel::UpdateCheckpoints");
+    HistoryCheckpoints::Checkpoint checkpoint;
+    checkpoint.reserve(mShapes.GetCount());
+    for(auto& iter : mShapes.GetOrder())
+    {
+        HistoryCheckpoints::ShapeState state;
+        state.mId = iter.second->GetId();
+        state.mOffset = iter.second->GetOffset();
+        state.mStyle = iter.second->GetStyle();
+        checkpoint.push_back(state);
+    }
+    mCheckpoints.Add(GetRevision(), std::move(checkpoint));
+}
+
+bool PaintModel::RestoreCheckpoint(const HistoryCheckpoints::Checkpoint& checkpoint)
+{
+    PROFILE_SCOPE("PaintModel::RestoreCheckpoint");
+    // A shape the model doesn't have is held by the history, if anything,
+    // or made again from its spill file, all before anything changes
+    std::vector<std::shared_ptr<Shape>> shapes;
+    shapes.reserve(checkpoint.size());
+    for(auto& state : checkpoint)
+    {
+        std::shared_ptr<Shape> shape = mShapes.Get(state.mId);
+        if(shape == nullptr)
+        {
+            shape = mShapes.GetRemoved(state.mId);
+        }
+        if(shape == nullptr)
+        {
+            shape = mHistory.ReadShape(*this, state.mId);
+        }
+        if(shape == nullptr)
+        {
+            return false;
+        }
+        shapes.push_back(shape);
+    }
+    
+    // The model and the checkpoint are both in draw order, so one pass
+    // over them finds the shapes that differ
+    std::vector<std::shared_ptr<Shape>> removed;
+    std::vector<size_t> added;
+    std::vector<size_t> changed;
+    const ShapeRegistry::Order& order = mShapes.GetOrder();
+    auto iter = order.begin();
+    size_t i = 0;
+    while(iter != order.end() || i < shapes.size())
+    {
+        unsigned int z = i < shapes.size() ? mShapes.GetZ(shapes[i]) : 0;
+        if(i == shapes.size() || (iter != order.end() && iter->first < z))
+        {
+            removed.push_back(iter->second);
+            ++iter;
+        }
+        else if(iter == order.end() || iter->first > z)
+        {
+            added.push_back(i++);
+        }
+        else
+        {
+            if(shapes[i]->GetOffset() != checkpoint[i].mOffset || shapes[i]->GetStyle() != checkpoint[i].mStyle)
+            {
+                changed.push_back(i);
+            }
+            ++iter;
+            i++;
+        }
+    }
+    if(removed.empty() && added.empty() && changed.empty())
+    {
+        return true;
+    }
+    
+    // Shapes go in and out of the registry and grid directly; everything
+    // is repainted once, instead of shape by shape. When a good part of
+    // the document changes, rebuilding the grid the next time it's needed
+    // is cheaper than updating it shape by shape.
+    UnSelectShape();
+    if(!mShapeGridStale && removed.size() + added.size() + changed.size() > mShapes.GetCount() / 8)
+    {
+        mShapeGrid.Clear();
+        mShapeGridStale = true;
+    }
+    std::vector<ShapeId> released;
+    for(auto& shape : removed)
+    {
+        mShapes.Remove(shape);
+        if(!mShapeGridStale)
+        {
+            mShapeGrid.Remove(shape.get());
+        }
+        released.push_back(shape->GetId());
+    }
+    for(size_t index : added)
+    {
+        shapes[index]->SetOffset(checkpoint[index].mOffset);
+        shapes[index]->SetStyle(checkpoint[index].mStyle, mStyles);
+        mShapes.Add(shapes[index]);
+        if(!mShapeGridStale)
+        {
+            mShapeGrid.Insert(shapes[index].get(), mShapes.GetZ(shapes[index]));
+        }
+    }
+    for(size_t index : changed)
+    {
+        shapes[index]->SetOffset(checkpoint[index].mOffset);
+        shapes[index]->SetStyle(checkpoint[index].mStyle, mStyles);
+        UpdateShapeIndex(shapes[index]);
+    }
+    // Shapes taken out that only the history held are gone unless one of
+    // its commands in memory still refers to them
+    removed.clear();
+    for(ShapeId id : released)
+    {
+        mShapes.Release(id);
+    }
+    InvalidateCommitted();
+    DamageAll();
+    return true;
+}
+
+void PaintModel::SetHistoryBudget(size_t bytes)
+{
+    mHistoryBudget = bytes;
+    TrimHistory();
+}
+
+void PaintModel::TrimHistory()
+{
+    // Whatever is furthest from the current revision goes first: commands
+    // to the spill file, or checkpoints, which only help jumps that far
+    size_t revision = GetRevision();
+    while(GetHistoryMemoryUsage() > mHistoryBudget)
+    {
+        size_t commandDistance = 0;
+        size_t checkpointDistance = 0;
+        bool command = mHistory.GetFurthest(commandDistance);
+        bool checkpoint = mCheckpoints.GetFurthest(revision, checkpointDistance);
+        if(checkpoint && (!command || checkpointDistance > commandDistance))
+        {
+            mCheckpoints.DropFurthest(revision);
+        }
+        else if(!mHistory.SpillFurthest(*this))
+        {
+            // Nothing is left to spill, or the spill file can't be written
+            if(!checkpoint)
+            {
+                break;
+            }
+            mCheckpoints.DropFurthest(revision);
+        }
+    }
+}
+
+void PaintModel::SelectShape(ShapeId id)
+{
+    std::shared_ptr<Shape> shape = mShapes.Get(id);
+    if(shape != nullptr)
+    {
+        DamageShape(mSelectedShape);
+        mSelectedShape = shape;
+        DamageShape(mSelectedShape);
     }
 }
 
 void PaintModel::SelectShape(wxPoint point)
 {
-    for(auto iter = mShapes.rbegin(); iter != mShapes.rend(); iter++)
+    PROFILE_SCOPE("PaintModel::SelectShape");
+    // The grid only points at shapes; the selection holds on to one
+    const Shape* picked = GetShapeGrid().Pick(point);
+    std::shared_ptr<Shape> shape = picked != nullptr ? mShapes.Get(picked->GetId()) : nullptr;
+    if(shape != nullptr)
+    {
+        DamageShape(mSelectedShape);
+        mSelectedShape = shape;
+        DamageShape(mSelectedShape);
+    }
+}
+
+uint64_t PaintModel::GetDocumentHash()
+{
+    // FNV-1a over fixed width fields, so the hash doesn't depend on the
+    // platform's int size or byte order
+    uint64_t hash = 14695981039346656037ULL;
+    auto add = [&hash](int64_t value)
     {
-        if((*iter)->Intersects(point))
+        for(int i = 0; i < 8; i++)
         {
-            mSelectedShape = *iter;
-            break;
+            hash ^= static_cast<uint64_t>(value >> (i * 8)) & 0xff;
+            hash *= 1099511628211ULL;
+        }
+    };
+    
+    std::vector<const Shape*> shapes;
+    GetDrawOrder(shapes);
+    add(static_cast<int64_t>(shapes.size()));
+    for(auto shape : shapes)
+    {
+        add(shape->GetKind());
+        wxPoint topLeft, botRight;
+        shape->GetBounds(topLeft, botRight);
+        add(topLeft.x);
+        add(topLeft.y);
+        add(botRight.x);
+        add(botRight.y);
+        if(shape->GetKind() == SK_Line)
+        {
+            // The bounds don't say which way the line goes
+            wxPoint start, end;
+            static_cast<const LineShape*>(shape)->GetEndpoints(start, end);
+            add(start.x);
+            add(start.y);
+            add(end.x);
+            add(end.y);
+        }
+        else if(shape->GetKind() == SK_Pencil)
+        {
+            add(shape->GetOffset().x);
+            add(shape->GetOffset().y);
+            PointStream::Reader reader(static_cast<const PencilShape*>(shape)->GetPoints());
+            wxPoint point;
+            while(reader.Next(point))
+            {
+                add(point.x);
+                add(point.y);
+            }
         }
+        const wxPen& pen = mStyles.GetPen(shape->GetStyle());
+        const wxBrush& brush = mStyles.GetBrush(shape->GetStyle());
+        add(pen.GetColour().GetRGBA());
+        add(pen.GetWidth());
+        add(pen.GetStyle());
+        add(brush.GetColour().GetRGBA());
+        add(brush.GetStyle());
     }
+    return hash;
 }
 
 void PaintModel::UnSelectShape()
 {
+    DamageShape(mSelectedShape);
     mSelectedShape.reset();
 }
+
+void PaintModel::ClearDamage()
+{
+    mDamage.Clear();
+    mFullDamage = false;
+    mPendingStroke.clear();
+    mStrokeOnlyDamage = true;
+}
+
+void PaintModel::DrawStrokeSegments(wxDC& dc)
+{
+    std::shared_ptr<Shape> active = GetActiveShape();
+    if(active != nullptr && mPendingStroke.size() > 1)
+    {
+        dc.SetPen(mStyles.GetPen(active->GetStyle()));
+        dc.DrawLines(static_cast<int>(mPendingStroke.size()), mPendingStroke.data());
+    }
+}
+
+void PaintModel::AddDamage(const wxRect& rect)
+{
+    if(!mFullDamage)
+    {
+        mDamage.Union(rect);
+    }
+    mStrokeOnlyDamage = false;
+}
+
+void PaintModel::UpdateShapeIndex(const std::shared_ptr<Shape>& shape)
+{
+    // Bounds change as shapes are drawn, moved, restyled or finalized.
+    // A stale grid picks up the new bounds when it's rebuilt.
+    if(shape != nullptr && !mShapeGridStale)
+    {
+        mShapeGrid.Update(shape.get());
+    }
+}
+
+ShapeGrid& PaintModel::GetShapeGrid()
+{
+    if(mShapeGridStale)
+    {
+        PROFILE_SCOPE("PaintModel::GetShapeGrid rebuild");
+        mShapeGrid.Clear();
+        mShapeGrid.Reserve(mShapes.GetCount());
+        for(auto& iter : mShapes.GetOrder())
+        {
+            mShapeGrid.Insert(iter.second.get(), iter.first);
+        }
+        mShapeGridStale = false;
+    }
+    return mShapeGrid;
+}
+
+void PaintModel::DamageShape(const std::shared_ptr<Shape>& shape)
+{
+    if(shape != nullptr)
+    {
+        AddDamage(shape->GetDamageRect());
+    }
+}
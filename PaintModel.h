@@ -1,67 +1,203 @@
 #pragma once
+#include <cstdint>
 #include <memory>
 #include <vector>
+#include <utility>
 #include "Shape.h"
 #include "Command.h"
+#include "CommandHistory.h"
+#include "HistoryCheckpoints.h"
+#include "ShapeGrid.h"
+#include "ShapeRegistry.h"
+#include "DrawList.h"
+#include "StyleTable.h"
+#include "PoolArena.h"
+#include "SoftwareRenderer.h"
+#include "TiledImage.h"
 #include <wx/bitmap.h>
-#include <stack>
+#include <wx/region.h>
+
+class DocumentJournal;
 
 class PaintModel : public std::enable_shared_from_this<PaintModel>
 {
 public:
+	// Milliseconds within which moving or restyling a shape again merges
+	// with the move or restyle before it
+	static const uint32_t MERGE_WINDOW = 1000;
+
 	PaintModel();
 	
 	// Draws any shapes in the model to the provided DC (draw context)
 	void DrawShapes(wxDC& dc, bool showSelection = true);
+    // Draws the bitmap and every shape with the software rasterizer,
+    // without the selection
+    void DrawShapes(SoftwareRenderer& renderer);
+    // Every shape in the order it's drawn in (committed shapes by z,
+    // then the active one)
+    void GetDrawOrder(std::vector<const Shape*>& shapes);
+    // Draws the imported bitmap and every finalized shape, skipping the
+    // shape owned by the active command. If clip is given, shapes that
+    // fall entirely outside of it are skipped.
+    void DrawCommittedShapes(wxDC& dc, const wxRect* clip = nullptr);
+    // Draws the shape owned by the active command and the selection
+    void DrawActiveShapes(wxDC& dc, bool showSelection = true, const wxRect* clip = nullptr);
+    // Bumped whenever the output of DrawCommittedShapes would change
+    unsigned int GetCommittedVersion() { return mCommittedVersion; }
+    
+    // Damaged area since the last ClearDamage, in panel coordinates
+    const wxRegion& GetDamage() { return mDamage; }
+    // True if the whole canvas has to be repainted
+    bool IsFullyDamaged() { return mFullDamage; }
+    
+    void ClearDamage();
+    
+    void AddDamage(const wxRect& rect);
+    // Damages the area covered by the shape in its current state
+    void DamageShape(const std::shared_ptr<Shape>& shape);
+    
+    void DamageAll() { mFullDamage = true; mStrokeOnlyDamage = false; }
+    
+    // True if the only damage since the last ClearDamage comes from
+    // segments appended to the active pencil stroke, in which case
+    // DrawStrokeSegments is enough to bring the last frame up to date
+    bool HasStrokeOnlyDamage() { return mStrokeOnlyDamage && !mFullDamage && !mPendingStroke.empty(); }
+    // Draws the segments appended to the active stroke since the last
+    // ClearDamage, with the stroke's pen
+    void DrawStrokeSegments(wxDC& dc);
 
 	// Clear the current paint model and start fresh
 	void New();
 
 	// Add a shape to the paint model
-	void AddShape(std::shared_ptr<Shape> shape);
+	void AddShape(const std::shared_ptr<Shape>& shape);
 	// Remove a shape from the paint model
-	void RemoveShape(std::shared_ptr<Shape> shape);
+	void RemoveShape(const std::shared_ptr<Shape>& shape);
     
     bool HasActiveCommand();
+    // Shape the active command draws or changes, if there is one
+    std::shared_ptr<Shape> GetActiveShape();
     
     void CreateCommand(CommandType commandType, const wxPoint& start);
     
     void UpdateCommand(wxPoint point);
     
+    // Adds the active command to the history. A move or restyle
+    // finalized within MERGE_WINDOW of the command before it is merged
+    // into that command instead, if it changes the same shape the same way.
     void FinalizeCommand();
+    // Time commands are finalized at, in milliseconds on any clock that
+    // only goes forward. It's up to the caller, so replays merge commands
+    // the same way.
+    void SetTime(uint32_t time) { mTime = time; }
     
-    bool CanUndo() { return !mUndo.empty(); }
+    uint32_t GetTime() { return mTime; }
+    // Commands finalized until the matching CommitTransaction are undone
+    // and redone as a single command. Transactions nest; only the
+    // outermost one makes a command. Damage piles up in the meantime, so
+    // the caller repaints once after committing.
+    void BeginTransaction();
     
-    bool CanRedo() { return !mRedo.empty(); }
+    void CommitTransaction();
+    
+    bool IsInTransaction() { return mTransaction != nullptr; }
+    // Undo and redo wait for the transaction to be committed
+    bool CanUndo() { return !IsInTransaction() && GetRevision() > 0; }
+    
+    bool CanRedo() { return !IsInTransaction() && GetRevision() < GetLastRevision(); }
     // Undo command
     void Undo();
     // Redo command
     void Redo();
+    // Number of commands done, which tells the states along the history
+    // apart
+    size_t GetRevision() { return mHistory.GetPosition(); }
+    // Revision redoing everything would get to
+    size_t GetLastRevision() { return mHistory.GetCount(); }
+    // Leaves the model at revision (at most the last one) as undoing or
+    // redoing one command at a time would. If a checkpoint is closer to
+    // revision than the current one, its shapes are put back the way they
+    // were and only the commands after it are redone; the ones in between
+    // aren't even read. Returns false if the history can't be read back
+    // far enough, leaving the model at the closest revision it got to, or
+    // if a command or transaction is in progress.
+    bool GoToRevision(size_t revision);
+    // While set, every finalized command, undo, redo and transaction is
+    // also appended to the journal
+    void SetJournal(DocumentJournal* journal) { mJournal = journal; }
+    
+    DocumentJournal* GetJournal() { return mJournal; }
+    // Memory the undo/redo history may hold before the commands furthest
+    // from the current state are spilled to disk
+    void SetHistoryBudget(size_t bytes);
+    
+    size_t GetHistoryBudget() { return mHistoryBudget; }
+    // Estimated memory held by the history that isn't spilled, including
+    // the shapes only the history holds and the checkpoints
+    size_t GetHistoryMemoryUsage() { return mHistory.GetMemoryUsage() + mShapes.GetRemovedMemoryUsage() + mCheckpoints.GetMemoryUsage(); }
+    
+    void SetPenWidth(int width);
+    
+    int GetPenWidth() { return GetPen().GetWidth(); }
+    
+    void SetPenColor(wxColour color);
     
-    void SetPenWidth(int width) { mPen.SetWidth(width); }
+    wxColour GetPenColor() { return GetPen().GetColour(); }
     
-    int GetPenWidth() { return mPen.GetWidth(); }
+    void SetBrushColor(wxColour color);
     
-    void SetPenColor(wxColour color) { mPen.SetColour(color); }
+    wxColour GetBrushColor() { return GetBrush().GetColour(); }
     
-    wxColour GetPenColor() { return mPen.GetColour(); }
+    const wxPen& GetPen() { return mStyles.GetPen(mStyle); }
     
-    void SetBrushColor(wxColour color) { mBrush.SetColour(color); }
+    const wxBrush& GetBrush() { return mStyles.GetBrush(mStyle); }
     
-    wxColour GetBrushColor() { return mBrush.GetColour(); }
+    // Current pen/brush as a handle into the style table
+    StyleId GetStyle() { return mStyle; }
     
-    wxPen GetPen() { return mPen; }
-    wxPen GetOldPen() { return mOldPen; }
+    void SetStyle(StyleId style) { mStyle = style; }
+    // Makes pen/brush the current style, adding it to the table if needed
+    void SetPenAndBrush(const wxPen& pen, const wxBrush& brush) { mStyle = mStyles.Intern(pen, brush); }
     
-    wxBrush GetBrush() { return mBrush; }
-    wxBrush GetOldBrush() { return mOldBrush; }
+    const StyleTable& GetStyles() { return mStyles; }
+    
+    // Pencil strokes are simplified to within this many pixels when
+    // finished; 0 keeps every sample
+    void SetSimplifyTolerance(double tolerance) { mSimplifyTolerance = tolerance; }
+    
+    double GetSimplifyTolerance() { return mSimplifyTolerance; }
+
+    // Hash of every shape's kind, geometry and style in draw order, to
+    // check that a replay built the same document; the imported image
+    // isn't included
+    uint64_t GetDocumentHash();
     
     void SelectShape(wxPoint point);
+    // Selects the shape with the given ID if it's currently in the model
+    void SelectShape(ShapeId id);
     
     void UnSelectShape();
     
     std::shared_ptr<Shape> GetSelectedShape() { return mSelectedShape; }
     
+    // Returns the shape with the given ID if it's currently in the model
+    std::shared_ptr<Shape> GetShape(ShapeId id) { return mShapes.Get(id); }
+    // For reading the history back from disk; see ShapeRegistry
+    std::shared_ptr<Shape> GetRemovedShape(ShapeId id) { return mShapes.GetRemoved(id); }
+    
+    bool RebindShape(ShapeId id, const std::shared_ptr<Shape>& shape) { return mShapes.Rebind(id, shape); }
+    
+    void ReleaseShape(ShapeId id) { mShapes.Release(id); }
+    
+    ShapeId GetNextShapeId() { return mShapes.GetNextId(); }
+    
+    // Creates a shape or command in the document's pool
+    template <class T, class... Args>
+    std::shared_ptr<T> Make(Args&&... args)
+    {
+        return std::allocate_shared<T>(ArenaAllocator<T>(&mArena), std::forward<Args>(args)...);
+    }
+    
     void SetPenCommand();
     
     void SetBrushCommand();
@@ -72,8 +208,23 @@ public:
     
     void LoadBitmap(wxString filename, wxBitmapType type);
     
-    void SetBitmap(wxBitmap bitmap) { mBitmap = bitmap;}
-    wxBitmap GetBitmap() { return mBitmap; }
+    // Saves the size, styles and shapes in the native document format
+    // (see DocumentFile); the undo history and imported image aren't kept
+    bool SaveDocument(const wxString& filename);
+    // Replaces the model with a document saved by SaveDocument. Returns
+    // false, leaving the model as it was, if the file can't be read.
+    bool LoadDocument(const wxString& filename);
+    // Adds the document and its history to snapshot, shape IDs and all,
+    // for writing out on another thread. Call with no command or
+    // transaction in progress.
+    void CaptureSession(SessionSnapshot& snapshot);
+    // Replaces the model with a session written by CaptureSession, its
+    // whole history spilled. Returns false, leaving the model empty, if
+    // the file can't be read or the snapshot isn't complete.
+    bool LoadSession(const wxString& filename);
+    
+    void SetImage(std::shared_ptr<TiledImage> image) { mImage = image; InvalidateCommitted(); DamageAll(); }
+    std::shared_ptr<TiledImage> GetImage() { return mImage; }
     
     wxSize GetSize() { return mSize; }
     void SetSize(wxSize size) { mSize = size; }
@@ -81,20 +232,48 @@ public:
     wxString GetFilename() { return mFilename; }
     void SetFilename(wxString filename) { mFilename = filename; }
 private:
-	// Vector of all the shapes in the model
-	std::vector<std::shared_ptr<Shape>> mShapes;
+    // Backs every shape and command made through Make. Declared first so
+    // it outlives everything below that may still hold pooled objects
+    PoolArena mArena;
+	// All the shapes in the model, by ID and in z-order
+	ShapeRegistry mShapes;
+    // Spatial index over mShapes for hit-testing and culling; read it
+    // through GetShapeGrid, which brings it up to date first
+    ShapeGrid mShapeGrid;
+    // Whether mShapeGrid needs rebuilding from mShapes before it's used.
+    // Loading a document leaves it stale, so opening doesn't pay for
+    // indexing every shape until something is hit-tested or culled.
+    bool mShapeGridStale;
+    // Batched snapshot of the committed shapes, rebuilt when they change
+    DrawList mCommittedList;
+    // Committed version mCommittedList was built from
+    unsigned int mCommittedListVersion;
     //Shared pointer to active commands
     std::shared_ptr<Command> mActiveCommand;
-    // Undo stack
-    std::stack<std::shared_ptr<Command>> mUndo;
-    // Redo stack
-    std::stack<std::shared_ptr<Command>> mRedo;
-    // Pen
-    wxPen mPen;
-    wxPen mOldPen;
-    // Brush
-    wxBrush mBrush;
-    wxBrush mOldBrush;
+    // Commands done and undone
+    CommandHistory mHistory;
+    // Bytes mHistory and the shapes only it holds may take up in memory
+    size_t mHistoryBudget;
+    // Shapes at points along the history, for GoToRevision
+    HistoryCheckpoints mCheckpoints;
+    // Commands of the open transaction, if any
+    std::shared_ptr<CompoundCommand> mTransaction;
+    // Transactions begun and not committed yet
+    unsigned int mTransactionDepth;
+    // Current time, as given to SetTime
+    uint32_t mTime;
+    // Time the last command done was finalized at
+    uint32_t mLastCommandTime;
+    // Whether the last command done may take merges, which
+    // it stops doing once anything but finalizing a command touches the
+    // history
+    bool mMergeable;
+    // Every pen/brush combination used in the document
+    StyleTable mStyles;
+    // Current pen/brush
+    StyleId mStyle;
+    // Simplification tolerance given to new pencil strokes
+    double mSimplifyTolerance;
     // Selected shape
     std::shared_ptr<Shape> mSelectedShape;
     // Actual selection drawing
@@ -103,6 +282,46 @@ private:
     wxSize mSize;
     // Name of file
     wxString mFilename;
-    // Bitmap of the model
-    wxBitmap mBitmap;
+    // Imported image the shapes are drawn over, if any
+    std::shared_ptr<TiledImage> mImage;
+    // Version of the committed (non-active) contents
+    unsigned int mCommittedVersion;
+    // Area that needs to be repainted
+    wxRegion mDamage;
+    // Whether everything needs to be repainted
+    bool mFullDamage;
+    // Whether the active command is drawing a pencil stroke
+    bool mStrokeActive;
+    // Stroke points added since the last ClearDamage, starting with the
+    // last point that was already drawn
+    std::vector<wxPoint> mPendingStroke;
+    // Whether mPendingStroke accounts for all of mDamage
+    bool mStrokeOnlyDamage;
+    // Journal edits are appended to, if any
+    DocumentJournal* mJournal;
+    
+    void InvalidateCommitted() { mCommittedVersion++; }
+    
+    void UpdateShapeIndex(const std::shared_ptr<Shape>& shape);
+    // Spills history until it fits in the budget
+    void TrimHistory();
+    // Merges command into the last one done if it's due to; see
+    // FinalizeCommand
+    bool MergeCommand(Command& command);
+    // Undo and Redo without journaling or trimming the history; return
+    // false if the command can't be read back
+    bool UndoCommand();
+    
+    bool RedoCommand();
+    // Undoes or redoes command, damaging and indexing each shape it changes
+    void ApplyCommand(const std::shared_ptr<Command>& command, bool undo);
+    // Takes a checkpoint of the current revision if one is due and the
+    // model is at that revision, between commands and transactions
+    void UpdateCheckpoints();
+    // Puts the shapes in the checkpoint back in the model the way they
+    // were and takes out the rest, only touching the ones that differ.
+    // Returns false, changing nothing, if a shape can't be made again.
+    bool RestoreCheckpoint(const HistoryCheckpoints::Checkpoint& checkpoint);
+    
+    ShapeGrid& GetShapeGrid();
 };
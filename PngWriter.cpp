@@ -0,0 +1,275 @@
+#include "PngWriter.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <cstdlib>
+#include <thread>
+#include <wx/file.h>
+#include <wx/filefn.h>
+#include <zlib.h>
+
+namespace
+{
+	// Aim for bands of about this much filtered data; smaller bands
+	// spread better over the threads but compress slightly worse
+	const size_t BAND_SIZE = 256 * 1024;
+	// Bytes per pixel in the written file (8-bit RGB)
+	const int PIXEL_SIZE = 3;
+	
+	void PutUInt32(std::vector<unsigned char>& out, unsigned long value)
+	{
+		out.push_back(static_cast<unsigned char>((value >> 24) & 0xff));
+		out.push_back(static_cast<unsigned char>((value >> 16) & 0xff));
+		out.push_back(static_cast<unsigned char>((value >> 8) & 0xff));
+		out.push_back(static_cast<unsigned char>(value & 0xff));
+	}
+	
+	bool WriteChunk(wxFile& file, const char* type, const unsigned char* data, size_t size)
+	{
+		std::vector<unsigned char> header;
+		PutUInt32(header, static_cast<unsigned long>(size));
+		header.insert(header.end(), type, type + 4);
+		unsigned long crc = crc32(0L, header.data() + 4, 4);
+		if (size > 0)
+		{
+			crc = crc32(crc, data, static_cast<uInt>(size));
+		}
+		std::vector<unsigned char> footer;
+		PutUInt32(footer, crc);
+		return file.Write(header.data(), header.size()) == header.size() &&
+			(size == 0 || file.Write(data, size) == size) &&
+			file.Write(footer.data(), footer.size()) == footer.size();
+	}
+	
+	inline unsigned char Paeth(int left, int up, int upLeft)
+	{
+		int estimate = left + up - upLeft;
+		int distLeft = std::abs(estimate - left);
+		int distUp = std::abs(estimate - up);
+		int distUpLeft = std::abs(estimate - upLeft);
+		if (distLeft <= distUp && distLeft <= distUpLeft)
+		{
+			return static_cast<unsigned char>(left);
+		}
+		return static_cast<unsigned char>(distUp <= distUpLeft ? up : upLeft);
+	}
+	
+	// Filters one row of RGB bytes with whichever of the five PNG filters
+	// gives the smallest sum of absolute (signed) differences, the usual
+	// heuristic for what will deflate best. out gets the filter type
+	// byte followed by the filtered row.
+	void FilterRow(const unsigned char* row, const unsigned char* previous, size_t size,
+		std::vector<unsigned char>* candidates, unsigned char* out)
+	{
+		unsigned long bestSum = 0;
+		int best = -1;
+		for (int filter = 0; filter < 5; filter++)
+		{
+			std::vector<unsigned char>& dest = candidates[filter];
+			unsigned long sum = 0;
+			for (size_t i = 0; i < size; i++)
+			{
+				int left = i >= PIXEL_SIZE ? row[i - PIXEL_SIZE] : 0;
+				int up = previous ? previous[i] : 0;
+				int upLeft = (previous && i >= PIXEL_SIZE) ? previous[i - PIXEL_SIZE] : 0;
+				int predicted = 0;
+				switch (filter)
+				{
+					case 1: predicted = left; break;
+					case 2: predicted = up; break;
+					case 3: predicted = (left + up) / 2; break;
+					case 4: predicted = Paeth(left, up, upLeft); break;
+					default: break;
+				}
+				unsigned char value = static_cast<unsigned char>(row[i] - predicted);
+				dest[i] = value;
+				sum += value < 128 ? value : 256 - value;
+			}
+			if (best < 0 || sum < bestSum)
+			{
+				best = filter;
+				bestSum = sum;
+			}
+		}
+		out[0] = static_cast<unsigned char>(best);
+		std::copy(candidates[best].begin(), candidates[best].begin() + size, out + 1);
+	}
+	
+	// One image row as packed RGB
+	void GetRgbRow(const RasterImage& image, int y, unsigned char* out)
+	{
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(image.GetRow(y));
+		for (int x = 0; x < image.GetWidth(); x++, src += 4, out += PIXEL_SIZE)
+		{
+			out[0] = src[0];
+			out[1] = src[1];
+			out[2] = src[2];
+		}
+	}
+}
+
+PngWriter::PngWriter(int level, unsigned int threadCount)
+: mLevel(level)
+, mThreadCount(threadCount)
+{
+	if (mThreadCount == 0)
+	{
+		mThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+}
+
+void PngWriter::CompressBand(const RasterImage& image, Band& band, bool last) const
+{
+	size_t rowSize = static_cast<size_t>(image.GetWidth()) * PIXEL_SIZE;
+	std::vector<unsigned char> filtered((rowSize + 1) * band.mRowCount);
+	std::vector<unsigned char> row(rowSize);
+	std::vector<unsigned char> previous(rowSize);
+	std::vector<unsigned char> candidates[5];
+	for (auto& candidate : candidates)
+	{
+		candidate.resize(rowSize);
+	}
+	// Filters look at the row above, which may belong to the band before
+	if (band.mFirstRow > 0)
+	{
+		GetRgbRow(image, band.mFirstRow - 1, previous.data());
+	}
+	for (int i = 0; i < band.mRowCount; i++)
+	{
+		int y = band.mFirstRow + i;
+		GetRgbRow(image, y, row.data());
+		FilterRow(row.data(), y > 0 ? previous.data() : nullptr, rowSize, candidates,
+			&filtered[i * (rowSize + 1)]);
+		row.swap(previous);
+	}
+	band.mSize = filtered.size();
+	band.mAdler = adler32(adler32(0L, Z_NULL, 0), filtered.data(), static_cast<uInt>(filtered.size()));
+	
+	// Raw deflate (negative window bits): the zlib header and checksum
+	// are written once for the whole image
+	z_stream stream = z_stream();
+	band.mOk = false;
+	if (deflateInit2(&stream, mLevel, Z_DEFLATED, -15, 8, Z_DEFAULT_STRATEGY) != Z_OK)
+	{
+		return;
+	}
+	band.mData.resize(deflateBound(&stream, static_cast<uLong>(filtered.size())) + 64);
+	stream.next_in = filtered.data();
+	stream.avail_in = static_cast<uInt>(filtered.size());
+	int flush = last ? Z_FINISH : Z_FULL_FLUSH;
+	int result;
+	do
+	{
+		if (stream.total_out == band.mData.size())
+		{
+			band.mData.resize(band.mData.size() * 2);
+		}
+		stream.next_out = band.mData.data() + stream.total_out;
+		stream.avail_out = static_cast<uInt>(band.mData.size() - stream.total_out);
+		result = deflate(&stream, flush);
+	} while ((result == Z_OK || result == Z_BUF_ERROR) && stream.avail_out == 0);
+	band.mOk = last ? result == Z_STREAM_END : result == Z_OK;
+	band.mData.resize(stream.total_out);
+	deflateEnd(&stream);
+}
+
+bool PngWriter::Write(const RasterImage& image, const wxString& filename,
+	const std::atomic<bool>* cancel, ProgressFunc progress)
+{
+	PROFILE_SCOPE("PngWriter::Write");
+	if (!image.IsOk())
+	{
+		return false;
+	}
+	
+	size_t rowSize = static_cast<size_t>(image.GetWidth()) * PIXEL_SIZE + 1;
+	int rowsPerBand = static_cast<int>(std::max<size_t>(BAND_SIZE / rowSize, 1));
+	std::vector<Band> bands;
+	for (int y = 0; y < image.GetHeight(); y += rowsPerBand)
+	{
+		Band band;
+		band.mFirstRow = y;
+		band.mRowCount = std::min(rowsPerBand, image.GetHeight() - y);
+		band.mAdler = 1;
+		band.mSize = 0;
+		band.mOk = false;
+		bands.push_back(band);
+	}
+	
+	std::atomic<size_t> nextBand(0);
+	std::atomic<size_t> doneBands(0);
+	auto worker = [&]()
+	{
+		for (size_t i = nextBand++; i < bands.size(); i = nextBand++)
+		{
+			if (cancel != nullptr && *cancel)
+			{
+				return;
+			}
+			CompressBand(image, bands[i], i + 1 == bands.size());
+			size_t done = ++doneBands;
+			if (progress)
+			{
+				progress(done, bands.size());
+			}
+		}
+	};
+	unsigned int threadCount = static_cast<unsigned int>(std::min<size_t>(mThreadCount, bands.size()));
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		threads.push_back(std::thread(worker));
+	}
+	worker();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	if (doneBands != bands.size())
+	{
+		return false;
+	}
+	
+	wxFile file;
+	if (!file.Create(filename, true))
+	{
+		return false;
+	}
+	static const unsigned char SIGNATURE[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n' };
+	std::vector<unsigned char> header;
+	PutUInt32(header, static_cast<unsigned long>(image.GetWidth()));
+	PutUInt32(header, static_cast<unsigned long>(image.GetHeight()));
+	// 8 bits per channel, RGB, deflate, adaptive filtering, no interlace
+	const unsigned char format[5] = { 8, 2, 0, 0, 0 };
+	header.insert(header.end(), format, format + 5);
+	bool ok = file.Write(SIGNATURE, sizeof(SIGNATURE)) == sizeof(SIGNATURE) &&
+		WriteChunk(file, "IHDR", header.data(), header.size());
+	
+	// One IDAT per band; the first carries the zlib header, the last the
+	// Adler-32 of everything, combined from the per-band checksums
+	unsigned long adler = adler32(0L, Z_NULL, 0);
+	for (size_t i = 0; i < bands.size() && ok; i++)
+	{
+		Band& band = bands[i];
+		ok = band.mOk;
+		adler = adler32_combine(adler, band.mAdler, static_cast<z_off_t>(band.mSize));
+		if (i == 0)
+		{
+			const unsigned char zlibHeader[2] = { 0x78, 0x9c };
+			band.mData.insert(band.mData.begin(), zlibHeader, zlibHeader + 2);
+		}
+		if (i + 1 == bands.size())
+		{
+			PutUInt32(band.mData, adler);
+		}
+		ok = ok && WriteChunk(file, "IDAT", band.mData.data(), band.mData.size());
+		std::vector<unsigned char>().swap(band.mData);
+	}
+	ok = ok && WriteChunk(file, "IEND", nullptr, 0);
+	ok = file.Close() && ok;
+	if (!ok || (cancel != nullptr && *cancel))
+	{
+		wxRemoveFile(filename);
+		return false;
+	}
+	return true;
+}
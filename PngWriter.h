@@ -0,0 +1,43 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <wx/string.h>
+#include "RasterImage.h"
+
+// Writes opaque RGB PNG files. Rows are filtered and deflated in bands
+// on several threads; every band but the last ends on a full flush, so
+// the compressed bands can be concatenated into a single zlib stream
+// that any PNG decoder reads as usual.
+class PngWriter
+{
+public:
+	// Called with the number of compressed bands and the total, from
+	// whichever thread finished the band
+	typedef std::function<void(size_t, size_t)> ProgressFunc;
+	
+	// level is the zlib compression level; threadCount 0 uses one
+	// thread per hardware core
+	PngWriter(int level = 6, unsigned int threadCount = 0);
+	// Returns false if the file couldn't be written or cancel became
+	// true; no partial file is left behind either way
+	bool Write(const RasterImage& image, const wxString& filename,
+		const std::atomic<bool>* cancel = nullptr, ProgressFunc progress = ProgressFunc());
+private:
+	struct Band
+	{
+		int mFirstRow;
+		int mRowCount;
+		// Raw deflate data for the band's filtered rows
+		std::vector<unsigned char> mData;
+		// Adler-32 and size of the filtered rows, before compression
+		unsigned long mAdler;
+		size_t mSize;
+		bool mOk;
+	};
+	
+	void CompressBand(const RasterImage& image, Band& band, bool last) const;
+	
+	int mLevel;
+	unsigned int mThreadCount;
+};
@@ -0,0 +1,202 @@
+#include "PointStream.h"
+#include <algorithm>
+#include <cstdint>
+
+namespace
+{
+	const size_t MIN_CHUNK_SIZE = 64;
+	const size_t MAX_CHUNK_SIZE = 4096;
+	// Two deltas of at most five bytes each
+	const size_t MAX_POINT_SIZE = 10;
+	
+	// Map signed deltas onto unsigned ones so small negative values
+	// stay small: 0, -1, 1, -2, 2... become 0, 1, 2, 3, 4...
+	uint32_t ZigZag(int value)
+	{
+		return (static_cast<uint32_t>(value) << 1) ^ static_cast<uint32_t>(value >> 31);
+	}
+	
+	int UnZigZag(uint32_t value)
+	{
+		return static_cast<int>((value >> 1) ^ (~(value & 1) + 1));
+	}
+	
+	int Decode(const unsigned char* data, size_t& pos)
+	{
+		uint32_t value = 0;
+		int shift = 0;
+		unsigned char byte;
+		do
+		{
+			byte = data[pos++];
+			value |= static_cast<uint32_t>(byte & 0x7f) << shift;
+			shift += 7;
+		} while (byte & 0x80);
+		return UnZigZag(value);
+	}
+}
+
+PointStream::PointStream()
+: mCount(0)
+{
+	
+}
+
+void PointStream::Append(const wxPoint& point)
+{
+	if (mCount == 0)
+	{
+		mFirst = point;
+	}
+	else
+	{
+		Chunk* chunk = mChunks.empty() ? nullptr : &mChunks.back();
+		if (chunk == nullptr || chunk->capacity() - chunk->size() < MAX_POINT_SIZE)
+		{
+			size_t size = MIN_CHUNK_SIZE;
+			if (chunk != nullptr)
+			{
+				size = std::min(chunk->capacity() * 2, MAX_CHUNK_SIZE);
+			}
+			mChunks.push_back(Chunk());
+			mChunks.back().reserve(size);
+		}
+		Encode(point.x - mLast.x);
+		Encode(point.y - mLast.y);
+	}
+	mLast = point;
+	mCount++;
+}
+
+void PointStream::Encode(int value)
+{
+	Chunk& chunk = mChunks.back();
+	uint32_t bits = ZigZag(value);
+	while (bits >= 0x80)
+	{
+		chunk.push_back(static_cast<unsigned char>(bits | 0x80));
+		bits >>= 7;
+	}
+	chunk.push_back(static_cast<unsigned char>(bits));
+}
+
+void PointStream::ShrinkToFit()
+{
+	if (!mChunks.empty())
+	{
+		mChunks.back().shrink_to_fit();
+	}
+	mChunks.shrink_to_fit();
+}
+
+size_t PointStream::GetCapacity() const
+{
+	size_t bytes = mChunks.capacity() * sizeof(Chunk);
+	for (auto& chunk : mChunks)
+	{
+		bytes += chunk.capacity();
+	}
+	return bytes;
+}
+
+void PointStream::Clear()
+{
+	mChunks.clear();
+	mCount = 0;
+}
+
+void PointStream::GetDeltas(std::vector<unsigned char>& out) const
+{
+	for (auto& chunk : mChunks)
+	{
+		out.insert(out.end(), chunk.begin(), chunk.end());
+	}
+}
+
+void PointStream::Assign(const wxPoint& first, const wxPoint& last, const unsigned char* deltas, size_t size, size_t count)
+{
+	mChunks.clear();
+	if (size > 0)
+	{
+		// One exact fit chunk; Append starts a new one if it's ever needed
+		mChunks.push_back(Chunk(deltas, deltas + size));
+	}
+	mFirst = first;
+	mLast = last;
+	mCount = count;
+}
+
+bool PointStream::CheckDeltas(const unsigned char* deltas, size_t size, size_t count)
+{
+	if (count == 0)
+	{
+		return size == 0;
+	}
+	// Every point after the first ends two values, and a value never
+	// takes more than five bytes
+	size_t values = 0;
+	size_t length = 0;
+	for (size_t i = 0; i < size; i++)
+	{
+		if (deltas[i] & 0x80)
+		{
+			if (++length == 5)
+			{
+				return false;
+			}
+		}
+		else
+		{
+			values++;
+			length = 0;
+		}
+	}
+	return length == 0 && values == 2 * (count - 1);
+}
+
+PointStream::Reader::Reader(const PointStream& stream)
+: mStream(stream)
+, mChunk(0)
+, mPos(0)
+, mRemaining(stream.mCount)
+{
+	
+}
+
+bool PointStream::Reader::Next(wxPoint& point)
+{
+	if (mRemaining == 0)
+	{
+		return false;
+	}
+	
+	if (mRemaining == mStream.mCount)
+	{
+		mPoint = mStream.mFirst;
+	}
+	else
+	{
+		// Points never straddle two chunks
+		if (mPos == mStream.mChunks[mChunk].size())
+		{
+			mChunk++;
+			mPos = 0;
+		}
+		const unsigned char* data = mStream.mChunks[mChunk].data();
+		mPoint.x += Decode(data, mPos);
+		mPoint.y += Decode(data, mPos);
+	}
+	mRemaining--;
+	point = mPoint;
+	return true;
+}
+
+size_t PointStream::Reader::Read(wxPoint* points, size_t maxCount)
+{
+	size_t count = 0;
+	while (count < maxCount && Next(points[count]))
+	{
+		count++;
+	}
+	return count;
+}
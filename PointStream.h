@@ -0,0 +1,65 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+#include <wx/gdicmn.h>
+
+// Append-only list of points stored as the first point followed by
+// variable-length deltas, so a typical freehand sample takes two bytes
+// instead of sizeof(wxPoint). Bytes live in a list of chunks that
+// double in size up to a limit; growing never moves the older chunks.
+class PointStream
+{
+public:
+	PointStream();
+	
+	void Append(const wxPoint& point);
+	
+	size_t GetCount() const { return mCount; }
+	
+	bool IsEmpty() const { return mCount == 0; }
+	
+	const wxPoint& GetFirst() const { return mFirst; }
+	
+	const wxPoint& GetLast() const { return mLast; }
+	// Gives back the unused tail of the last chunk
+	void ShrinkToFit();
+	// Bytes currently reserved for the encoded points
+	size_t GetCapacity() const;
+	
+	void Clear();
+	// Appends the encoded deltas, everything after the first point, to out
+	void GetDeltas(std::vector<unsigned char>& out) const;
+	// Replaces the points with count points going from first to last,
+	// whose deltas were taken from GetDeltas; the bytes are copied as they
+	// are, without decoding them
+	void Assign(const wxPoint& first, const wxPoint& last, const unsigned char* deltas, size_t size, size_t count);
+	// True if size bytes of deltas encode exactly count points, so they
+	// can be given to Assign without reading past the end
+	static bool CheckDeltas(const unsigned char* deltas, size_t size, size_t count);
+	
+	// Decodes the points in order
+	class Reader
+	{
+	public:
+		Reader(const PointStream& stream);
+		
+		bool Next(wxPoint& point);
+		// Decodes up to maxCount points; returns how many were written
+		size_t Read(wxPoint* points, size_t maxCount);
+	private:
+		const PointStream& mStream;
+		size_t mChunk;
+		size_t mPos;
+		size_t mRemaining;
+		wxPoint mPoint;
+	};
+private:
+	typedef std::vector<unsigned char> Chunk;
+	
+	void Encode(int value);
+	
+	std::vector<Chunk> mChunks;
+	size_t mCount;
+	wxPoint mFirst;
+	wxPoint mLast;
+};
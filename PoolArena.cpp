@@ -0,0 +1,99 @@
+#include "PoolArena.h"
+#include <new>
+
+// Every size is rounded up to this, which also keeps allocations aligned
+static const size_t GRANULARITY = 16;
+// Bigger allocations skip the pool
+static const size_t MAX_POOLED_SIZE = 512;
+
+PoolArena::PoolArena(size_t blockSize)
+: mBlockSize(blockSize)
+, mFreeLists(MAX_POOLED_SIZE / GRANULARITY + 1, nullptr)
+, mCursor(nullptr)
+, mEnd(nullptr)
+, mLiveCount(0)
+{
+	
+}
+
+PoolArena::~PoolArena()
+{
+	for (auto block : mBlocks)
+	{
+		::operator delete(block);
+	}
+}
+
+void* PoolArena::Allocate(size_t size)
+{
+	mLiveCount++;
+	if (size > MAX_POOLED_SIZE)
+	{
+		return ::operator new(size);
+	}
+	
+	size_t sizeClass = GetSizeClass(size);
+	FreeNode* node = mFreeLists[sizeClass];
+	if (node != nullptr)
+	{
+		mFreeLists[sizeClass] = node->mNext;
+		return node;
+	}
+	
+	size_t bytes = sizeClass * GRANULARITY;
+	if (mCursor == nullptr || static_cast<size_t>(mEnd - mCursor) < bytes)
+	{
+		// The tail of the previous block is abandoned until Release
+		mCursor = static_cast<char*>(::operator new(mBlockSize));
+		mEnd = mCursor + mBlockSize;
+		mBlocks.push_back(mCursor);
+	}
+	void* ptr = mCursor;
+	mCursor += bytes;
+	return ptr;
+}
+
+void PoolArena::Deallocate(void* ptr, size_t size)
+{
+	mLiveCount--;
+	if (size > MAX_POOLED_SIZE)
+	{
+		::operator delete(ptr);
+		return;
+	}
+	
+	size_t sizeClass = GetSizeClass(size);
+	FreeNode* node = static_cast<FreeNode*>(ptr);
+	node->mNext = mFreeLists[sizeClass];
+	mFreeLists[sizeClass] = node;
+}
+
+bool PoolArena::Release()
+{
+	if (mLiveCount != 0)
+	{
+		return false;
+	}
+	
+	for (auto block : mBlocks)
+	{
+		::operator delete(block);
+	}
+	mBlocks.clear();
+	for (auto& list : mFreeLists)
+	{
+		list = nullptr;
+	}
+	mCursor = nullptr;
+	mEnd = nullptr;
+	return true;
+}
+
+size_t PoolArena::GetSizeClass(size_t size)
+{
+	if (size == 0)
+	{
+		size = 1;
+	}
+	return (size + GRANULARITY - 1) / GRANULARITY;
+}
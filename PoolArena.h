@@ -0,0 +1,85 @@
+#pragma once
+#include <cstddef>
+#include <vector>
+
+// Per-document memory pool for shapes, commands and their shared_ptr
+// control blocks. Small allocations are carved out of large blocks and
+// recycled through per-size free lists; Release hands every block back
+// at once. Not thread-safe: only allocate and free on the UI thread.
+class PoolArena
+{
+public:
+	PoolArena(size_t blockSize = 64 * 1024);
+	~PoolArena();
+	
+	void* Allocate(size_t size);
+	
+	void Deallocate(void* ptr, size_t size);
+	// Frees every block in one go. Only does anything once all the
+	// allocations have been given back; returns whether it did.
+	bool Release();
+	// Number of allocations not yet given back
+	size_t GetLiveCount() const { return mLiveCount; }
+	
+	size_t GetReservedBytes() const { return mBlocks.size() * mBlockSize; }
+	
+	// Disallow copy/assignment
+	PoolArena(const PoolArena&) = delete;
+	PoolArena& operator=(const PoolArena&) = delete;
+private:
+	struct FreeNode
+	{
+		FreeNode* mNext;
+	};
+	
+	static size_t GetSizeClass(size_t size);
+	
+	size_t mBlockSize;
+	// Free list per size class
+	std::vector<FreeNode*> mFreeLists;
+	// Every block handed out by operator new
+	std::vector<char*> mBlocks;
+	// Unused tail of the newest block
+	char* mCursor;
+	char* mEnd;
+	size_t mLiveCount;
+};
+
+// Standard allocator drawing from a PoolArena, for std::allocate_shared
+template <class T>
+class ArenaAllocator
+{
+public:
+	typedef T value_type;
+	
+	ArenaAllocator(PoolArena* arena) : mArena(arena) { }
+	
+	template <class U>
+	ArenaAllocator(const ArenaAllocator<U>& other) : mArena(other.GetArena()) { }
+	
+	T* allocate(size_t count)
+	{
+		return static_cast<T*>(mArena->Allocate(count * sizeof(T)));
+	}
+	
+	void deallocate(T* ptr, size_t count)
+	{
+		mArena->Deallocate(ptr, count * sizeof(T));
+	}
+	
+	PoolArena* GetArena() const { return mArena; }
+private:
+	PoolArena* mArena;
+};
+
+template <class T, class U>
+bool operator==(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+	return a.GetArena() == b.GetArena();
+}
+
+template <class T, class U>
+bool operator!=(const ArenaAllocator<T>& a, const ArenaAllocator<U>& b)
+{
+	return a.GetArena() != b.GetArena();
+}
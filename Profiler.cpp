@@ -0,0 +1,210 @@
+#include "Profiler.h"
+#include <wx/ffile.h>
+#include <algorithm>
+#include <cstring>
+#include <map>
+
+// Needed for odr-uses such as std::min
+const size_t Profiler::MAX_SECTIONS;
+const size_t Profiler::BUCKET_COUNT;
+const size_t Profiler::MAX_TRACE_EVENTS;
+
+Profiler& Profiler::Get()
+{
+	static Profiler profiler;
+	return profiler;
+}
+
+Profiler::Profiler()
+: mSectionCount(0)
+, mEnabled(false)
+, mTracing(false)
+{
+	for (Section& section : mSections)
+	{
+		section.mName = nullptr;
+	}
+	Reset();
+}
+
+size_t Profiler::Register(const char* name)
+{
+	std::lock_guard<std::mutex> lock(mRegisterMutex);
+	size_t count = mSectionCount;
+	for (size_t i = 0; i < count; i++)
+	{
+		// The same scope can be compiled into several places (inline
+		// functions, templates), which should all add up together
+		if (std::strcmp(mSections[i].mName, name) == 0)
+		{
+			return i;
+		}
+	}
+	if (count == MAX_SECTIONS)
+	{
+		// Out of room; lump the rest in with the last section
+		return MAX_SECTIONS - 1;
+	}
+	mSections[count].mName = name;
+	mSectionCount = count + 1;
+	return count;
+}
+
+void Profiler::Add(size_t section, Clock::time_point start, Clock::time_point end)
+{
+	uint64_t duration = static_cast<uint64_t>(
+		std::chrono::duration_cast<std::chrono::nanoseconds>(end - start).count());
+	Section& target = mSections[section];
+	target.mCount.fetch_add(1, std::memory_order_relaxed);
+	target.mTotal.fetch_add(duration, std::memory_order_relaxed);
+	target.mBuckets[GetBucket(duration)].fetch_add(1, std::memory_order_relaxed);
+	uint64_t max = target.mMax.load(std::memory_order_relaxed);
+	while (duration > max && !target.mMax.compare_exchange_weak(max, duration, std::memory_order_relaxed))
+	{
+	}
+
+	if (IsTracing())
+	{
+		std::lock_guard<std::mutex> lock(mTraceMutex);
+		if (mTracing && mTrace.size() < MAX_TRACE_EVENTS)
+		{
+			TraceEvent event;
+			event.mSection = section;
+			event.mThread = std::this_thread::get_id();
+			event.mStart = std::chrono::duration_cast<std::chrono::nanoseconds>(start - mTraceStart).count();
+			event.mDuration = static_cast<int64_t>(duration);
+			mTrace.push_back(event);
+		}
+	}
+}
+
+void Profiler::Reset()
+{
+	for (Section& section : mSections)
+	{
+		section.mCount = 0;
+		section.mTotal = 0;
+		section.mMax = 0;
+		for (auto& bucket : section.mBuckets)
+		{
+			bucket = 0;
+		}
+	}
+}
+
+wxString Profiler::GetSummary(size_t maxSections) const
+{
+	std::vector<const Section*> sections;
+	size_t count = mSectionCount;
+	for (size_t i = 0; i < count; i++)
+	{
+		if (mSections[i].mCount > 0)
+		{
+			sections.push_back(&mSections[i]);
+		}
+	}
+	std::sort(sections.begin(), sections.end(), [](const Section* a, const Section* b)
+	{
+		return a->mTotal > b->mTotal;
+	});
+
+	wxString summary;
+	for (size_t i = 0; i < sections.size() && i < maxSections; i++)
+	{
+		if (i > 0)
+		{
+			summary << "  ";
+		}
+		summary << wxString::Format("%s %.2f/%.2f ms", sections[i]->mName,
+			GetPercentile(*sections[i], 0.5) / 1e6, GetPercentile(*sections[i], 0.95) / 1e6);
+	}
+	return summary;
+}
+
+void Profiler::StartTrace()
+{
+	std::lock_guard<std::mutex> lock(mTraceMutex);
+	mTrace.clear();
+	mTraceStart = Clock::now();
+	mTracing = true;
+	mEnabled = true;
+}
+
+bool Profiler::StopTrace(const wxString& filename)
+{
+	std::vector<TraceEvent> trace;
+	{
+		std::lock_guard<std::mutex> lock(mTraceMutex);
+		mTracing = false;
+		trace.swap(mTrace);
+	}
+	if (filename.empty())
+	{
+		return true;
+	}
+
+	wxFFile file(filename, "w");
+	if (!file.IsOpened())
+	{
+		return false;
+	}
+	// Chrome wants small integer thread IDs; number them as they appear
+	std::map<std::thread::id, int> threads;
+	bool ok = file.Write(wxString("{\"displayTimeUnit\": \"ms\", \"traceEvents\": [\n"));
+	for (size_t i = 0; i < trace.size() && ok; i++)
+	{
+		const TraceEvent& event = trace[i];
+		auto thread = threads.insert(std::make_pair(event.mThread, static_cast<int>(threads.size()) + 1)).first;
+		ok = file.Write(wxString::Format(
+			"{\"name\": \"%s\", \"cat\": \"paint\", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, "
+			"\"ts\": %.3f, \"dur\": %.3f}%s\n",
+			mSections[event.mSection].mName, thread->second, event.mStart / 1e3, event.mDuration / 1e3,
+			i + 1 < trace.size() ? "," : ""));
+	}
+	ok = ok && file.Write(wxString("]}\n"));
+	ok = file.Close() && ok;
+	return ok;
+}
+
+size_t Profiler::GetBucket(uint64_t nanoseconds)
+{
+	if (nanoseconds < 4)
+	{
+		return static_cast<size_t>(nanoseconds);
+	}
+	size_t top = 0;
+	for (uint64_t value = nanoseconds; value > 1; value >>= 1)
+	{
+		top++;
+	}
+	// Split each power of two by the two bits below the highest one
+	size_t bucket = 4 * (top - 1) + static_cast<size_t>((nanoseconds >> (top - 2)) & 3);
+	return std::min(bucket, BUCKET_COUNT - 1);
+}
+
+uint64_t Profiler::GetBucketLimit(size_t bucket)
+{
+	if (bucket < 4)
+	{
+		return bucket;
+	}
+	size_t top = bucket / 4 + 1;
+	uint64_t sub = bucket % 4;
+	return ((5 + sub) << (top - 2)) - 1;
+}
+
+uint64_t Profiler::GetPercentile(const Section& section, double fraction) const
+{
+	uint64_t count = section.mCount;
+	uint64_t rank = static_cast<uint64_t>(fraction * count);
+	uint64_t seen = 0;
+	for (size_t i = 0; i < BUCKET_COUNT; i++)
+	{
+		seen += section.mBuckets[i];
+		if (seen > rank)
+		{
+			return std::min(GetBucketLimit(i), section.mMax.load());
+		}
+	}
+	return section.mMax;
+}
@@ -0,0 +1,132 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <thread>
+#include <vector>
+#include <wx/string.h>
+
+// Collects how long named sections of code take, from any thread, into
+// per-section histograms, and optionally records every call for a Chrome
+// trace (chrome://tracing or ui.perfetto.dev). Sections are marked with
+// PROFILE_SCOPE, which compiles to nothing unless PAINT_PROFILING is
+// defined (Debug builds define it). When compiled in but not enabled, a
+// scope costs one relaxed atomic load.
+class Profiler
+{
+public:
+	typedef std::chrono::steady_clock Clock;
+
+	static Profiler& Get();
+	// Returns the index of the section called name, adding it the first
+	// time; name must outlive the profiler, so pass a string literal
+	size_t Register(const char* name);
+
+	bool IsEnabled() const { return mEnabled.load(std::memory_order_relaxed); }
+
+	void SetEnabled(bool enabled) { mEnabled = enabled; }
+	// Records one call of section
+	void Add(size_t section, Clock::time_point start, Clock::time_point end);
+	// Forgets every call recorded so far, keeping the sections
+	void Reset();
+	// p50/p95 of the sections that took the most time in total, busiest
+	// first, for the status bar
+	wxString GetSummary(size_t maxSections) const;
+	// Starts keeping every call, which also enables the profiler
+	void StartTrace();
+
+	bool IsTracing() const { return mTracing.load(std::memory_order_relaxed); }
+	// Stops tracing and writes the calls kept since StartTrace to filename
+	// in the Chrome trace event format, or just drops them if filename is
+	// empty. Profiling stays enabled.
+	bool StopTrace(const wxString& filename);
+
+	// Disallow copy/assignment
+	Profiler(const Profiler&) = delete;
+	Profiler& operator=(const Profiler&) = delete;
+private:
+	Profiler();
+
+	static const size_t MAX_SECTIONS = 64;
+	// Four buckets per power of two nanoseconds, up to about half an hour
+	static const size_t BUCKET_COUNT = 160;
+	// A trace stops growing after this many calls (about 32 MB)
+	static const size_t MAX_TRACE_EVENTS = 1 << 20;
+
+	struct Section
+	{
+		const char* mName;
+		std::atomic<uint64_t> mCount;
+		std::atomic<uint64_t> mTotal;
+		std::atomic<uint64_t> mMax;
+		std::atomic<uint32_t> mBuckets[BUCKET_COUNT];
+	};
+
+	struct TraceEvent
+	{
+		size_t mSection;
+		std::thread::id mThread;
+		// Nanoseconds since the trace started
+		int64_t mStart;
+		int64_t mDuration;
+	};
+
+	static size_t GetBucket(uint64_t nanoseconds);
+	// Largest duration that lands in bucket
+	static uint64_t GetBucketLimit(size_t bucket);
+	// Upper bound of the given fraction of a section's calls, in ns
+	uint64_t GetPercentile(const Section& section, double fraction) const;
+
+	Section mSections[MAX_SECTIONS];
+	std::atomic<size_t> mSectionCount;
+	std::mutex mRegisterMutex;
+	std::atomic<bool> mEnabled;
+	std::atomic<bool> mTracing;
+	std::mutex mTraceMutex;
+	Clock::time_point mTraceStart;
+	std::vector<TraceEvent> mTrace;
+};
+
+// Times the enclosing block into a profiler section
+class ProfileScope
+{
+public:
+	ProfileScope(size_t section)
+	: mSection(section)
+	, mActive(Profiler::Get().IsEnabled())
+	{
+		if (mActive)
+		{
+			mStart = Profiler::Clock::now();
+		}
+	}
+
+	~ProfileScope()
+	{
+		if (mActive)
+		{
+			Profiler::Get().Add(mSection, mStart, Profiler::Clock::now());
+		}
+	}
+
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+private:
+	size_t mSection;
+	bool mActive;
+	Profiler::Clock::time_point mStart;
+};
+
+#define PROFILE_CONCAT_INNER(a, b) a##b
+#define PROFILE_CONCAT(a, b) PROFILE_CONCAT_INNER(a, b)
+
+#ifdef PAINT_PROFILING
+// Times the rest of the enclosing block as the section called name
+#define PROFILE_SCOPE(name) \
+	static const size_t PROFILE_CONCAT(profileSection, __LINE__) = Profiler::Get().Register(name); \
+	ProfileScope PROFILE_CONCAT(profileScope, __LINE__)(PROFILE_CONCAT(profileSection, __LINE__))
+#else
+#define PROFILE_SCOPE(name) ((void)0)
+#endif
@@ -0,0 +1,70 @@
+#include "RasterImage.h"
+#include <algorithm>
+
+RasterImage::RasterImage(int width, int height)
+: mWidth(0)
+, mHeight(0)
+{
+	Create(width, height);
+}
+
+void RasterImage::Create(int width, int height)
+{
+	mWidth = std::max(width, 0);
+	mHeight = std::max(height, 0);
+	mPixels.assign(static_cast<size_t>(mWidth) * mHeight, 0);
+}
+
+void RasterImage::Clear(const wxColour& colour)
+{
+	std::fill(mPixels.begin(), mPixels.end(), ToPixel(colour));
+}
+
+void RasterImage::Assign(const wxImage& image)
+{
+	if (!image.IsOk())
+	{
+		Create(0, 0);
+		return;
+	}
+	Create(image.GetWidth(), image.GetHeight());
+	const unsigned char* src = image.GetData();
+	const unsigned char* alpha = image.HasAlpha() ? image.GetAlpha() : nullptr;
+	unsigned char* dest = reinterpret_cast<unsigned char*>(mPixels.data());
+	size_t count = mPixels.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest[3] = alpha ? alpha[i] : 255;
+		dest += 4;
+		src += 3;
+	}
+}
+
+wxImage RasterImage::ToImage() const
+{
+	wxImage image(mWidth, mHeight, false);
+	unsigned char* dest = image.GetData();
+	const unsigned char* src = GetData();
+	size_t count = mPixels.size();
+	for (size_t i = 0; i < count; i++)
+	{
+		dest[0] = src[0];
+		dest[1] = src[1];
+		dest[2] = src[2];
+		dest += 3;
+		src += 4;
+	}
+	return image;
+}
+
+uint32_t RasterImage::ToPixel(const wxColour& colour)
+{
+	// Byte order in memory is R, G, B, A on every platform we build for
+	unsigned char bytes[4] = { colour.Red(), colour.Green(), colour.Blue(), colour.Alpha() };
+	uint32_t pixel;
+	std::copy(bytes, bytes + 4, reinterpret_cast<unsigned char*>(&pixel));
+	return pixel;
+}
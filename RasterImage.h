@@ -0,0 +1,41 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <wx/colour.h>
+#include <wx/image.h>
+
+// Plain 32-bit image in memory, four bytes per pixel in R, G, B, A
+// order with straight (not premultiplied) alpha. Rows are tightly
+// packed, so GetRow(y)[x] is pixel (x, y).
+class RasterImage
+{
+public:
+	RasterImage(int width = 0, int height = 0);
+	
+	void Create(int width, int height);
+	
+	int GetWidth() const { return mWidth; }
+	
+	int GetHeight() const { return mHeight; }
+	
+	bool IsOk() const { return mWidth > 0 && mHeight > 0; }
+	
+	uint32_t* GetRow(int y) { return &mPixels[static_cast<size_t>(y) * mWidth]; }
+	
+	const uint32_t* GetRow(int y) const { return &mPixels[static_cast<size_t>(y) * mWidth]; }
+	
+	const unsigned char* GetData() const { return reinterpret_cast<const unsigned char*>(mPixels.data()); }
+	
+	void Clear(const wxColour& colour);
+	// Copies a wxImage, taking alpha from it if it has any
+	void Assign(const wxImage& image);
+	// Copies the colour channels into a new wxImage; alpha is dropped
+	// since the canvas is always opaque
+	wxImage ToImage() const;
+	// Packs a colour into a pixel value
+	static uint32_t ToPixel(const wxColour& colour);
+private:
+	int mWidth;
+	int mHeight;
+	std::vector<uint32_t> mPixels;
+};
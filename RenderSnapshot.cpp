@@ -0,0 +1,92 @@
+#include "RenderSnapshot.h"
+#include "Profiler.h"
+#include "PaintModel.h"
+
+RenderSnapshot::RenderSnapshot()
+{
+	
+}
+
+void RenderSnapshot::Capture(PaintModel& model, const wxSize& size)
+{
+	PROFILE_SCOPE("RenderSnapshot::Capture");
+	mSize = size;
+	mItems.clear();
+	mPencils.clear();
+	mStyles.clear();
+	
+	const StyleTable& styles = model.GetStyles();
+	for (StyleId id = 0; id < styles.GetCount(); id++)
+	{
+		mStyles.push_back(RasterStyle(styles.GetPen(id), styles.GetBrush(id)));
+	}
+	if (model.GetImage())
+	{
+		// Only the part of the image on the canvas ends up in the output
+		model.GetImage()->Read(wxRect(size), mBackground);
+	}
+	else
+	{
+		mBackground.Create(0, 0);
+	}
+	
+	std::vector<const Shape*> shapes;
+	model.GetDrawOrder(shapes);
+	mItems.reserve(shapes.size());
+	for (auto shape : shapes)
+	{
+		Item item;
+		item.mKind = shape->GetKind();
+		item.mStyle = shape->GetStyle();
+		item.mBounds = shape->GetDamageRect();
+		wxPoint topLeft;
+		wxPoint botRight;
+		shape->GetBounds(topLeft, botRight);
+		item.mRect = wxRect(topLeft, botRight);
+		item.mPencil = 0;
+		switch (item.mKind)
+		{
+			case SK_Line:
+				static_cast<const LineShape*>(shape)->GetEndpoints(item.mFrom, item.mTo);
+				break;
+			case SK_Pencil:
+				item.mFrom = shape->GetOffset();
+				item.mPencil = mPencils.size();
+				mPencils.push_back(static_cast<const PencilShape*>(shape)->GetPoints());
+				break;
+			default:
+				break;
+		}
+		mItems.push_back(item);
+	}
+}
+
+void RenderSnapshot::DrawBackground(SoftwareRenderer& renderer) const
+{
+	renderer.Clear(wxColour(255, 255, 255));
+	if (mBackground.IsOk())
+	{
+		renderer.DrawImage(mBackground, wxPoint(0, 0));
+	}
+}
+
+void RenderSnapshot::DrawItem(SoftwareRenderer& renderer, size_t index) const
+{
+	const Item& item = mItems[index];
+	const RasterStyle& style = mStyles[item.mStyle];
+	switch (item.mKind)
+	{
+		case SK_Rect:
+			renderer.DrawRectangle(item.mRect, style);
+			break;
+		case SK_Ellipse:
+			renderer.DrawEllipse(item.mRect, style);
+			break;
+		case SK_Line:
+			renderer.DrawLine(item.mFrom, item.mTo, style);
+			break;
+		case SK_Pencil:
+			renderer.DrawPencil(mPencils[item.mPencil], item.mFrom, style);
+			break;
+	}
+}
@@ -0,0 +1,52 @@
+#pragma once
+#include <vector>
+#include <wx/gdicmn.h>
+#include "Shape.h"
+#include "PointStream.h"
+#include "RasterImage.h"
+#include "SoftwareRenderer.h"
+
+class PaintModel;
+
+// Self-contained copy of everything needed to rasterize a model: shape
+// geometry in draw order, flattened styles and the background image.
+// It shares nothing with the model (shapes live in the model's pool,
+// which is only safe to touch from the UI thread), so it can be drawn
+// on other threads while the user keeps editing.
+class RenderSnapshot
+{
+public:
+	RenderSnapshot();
+	// Copies the model; call on the UI thread
+	void Capture(PaintModel& model, const wxSize& size);
+	
+	const wxSize& GetSize() const { return mSize; }
+	
+	size_t GetCount() const { return mItems.size(); }
+	// Area touched by drawing item index, including the pen
+	const wxRect& GetBounds(size_t index) const { return mItems[index].mBounds; }
+	// Draws the background the same way for every part of the canvas
+	void DrawBackground(SoftwareRenderer& renderer) const;
+	
+	void DrawItem(SoftwareRenderer& renderer, size_t index) const;
+private:
+	struct Item
+	{
+		ShapeKind mKind;
+		StyleId mStyle;
+		wxRect mBounds;
+		// Rectangle/ellipse
+		wxRect mRect;
+		// Line endpoints, or the pencil offset in mFrom
+		wxPoint mFrom;
+		wxPoint mTo;
+		// Index into mPencils
+		size_t mPencil;
+	};
+	
+	wxSize mSize;
+	std::vector<Item> mItems;
+	std::vector<PointStream> mPencils;
+	std::vector<RasterStyle> mStyles;
+	RasterImage mBackground;
+};
@@ -0,0 +1,85 @@
+#include "SessionSnapshot.h"
+#include "Journal.h"
+#include "Profiler.h"
+#include <wx/filefn.h>
+#include <utility>
+
+namespace
+{
+	// Bytes queued before waiting for them to be written, so copying the
+	// spill file doesn't keep all of it in memory
+	const uint64_t WRITE_BATCH = 4 * 1024 * 1024;
+}
+
+void SessionSnapshot::Add(std::vector<unsigned char>&& record)
+{
+	Item item;
+	item.mHead = std::move(record);
+	item.mOffset = 0;
+	item.mSize = 0;
+	mItems.push_back(std::move(item));
+}
+
+void SessionSnapshot::Add(std::vector<unsigned char>&& head, uint64_t offset, uint32_t size)
+{
+	Item item;
+	item.mHead = std::move(head);
+	item.mOffset = offset;
+	item.mSize = size;
+	mItems.push_back(std::move(item));
+}
+
+bool SessionSnapshot::Write(const wxString& filename, const std::atomic<bool>& cancel) const
+{
+	PROFILE_SCOPE("SessionSnapshot::Write");
+	Journal journal;
+	if (!journal.Create(filename))
+	{
+		return false;
+	}
+	bool ok = true;
+	uint64_t queued = 0;
+	Journal::Record record;
+	std::vector<unsigned char> rest;
+	for (auto& item : mItems)
+	{
+		if (cancel)
+		{
+			ok = false;
+			break;
+		}
+		record = item.mHead;
+		if (item.mSize != 0)
+		{
+			if (mSpill == nullptr || !mSpill->Read(item.mOffset, item.mSize, rest))
+			{
+				ok = false;
+				break;
+			}
+			record.insert(record.end(), rest.begin(), rest.end());
+		}
+		journal.Append(record);
+		queued += record.size();
+		if (queued >= WRITE_BATCH)
+		{
+			ok = journal.Flush();
+			queued = 0;
+			if (!ok)
+			{
+				break;
+			}
+		}
+	}
+	if (ok)
+	{
+		record.assign(1, static_cast<unsigned char>(SR_End));
+		journal.Append(record);
+		ok = journal.Flush() && !cancel;
+	}
+	journal.Close();
+	if (!ok)
+	{
+		wxRemoveFile(filename);
+	}
+	return ok;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include <wx/string.h>
+#include "SpillFile.h"
+
+// Copy of an editing session, the document along with its undo and redo
+// history, taken on the UI thread and written out on another one. It's
+// written as the records of a Journal (.psnp). What the model holds in
+// memory is copied into the records when it's captured; commands and
+// shapes in the history's spill file are only referred to there, and
+// copied over as the snapshot is written, since records in a spill file
+// never move.
+class SessionSnapshot
+{
+public:
+	// What a record holds, in its first byte. The document record comes
+	// first and the end record last, so a snapshot cut short by a crash is
+	// never taken for a complete one.
+	enum RecordType
+	{
+		// Written by PaintModel::CaptureSession
+		SR_Document,
+		SR_Style,
+		SR_Shape,
+		// Written by CommandHistory::Capture
+		SR_HistoryShape,
+		SR_Command,
+		SR_End,
+	};
+
+	// Records held in the spill file are read from spill
+	void SetSpill(const std::shared_ptr<SpillFile>& spill) { mSpill = spill; }
+	// Adds a record held in memory
+	void Add(std::vector<unsigned char>&& record);
+	// Adds a record made of head followed by size bytes of the spill file,
+	// starting at offset
+	void Add(std::vector<unsigned char>&& head, uint64_t offset, uint32_t size);
+	// Writes the records to a new file at filename, followed by the end
+	// record, and syncs it. Call on any thread, once the snapshot is
+	// captured. Returns false, removing the file, if writing fails or
+	// cancel is set.
+	bool Write(const wxString& filename, const std::atomic<bool>& cancel) const;
+private:
+	struct Item
+	{
+		std::vector<unsigned char> mHead;
+		// Rest of the record in the spill file; mSize is 0 if there's none
+		uint64_t mOffset;
+		uint32_t mSize;
+	};
+
+	std::vector<Item> mItems;
+	std::shared_ptr<SpillFile> mSpill;
+};
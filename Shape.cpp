@@ -1,10 +1,16 @@
 #include "Shape.h"
+#include "Profiler.h"
+#include <algorithm>
+#include <utility>
 
 Shape::Shape(const wxPoint& start)
 	:mStartPoint(start)
 	,mEndPoint(start)
 	,mTopLeft(start)
 	,mBotRight(start)
+	,mStyle(StyleTable::DEFAULT_STYLE)
+	,mPenWidth(1)
+	,mId(INVALID_SHAPE_ID)
 {
     mOffset.x = 0;
     mOffset.y = 0;
@@ -53,7 +59,46 @@ void Shape::GetBounds(wxPoint& topLeft, wxPoint& botRight) const
 	botRight = mBotRight + mOffset;
 }
 
-void Shape::DrawSelection(wxDC &dc)
+wxRect Shape::GetDamageRect() const
+{
+	wxPoint topLeft;
+	wxPoint botRight;
+	GetBounds(topLeft, botRight);
+	return GetDamageRect(topLeft - mOffset, botRight - mOffset);
+}
+
+wxRect Shape::GetDamageRect(const wxPoint& from, const wxPoint& to) const
+{
+	wxRect rect(from + mOffset, to + mOffset);
+	// Half the pen spills outside the bounds, and the selection outline
+	// is drawn 2 pixels out with a 1 pixel pen
+	rect.Inflate(mPenWidth / 2 + 4);
+	return rect;
+}
+
+void Shape::GetGeometry(wxPoint& start, wxPoint& end, wxPoint& topLeft, wxPoint& botRight) const
+{
+	start = mStartPoint;
+	end = mEndPoint;
+	topLeft = mTopLeft;
+	botRight = mBotRight;
+}
+
+void Shape::SetGeometry(const wxPoint& start, const wxPoint& end, const wxPoint& topLeft, const wxPoint& botRight)
+{
+	mStartPoint = start;
+	mEndPoint = end;
+	mTopLeft = topLeft;
+	mBotRight = botRight;
+}
+
+void Shape::SetStyle(StyleId style, const StyleTable& styles)
+{
+	mStyle = style;
+	mPenWidth = styles.GetPen(style).GetWidth();
+}
+
+wxRect Shape::GetSelectionRectangle() const
 {
     wxPoint topLeft = mTopLeft + mOffset;
     wxPoint botRight = mBotRight + mOffset;
@@ -61,11 +106,14 @@ void Shape::DrawSelection(wxDC &dc)
     topLeft.y -= 2;
     botRight.x += 2;
     botRight.y += 2;
-    
+    return wxRect(topLeft, botRight);
+}
+
+void Shape::DrawSelection(wxDC &dc)
+{
     dc.SetPen(*wxBLACK_DASHED_PEN);
     dc.SetBrush(*wxTRANSPARENT_BRUSH);
-    mSelectionRectangle = wxRect(topLeft, botRight);
-    dc.DrawRectangle(mSelectionRectangle);
+    dc.DrawRectangle(GetSelectionRectangle());
 }
 RectShape::RectShape(const wxPoint& start)
 : Shape(start)
@@ -73,10 +121,11 @@ RectShape::RectShape(const wxPoint& start)
     
 }
 
-void RectShape::Draw(wxDC &dc) const
+void RectShape::Draw(wxDC &dc, const StyleTable& styles) const
 {
-    dc.SetPen(mPen);
-    dc.SetBrush(mBrush);
+    PROFILE_SCOPE("RectShape::Draw");
+    dc.SetPen(styles.GetPen(mStyle));
+    dc.SetBrush(styles.GetBrush(mStyle));
     dc.DrawRectangle(wxRect(mTopLeft + mOffset, mBotRight + mOffset));
 }
 
@@ -86,10 +135,11 @@ EllipseShape::EllipseShape(const wxPoint& start)
 
 }
 
-void EllipseShape::Draw(wxDC &dc) const
+void EllipseShape::Draw(wxDC &dc, const StyleTable& styles) const
 {
-    dc.SetPen(mPen);
-    dc.SetBrush(mBrush);
+    PROFILE_SCOPE("EllipseShape::Draw");
+    dc.SetPen(styles.GetPen(mStyle));
+    dc.SetBrush(styles.GetBrush(mStyle));
     dc.DrawEllipse(wxRect(mTopLeft + mOffset, mBotRight + mOffset));
 }
 
@@ -99,66 +149,248 @@ LineShape::LineShape(const wxPoint& start)
     
 }
 
-void LineShape::Draw(wxDC &dc) const
+void LineShape::Draw(wxDC &dc, const StyleTable& styles) const
 {
-    dc.SetPen(mPen);
-    dc.SetBrush(mBrush);
+    PROFILE_SCOPE("LineShape::Draw");
+    dc.SetPen(styles.GetPen(mStyle));
+    dc.SetBrush(styles.GetBrush(mStyle));
     dc.DrawLine(mStartPoint + mOffset, mEndPoint + mOffset);
 }
 
-PencilShape::PencilShape(const wxPoint& point)
-:Shape(point)
+void LineShape::GetEndpoints(wxPoint& start, wxPoint& end) const
 {
-    mPoints.push_back(point);
+    start = mStartPoint + mOffset;
+    end = mEndPoint + mOffset;
 }
 
-void PencilShape::Update(const wxPoint &newPoint)
-{
-    Shape::Update(newPoint);
-    mPoints.push_back(newPoint);
-}
-
-void PencilShape::Finalize()
+namespace
 {
-    wxPoint topLeft = mPoints.front();
-    wxPoint botRight = mPoints.front();
-    for(auto& iter : mPoints)
+    // Tolerance of each level of detail, in pixels at 100% scale
+    const double LOD_TOLERANCES[] = { 2.0, 4.0, 8.0, 16.0 };
+    const size_t LOD_LEVELS = sizeof(LOD_TOLERANCES) / sizeof(LOD_TOLERANCES[0]);
+    // Strokes this short never get coarser levels
+    const size_t LOD_MIN_POINTS = 16;
+    
+    // Squared distance from point to the segment between a and b
+    double SegmentDistanceSq(const wxPoint& point, const wxPoint& a, const wxPoint& b)
     {
-        if(iter.x < topLeft.x)
+        double dx = b.x - a.x;
+        double dy = b.y - a.y;
+        double px = point.x - a.x;
+        double py = point.y - a.y;
+        double lengthSq = dx * dx + dy * dy;
+        if(lengthSq > 0.0)
         {
-            topLeft.x = iter.x;
+            double t = (px * dx + py * dy) / lengthSq;
+            if(t > 1.0)
+            {
+                t = 1.0;
+            }
+            if(t > 0.0)
+            {
+                px -= t * dx;
+                py -= t * dy;
+            }
         }
-        if(iter.y < topLeft.y)
+        return px * px + py * py;
+    }
+    
+    // Ramer-Douglas-Peucker: keeps the endpoints and recursively the
+    // point furthest from each chord until everything is within tolerance
+    void SimplifyPoints(const std::vector<wxPoint>& points, double tolerance, PointStream& out)
+    {
+        out.Clear();
+        if(points.size() < 3 || tolerance <= 0.0)
         {
-            topLeft.y = iter.y;
+            for(auto& point : points)
+            {
+                out.Append(point);
+            }
+            out.ShrinkToFit();
+            return;
         }
-        if(iter.x > botRight.x)
+        
+        double toleranceSq = tolerance * tolerance;
+        std::vector<char> keep(points.size(), 0);
+        keep.front() = 1;
+        keep.back() = 1;
+        std::vector<std::pair<size_t, size_t>> spans;
+        spans.push_back(std::make_pair(size_t(0), points.size() - 1));
+        while(!spans.empty())
         {
-            botRight.x = iter.x;
+            size_t first = spans.back().first;
+            size_t last = spans.back().second;
+            spans.pop_back();
+            
+            double maxDistSq = 0.0;
+            size_t index = first;
+            for(size_t i = first + 1; i < last; i++)
+            {
+                double distSq = SegmentDistanceSq(points[i], points[first], points[last]);
+                if(distSq > maxDistSq)
+                {
+                    maxDistSq = distSq;
+                    index = i;
+                }
+            }
+            if(maxDistSq > toleranceSq)
+            {
+                keep[index] = 1;
+                spans.push_back(std::make_pair(first, index));
+                spans.push_back(std::make_pair(index, last));
+            }
         }
-        if(iter.y > botRight.y)
+        
+        for(size_t i = 0; i < points.size(); i++)
         {
-            botRight.y = iter.y;
+            if(keep[i])
+            {
+                out.Append(points[i]);
+            }
         }
+        out.ShrinkToFit();
     }
-    mTopLeft = topLeft;
-    mBotRight = botRight;
 }
 
-void PencilShape::Draw(wxDC &dc) const
+PencilShape::PencilShape(const wxPoint& point)
+:Shape(point)
+,mTolerance(0.0)
+,mRecordedCount(0)
+,mSimplified(false)
+{
+    mPoints.Append(point);
+    mRecordedCount = 1;
+}
+
+void PencilShape::Update(const wxPoint &newPoint)
+{
+    // Shape::Update only looks at the start and end point, so grow the
+    // bounds here instead; that keeps them right while drawing without
+    // rescanning the stroke
+    mEndPoint = newPoint;
+    mTopLeft.x = std::min(mTopLeft.x, newPoint.x);
+    mTopLeft.y = std::min(mTopLeft.y, newPoint.y);
+    mBotRight.x = std::max(mBotRight.x, newPoint.x);
+    mBotRight.y = std::max(mBotRight.y, newPoint.y);
+    mPoints.Append(newPoint);
+    mRecordedCount++;
+}
+
+void PencilShape::Finalize()
 {
-    dc.SetPen(mPen);
-    dc.SetBrush(mBrush);
-    if(mPoints.size() == 1)
+    // Finalize also runs again for pen/brush changes; only simplify once
+    // so the error doesn't build up. The bounds were grown from the raw
+    // samples and stay conservative.
+    if(mSimplified)
     {
-        dc.DrawPoint(mPoints[0]);
+        return;
     }
-    else {
-        dc.DrawLines(static_cast<int>(mPoints.size()), mPoints.data(), mOffset.x, mOffset.y);
+    mSimplified = true;
+    std::vector<wxPoint> points;
+    points.reserve(mPoints.GetCount());
+    PointStream::Reader reader(mPoints);
+    wxPoint point;
+    while(reader.Next(point))
+    {
+        points.push_back(point);
     }
+    SimplifyPoints(points, mTolerance, mPoints);
+    BuildLevels(points);
 }
 
+void PencilShape::BuildLevels(const std::vector<wxPoint>& points)
+{
+    mLevels.clear();
+    size_t count = mPoints.GetCount();
+    for(size_t i = 0; i < LOD_LEVELS && count > LOD_MIN_POINTS; i++)
+    {
+        if(LOD_TOLERANCES[i] <= mTolerance)
+        {
+            continue;
+        }
+        Level level;
+        level.mTolerance = LOD_TOLERANCES[i];
+        SimplifyPoints(points, level.mTolerance, level.mPoints);
+        // Not worth keeping a level that barely drops anything
+        if(level.mPoints.GetCount() * 4 > count * 3)
+        {
+            break;
+        }
+        count = level.mPoints.GetCount();
+        mLevels.push_back(level);
+    }
+}
 
+void PencilShape::Restore(const unsigned char* deltas, size_t size, size_t count, size_t recordedCount, double tolerance)
+{
+    // Simplification keeps the first and last samples, so they're the
+    // start and end points
+    mPoints.Assign(mStartPoint, mEndPoint, deltas, size, count);
+    mLevels.clear();
+    mRecordedCount = recordedCount;
+    mTolerance = tolerance;
+    mSimplified = true;
+}
 
+void PencilShape::RestoreLevel(double tolerance, const unsigned char* deltas, size_t size, size_t count)
+{
+    Level level;
+    level.mTolerance = tolerance;
+    level.mPoints.Assign(mStartPoint, mEndPoint, deltas, size, count);
+    mLevels.push_back(level);
+}
 
+size_t PencilShape::GetMemoryUsage() const
+{
+    size_t bytes = sizeof(*this) + mPoints.GetCapacity() + mLevels.capacity() * sizeof(Level);
+    for(auto& level : mLevels)
+    {
+        bytes += level.mPoints.GetCapacity();
+    }
+    return bytes;
+}
 
+void PencilShape::Draw(wxDC &dc, const StyleTable& styles) const
+{
+    PROFILE_SCOPE("PencilShape::Draw");
+    dc.SetPen(styles.GetPen(mStyle));
+    dc.SetBrush(styles.GetBrush(mStyle));
+    DrawPoints(dc);
+}
+
+void PencilShape::DrawPoints(wxDC &dc) const
+{
+    if(mPoints.GetCount() == 1)
+    {
+        dc.DrawPoint(mPoints.GetFirst() + mOffset);
+        return;
+    }
+    
+    // Pick the coarsest level whose error stays under half a device pixel
+    double scaleX = 1.0;
+    double scaleY = 1.0;
+    dc.GetUserScale(&scaleX, &scaleY);
+    double scale = std::min(scaleX, scaleY);
+    const PointStream* points = &mPoints;
+    for(auto& level : mLevels)
+    {
+        if(level.mTolerance * scale > 0.5)
+        {
+            break;
+        }
+        points = &level.mPoints;
+    }
+    
+    // Decode a batch at a time; each batch starts with the last point of
+    // the previous one so the polyline stays connected
+    const size_t BATCH_SIZE = 256;
+    wxPoint batch[BATCH_SIZE];
+    PointStream::Reader reader(*points);
+    size_t count = reader.Read(batch, BATCH_SIZE);
+    while(count > 1)
+    {
+        dc.DrawLines(static_cast<int>(count), batch, mOffset.x, mOffset.y);
+        batch[0] = batch[count - 1];
+        count = 1 + reader.Read(batch + 1, BATCH_SIZE - 1);
+    }
+}
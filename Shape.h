@@ -1,5 +1,20 @@
 #pragma once
 #include <wx/dc.h>
+#include <vector>
+#include "StyleTable.h"
+#include "PointStream.h"
+
+// Identifier handed out by the model's shape registry
+typedef unsigned int ShapeId;
+static const ShapeId INVALID_SHAPE_ID = 0xffffffff;
+
+enum ShapeKind
+{
+	SK_Rect,
+	SK_Ellipse,
+	SK_Line,
+	SK_Pencil,
+};
 
 // Abstract base class for all Shapes
 class Shape
@@ -15,23 +30,43 @@ public:
 	virtual void Finalize();
 	// Returns the top left/bottom right points of the shape
 	void GetBounds(wxPoint& topLeft, wxPoint& botRight) const;
-	// Draw the shape
-	virtual void Draw(wxDC& dc) const = 0;
+	// Returns the area touched when drawing this shape, including
+	// the pen width and the selection outline
+	wxRect GetDamageRect() const;
+	// Returns the area touched when drawing a segment with this shape's pen
+	wxRect GetDamageRect(const wxPoint& from, const wxPoint& to) const;
+	// Draw the shape with its style from the given table
+	virtual void Draw(wxDC& dc, const StyleTable& styles) const = 0;
+	// Which concrete shape this is, used by batched drawing
+	virtual ShapeKind GetKind() const = 0;
 	virtual ~Shape() { }
     
-    void SetPen(wxPen pen) { mPen = pen; }
-    
-    wxPen GetPen() { return mPen; }
-    
-    void SetBrush(wxBrush brush) { mBrush = brush; }
+    // Set the style handle; the table is only used to look up the pen width
+    void SetStyle(StyleId style, const StyleTable& styles);
     
-    wxBrush GetBrush() { return mBrush; }
+    StyleId GetStyle() const { return mStyle; }
     
-    wxRect GetSelectionRectangle() { return mSelectionRectangle; }
+    // Outline drawn around the shape while it's selected, 2 pixels out
+    // from its bounds; the same as what DrawSelection draws, so it can be
+    // hit-tested without painting first
+    wxRect GetSelectionRectangle() const;
     
     void DrawSelection(wxDC &dc);
     
     void SetOffset(wxPoint offset) { mOffset = offset; }
+    
+    wxPoint GetOffset() const { return mOffset; }
+    
+    ShapeId GetId() const { return mId; }
+    
+    void SetId(ShapeId id) { mId = id; }
+    
+    // Start/end points and bounds without the offset, as saved in documents
+    void GetGeometry(wxPoint& start, wxPoint& end, wxPoint& topLeft, wxPoint& botRight) const;
+    // Restores the points given by GetGeometry
+    void SetGeometry(const wxPoint& start, const wxPoint& end, const wxPoint& topLeft, const wxPoint& botRight);
+    // Bytes of memory the shape holds on to, roughly
+    virtual size_t GetMemoryUsage() const { return sizeof(*this); }
 protected:
 	// Starting point of shape
 	wxPoint mStartPoint;
@@ -41,14 +76,14 @@ protected:
 	wxPoint mTopLeft;
 	// Bottom right point of shape
 	wxPoint mBotRight;
-    // Pen
-    wxPen mPen;
-    // Brush
-    wxBrush mBrush;
-    // Rect for selection
-    wxRect mSelectionRectangle;
+    // Pen/brush handle in the model's style table
+    StyleId mStyle;
+    // Width of the style's pen, cached since the bounds depend on it
+    int mPenWidth;
     // Offset point
     wxPoint mOffset;
+    // Stable ID in the model's shape registry
+    ShapeId mId;
 };
 
 class RectShape : public Shape
@@ -57,7 +92,9 @@ public:
     RectShape(const wxPoint& start);
     
     //Draw the shape
-    void Draw(wxDC& dc) const override;
+    void Draw(wxDC& dc, const StyleTable& styles) const override;
+    
+    ShapeKind GetKind() const override { return SK_Rect; }
 };
 
 class EllipseShape : public Shape
@@ -66,7 +103,9 @@ public:
     EllipseShape(const wxPoint& start);
     
     //Draw the shape
-    void Draw(wxDC& dc) const override;
+    void Draw(wxDC& dc, const StyleTable& styles) const override;
+    
+    ShapeKind GetKind() const override { return SK_Ellipse; }
 };
 
 class LineShape : public Shape
@@ -75,7 +114,12 @@ public:
     LineShape(const wxPoint& start);
     
     //Draw the line
-    void Draw(wxDC& dc) const override;
+    void Draw(wxDC& dc, const StyleTable& styles) const override;
+    
+    ShapeKind GetKind() const override { return SK_Line; }
+    
+    // Returns the start/end points of the line, including the offset
+    void GetEndpoints(wxPoint& start, wxPoint& end) const;
 };
 
 class PencilShape : public Shape
@@ -87,7 +131,54 @@ public:
     
     void Finalize() override;
     
-    void Draw(wxDC& dc) const override;
+    void Draw(wxDC& dc, const StyleTable& styles) const override;
+    
+    ShapeKind GetKind() const override { return SK_Pencil; }
+    
+    // Draw the stroke with whatever pen is currently set on the DC,
+    // using a coarser level of detail when the DC is scaled down
+    void DrawPoints(wxDC& dc) const;
+    // Samples closer than this to the simplified stroke are dropped when
+    // the stroke is finalized; 0 keeps every sample
+    void SetTolerance(double tolerance) { mTolerance = tolerance; }
+    // Number of samples recorded while drawing
+    size_t GetRecordedCount() const { return mRecordedCount; }
+    // Number of points kept after simplification
+    size_t GetPointCount() const { return mPoints.GetCount(); }
+    // Full resolution points, without the offset
+    const PointStream& GetPoints() const { return mPoints; }
+    
+    double GetTolerance() const { return mTolerance; }
+    // Coarser levels of detail, from finest to coarsest
+    size_t GetLevelCount() const { return mLevels.size(); }
+    
+    double GetLevelTolerance(size_t level) const { return mLevels[level].mTolerance; }
+    
+    const PointStream& GetLevelPoints(size_t level) const { return mLevels[level].mPoints; }
+    // Restores a finished stroke saved in a document from the deltas of
+    // its points; call SetGeometry first, since the stroke runs from the
+    // start point to the end point. It isn't simplified again.
+    void Restore(const unsigned char* deltas, size_t size, size_t count, size_t recordedCount, double tolerance);
+    // Adds the next coarser level of detail of a restored stroke
+    void RestoreLevel(double tolerance, const unsigned char* deltas, size_t size, size_t count);
+    
+    size_t GetMemoryUsage() const override;
 private:
-    std::vector<wxPoint> mPoints;
+    // Rebuilds mLevels from the full resolution points
+    void BuildLevels(const std::vector<wxPoint>& points);
+    
+    // Every point of the stroke, delta encoded
+    PointStream mPoints;
+    struct Level
+    {
+        // Maximum distance from the full resolution stroke
+        double mTolerance;
+        PointStream mPoints;
+    };
+    // Progressively coarser copies of mPoints for scaled down drawing
+    std::vector<Level> mLevels;
+    double mTolerance;
+    size_t mRecordedCount;
+    // Whether Finalize has already simplified the stroke
+    bool mSimplified;
 };
@@ -0,0 +1,231 @@
+#include "ShapeGrid.h"
+#include "Shape.h"
+#include <algorithm>
+#include <climits>
+
+// Shapes spanning more cells than this go up a level, so a huge
+// rectangle doesn't have to be binned thousands of times
+static const long long MAX_CELLS_PER_SHAPE = 64;
+// How much wider each level's cells are than the level below
+static const int LEVEL_SCALE = 8;
+
+ShapeGrid::ShapeGrid(int cellSize)
+: mLevels(1)
+{
+	mLevels[0].mCellSize = cellSize;
+}
+
+void ShapeGrid::Insert(const Shape* shape, unsigned int z)
+{
+	Remove(shape);
+	
+	wxRect rect = shape->GetDamageRect();
+	Record record;
+	record.mLevel = 0;
+	record.mCells = GetCellRange(rect, mLevels[0].mCellSize);
+	record.mZ = z;
+	while (static_cast<long long>(record.mCells.width) * record.mCells.height > MAX_CELLS_PER_SHAPE)
+	{
+		int cellSize = mLevels[record.mLevel].mCellSize;
+		if (cellSize > INT_MAX / LEVEL_SCALE)
+		{
+			// Cells this big cover any rectangle in a few cells
+			break;
+		}
+		record.mLevel++;
+		if (record.mLevel == mLevels.size())
+		{
+			mLevels.push_back(Level());
+			mLevels.back().mCellSize = cellSize * LEVEL_SCALE;
+		}
+		record.mCells = GetCellRange(rect, mLevels[record.mLevel].mCellSize);
+	}
+	
+	Entry entry;
+	entry.mShape = shape;
+	entry.mZ = z;
+	Level& level = mLevels[record.mLevel];
+	for (int y = record.mCells.y; y < record.mCells.y + record.mCells.height; y++)
+	{
+		for (int x = record.mCells.x; x < record.mCells.x + record.mCells.width; x++)
+		{
+			level.mCells[GetKey(x, y)].push_back(entry);
+		}
+	}
+	mRecords[shape] = record;
+}
+
+void ShapeGrid::Remove(const Shape* shape)
+{
+	auto iter = mRecords.find(shape);
+	if (iter == mRecords.end())
+	{
+		return;
+	}
+	
+	// Use the cells the shape was binned into, not its current bounds,
+	// since the shape may have moved since then
+	const Record& record = iter->second;
+	Level& level = mLevels[record.mLevel];
+	for (int y = record.mCells.y; y < record.mCells.y + record.mCells.height; y++)
+	{
+		for (int x = record.mCells.x; x < record.mCells.x + record.mCells.width; x++)
+		{
+			auto cell = level.mCells.find(GetKey(x, y));
+			if (cell != level.mCells.end())
+			{
+				RemoveEntry(cell->second, shape);
+				if (cell->second.empty())
+				{
+					level.mCells.erase(cell);
+				}
+			}
+		}
+	}
+	mRecords.erase(iter);
+}
+
+void ShapeGrid::Update(const Shape* shape)
+{
+	auto iter = mRecords.find(shape);
+	if (iter != mRecords.end())
+	{
+		unsigned int z = iter->second.mZ;
+		Insert(shape, z);
+	}
+}
+
+const Shape* ShapeGrid::Pick(const wxPoint& point) const
+{
+	const Shape* result = nullptr;
+	unsigned int resultZ = 0;
+	
+	for (auto& level : mLevels)
+	{
+		auto cell = level.mCells.find(GetKey(ToCell(point.x, level.mCellSize),
+			ToCell(point.y, level.mCellSize)));
+		if (cell == level.mCells.end())
+		{
+			continue;
+		}
+		for (auto& entry : cell->second)
+		{
+			if ((result == nullptr || entry.mZ > resultZ) && entry.mShape->Intersects(point))
+			{
+				result = entry.mShape;
+				resultZ = entry.mZ;
+			}
+		}
+	}
+	return result;
+}
+
+void ShapeGrid::Query(const wxRect& rect, std::vector<const Shape*>& shapes) const
+{
+	std::vector<const Entry*> found;
+	for (auto& level : mLevels)
+	{
+		Collect(level, GetCellRange(rect, level.mCellSize), found);
+	}
+	
+	// A shape shows up once per cell it covers; z values are unique,
+	// so sorting by z both restores draw order and groups duplicates
+	std::sort(found.begin(), found.end(), [](const Entry* a, const Entry* b)
+	{
+		return a->mZ < b->mZ;
+	});
+	for (size_t i = 0; i < found.size(); i++)
+	{
+		if (i > 0 && found[i]->mZ == found[i - 1]->mZ)
+		{
+			continue;
+		}
+		if (rect.Intersects(found[i]->mShape->GetDamageRect()))
+		{
+			shapes.push_back(found[i]->mShape);
+		}
+	}
+}
+
+void ShapeGrid::Clear()
+{
+	mLevels.resize(1);
+	mLevels[0].mCells.clear();
+	mRecords.clear();
+}
+
+void ShapeGrid::Collect(const Level& level, const wxRect& range, std::vector<const Entry*>& found)
+{
+	if (static_cast<long long>(range.width) * range.height > static_cast<long long>(level.mCells.size()))
+	{
+		// A zoomed out view covers mostly empty cells, so walk the
+		// occupied ones instead
+		for (auto& cell : level.mCells)
+		{
+			int x = static_cast<int>(static_cast<uint32_t>(cell.first >> 32));
+			int y = static_cast<int>(static_cast<uint32_t>(cell.first & 0xffffffff));
+			if (range.Contains(x, y))
+			{
+				for (auto& entry : cell.second)
+				{
+					found.push_back(&entry);
+				}
+			}
+		}
+		return;
+	}
+	for (int y = range.y; y < range.y + range.height; y++)
+	{
+		for (int x = range.x; x < range.x + range.width; x++)
+		{
+			auto cell = level.mCells.find(GetKey(x, y));
+			if (cell != level.mCells.end())
+			{
+				for (auto& entry : cell->second)
+				{
+					found.push_back(&entry);
+				}
+			}
+		}
+	}
+}
+
+wxRect ShapeGrid::GetCellRange(const wxRect& rect, int cellSize)
+{
+	int left = ToCell(rect.x, cellSize);
+	int top = ToCell(rect.y, cellSize);
+	int right = ToCell(rect.x + rect.width - 1, cellSize);
+	int bottom = ToCell(rect.y + rect.height - 1, cellSize);
+	return wxRect(left, top, right - left + 1, bottom - top + 1);
+}
+
+int ShapeGrid::ToCell(int coord, int cellSize)
+{
+	// Round towards negative infinity so moved shapes with negative
+	// coordinates don't share cell 0 with everything else
+	if (coord >= 0)
+	{
+		return coord / cellSize;
+	}
+	return -(-(coord + 1) / cellSize) - 1;
+}
+
+uint64_t ShapeGrid::GetKey(int cellX, int cellY)
+{
+	// Shift the unsigned bits, since shifting a negative cellX is undefined
+	return (static_cast<uint64_t>(static_cast<uint32_t>(cellX)) << 32) | static_cast<uint32_t>(cellY);
+}
+
+void ShapeGrid::RemoveEntry(std::vector<Entry>& entries, const Shape* shape)
+{
+	for (size_t i = 0; i < entries.size(); i++)
+	{
+		if (entries[i].mShape == shape)
+		{
+			// Order within a cell doesn't matter, z decides what's on top
+			entries[i] = entries.back();
+			entries.pop_back();
+			return;
+		}
+	}
+}
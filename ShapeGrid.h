@@ -0,0 +1,75 @@
+#pragma once
+#include <cstdint>
+#include <vector>
+#include <unordered_map>
+#include <wx/gdicmn.h>
+
+class Shape;
+
+// Uniform grid over the area covered by each shape, used to find the
+// shapes near a point or rectangle without walking the whole model.
+// Every shape carries a z value; higher z values are drawn on top.
+//
+// The grid doesn't own its shapes, so culling and picking don't touch any
+// reference counts. Whoever owns a shape removes it, or clears the grid,
+// before letting go of it.
+//
+// Shapes too big for the grid go into coarser grids stacked on top of it,
+// each with cells LEVEL_SCALE times wider than the one below, so a huge
+// shape is binned into a few big cells rather than thousands of small ones.
+class ShapeGrid
+{
+public:
+	ShapeGrid(int cellSize = 64);
+	
+	// Add a shape to every cell it covers
+	void Insert(const Shape* shape, unsigned int z);
+	// Remove a shape from the grid (no-op if it isn't there)
+	void Remove(const Shape* shape);
+	// Re-bin a shape whose bounds changed, keeping its z value
+	void Update(const Shape* shape);
+	// Returns the topmost shape that intersects with the point
+	const Shape* Pick(const wxPoint& point) const;
+	// Returns every shape that might touch the rectangle, bottom to top
+	void Query(const wxRect& rect, std::vector<const Shape*>& shapes) const;
+	
+	void Clear();
+	// Makes room for count shapes in total
+	void Reserve(size_t count) { mRecords.reserve(count); }
+private:
+	struct Entry
+	{
+		const Shape* mShape;
+		unsigned int mZ;
+	};
+	struct Level
+	{
+		// Size of each cell in pixels
+		int mCellSize;
+		// Shapes binned in each cell
+		std::unordered_map<uint64_t, std::vector<Entry>> mCells;
+	};
+	// Cell range a shape was binned into, and on which level
+	struct Record
+	{
+		wxRect mCells;
+		unsigned int mZ;
+		size_t mLevel;
+	};
+	
+	static wxRect GetCellRange(const wxRect& rect, int cellSize);
+	
+	static int ToCell(int coord, int cellSize);
+	
+	static uint64_t GetKey(int cellX, int cellY);
+	
+	void RemoveEntry(std::vector<Entry>& entries, const Shape* shape);
+	// Adds the entries of level's cells in range to found
+	static void Collect(const Level& level, const wxRect& range, std::vector<const Entry*>& found);
+	
+	// The finest grid first, each coarser one after it. Coarser levels are
+	// only added once a shape needs them.
+	std::vector<Level> mLevels;
+	// Where each shape currently lives
+	std::unordered_map<const Shape*, Record> mRecords;
+};
@@ -0,0 +1,148 @@
+#include "ShapeRegistry.h"
+
+ShapeRegistry::ShapeRegistry()
+: mNextZ(0)
+, mRemovedBytes(0)
+{
+	
+}
+
+bool ShapeRegistry::Add(const std::shared_ptr<Shape>& shape)
+{
+	const Slot* existing = GetSlot(shape);
+	if (existing != nullptr)
+	{
+		if (existing->mLive)
+		{
+			return false;
+		}
+		// Put it back exactly where it was
+		Slot& slot = mSlots[shape->GetId()];
+		slot.mLive = true;
+		mRemovedBytes -= slot.mBytes;
+		slot.mBytes = 0;
+		mOrder.emplace(slot.mZ, shape);
+		return true;
+	}
+	
+	Slot slot;
+	slot.mShape = shape;
+	slot.mZ = mNextZ++;
+	slot.mLive = true;
+	slot.mBytes = 0;
+	shape->SetId(static_cast<ShapeId>(mSlots.size()));
+	mSlots.push_back(slot);
+	// New shapes always go on top
+	mOrder.emplace_hint(mOrder.end(), slot.mZ, shape);
+	return true;
+}
+
+bool ShapeRegistry::Remove(const std::shared_ptr<Shape>& shape)
+{
+	const Slot* existing = GetSlot(shape);
+	if (existing == nullptr || !existing->mLive)
+	{
+		return false;
+	}
+	Slot& slot = mSlots[shape->GetId()];
+	slot.mLive = false;
+	slot.mBytes = shape->GetMemoryUsage();
+	mRemovedBytes += slot.mBytes;
+	mOrder.erase(slot.mZ);
+	return true;
+}
+
+bool ShapeRegistry::Contains(const std::shared_ptr<Shape>& shape) const
+{
+	const Slot* slot = GetSlot(shape);
+	return slot != nullptr && slot->mLive;
+}
+
+std::shared_ptr<Shape> ShapeRegistry::Get(ShapeId id) const
+{
+	if (id < mSlots.size() && mSlots[id].mLive)
+	{
+		return mSlots[id].mShape.lock();
+	}
+	return nullptr;
+}
+
+std::shared_ptr<Shape> ShapeRegistry::GetRemoved(ShapeId id) const
+{
+	if (id < mSlots.size() && !mSlots[id].mLive)
+	{
+		return mSlots[id].mShape.lock();
+	}
+	return nullptr;
+}
+
+bool ShapeRegistry::Rebind(ShapeId id, const std::shared_ptr<Shape>& shape)
+{
+	if (id >= mSlots.size() || mSlots[id].mLive || !mSlots[id].mShape.expired())
+	{
+		return false;
+	}
+	mSlots[id].mShape = shape;
+	mRemovedBytes -= mSlots[id].mBytes;
+	mSlots[id].mBytes = shape->GetMemoryUsage();
+	mRemovedBytes += mSlots[id].mBytes;
+	shape->SetId(id);
+	return true;
+}
+
+void ShapeRegistry::Release(ShapeId id)
+{
+	if (id < mSlots.size() && !mSlots[id].mLive && mSlots[id].mShape.expired())
+	{
+		mRemovedBytes -= mSlots[id].mBytes;
+		mSlots[id].mBytes = 0;
+	}
+}
+
+unsigned int ShapeRegistry::GetZ(const std::shared_ptr<Shape>& shape) const
+{
+	const Slot* slot = GetSlot(shape);
+	if (slot != nullptr)
+	{
+		return slot->mZ;
+	}
+	return 0;
+}
+
+void ShapeRegistry::Clear()
+{
+	mSlots.clear();
+	mOrder.clear();
+	mNextZ = 0;
+	mRemovedBytes = 0;
+}
+
+void ShapeRegistry::Reset(ShapeId count)
+{
+	Clear();
+	// Each shape's z is the order it was first added in, same as its ID
+	Slot slot;
+	slot.mLive = false;
+	slot.mBytes = 0;
+	mSlots.resize(count, slot);
+	for (ShapeId id = 0; id < count; id++)
+	{
+		mSlots[id].mZ = id;
+	}
+	mNextZ = count;
+}
+
+const ShapeRegistry::Slot* ShapeRegistry::GetSlot(const std::shared_ptr<Shape>& shape) const
+{
+	if (shape == nullptr)
+	{
+		return nullptr;
+	}
+	ShapeId id = shape->GetId();
+	// The ID alone isn't enough, the shape may come from an older document
+	if (id < mSlots.size() && mSlots[id].mShape.lock() == shape)
+	{
+		return &mSlots[id];
+	}
+	return nullptr;
+}
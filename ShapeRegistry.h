@@ -0,0 +1,75 @@
+#pragma once
+#include <memory>
+#include <vector>
+#include <map>
+#include "Shape.h"
+
+// Slot map that owns the shapes in the model, keyed by stable shape IDs.
+// Shapes are kept in an explicit z-order, and a shape that is removed and
+// later added back (undo/redo) returns to its original z position.
+class ShapeRegistry
+{
+public:
+	// Shapes in draw order (bottom to top), keyed by z
+	typedef std::map<unsigned int, std::shared_ptr<Shape>> Order;
+	
+	ShapeRegistry();
+	
+	// Add a shape, returns false if it was already in the registry
+	bool Add(const std::shared_ptr<Shape>& shape);
+	// Remove a shape, returns false if it wasn't in the registry
+	bool Remove(const std::shared_ptr<Shape>& shape);
+	// Returns true if the shape is currently in the registry
+	bool Contains(const std::shared_ptr<Shape>& shape) const;
+	// Returns the live shape with the given ID, or nullptr
+	std::shared_ptr<Shape> Get(ShapeId id) const;
+	// Returns the removed shape with the given ID if something still
+	// holds on to it, or nullptr
+	std::shared_ptr<Shape> GetRemoved(ShapeId id) const;
+	// Gives the ID of a removed shape that no longer exists to shape, a
+	// copy of it, so adding shape puts it back where the original was.
+	// Returns false if the ID isn't one of a destroyed shape.
+	bool Rebind(ShapeId id, const std::shared_ptr<Shape>& shape);
+	// Returns the z value of a shape that has been added at least once
+	unsigned int GetZ(const std::shared_ptr<Shape>& shape) const;
+	// Stops counting the memory of a removed shape once nothing holds it
+	// anymore; call after letting go of one
+	void Release(ShapeId id);
+	// Bytes held by removed shapes that something still holds, which is
+	// the undo history
+	size_t GetRemovedMemoryUsage() const { return mRemovedBytes; }
+	
+	const Order& GetOrder() const { return mOrder; }
+	
+	size_t GetCount() const { return mOrder.size(); }
+	// Makes room for count more new shapes
+	void Reserve(size_t count) { mSlots.reserve(mSlots.size() + count); }
+	
+	// ID the next new shape gets
+	ShapeId GetNextId() const { return static_cast<ShapeId>(mSlots.size()); }
+	
+	void Clear();
+	// Starts over with the IDs below count taken by shapes that have been
+	// removed and destroyed, so shapes can be given them again with Rebind
+	void Reset(ShapeId count);
+private:
+	struct Slot
+	{
+		// Identity of the shape owning this ID, even while it's removed
+		std::weak_ptr<Shape> mShape;
+		unsigned int mZ;
+		bool mLive;
+		// Bytes counted in mRemovedBytes for the shape, while it's removed
+		size_t mBytes;
+	};
+	
+	const Slot* GetSlot(const std::shared_ptr<Shape>& shape) const;
+	
+	// Indexed by ShapeId; IDs are never reused within a document
+	std::vector<Slot> mSlots;
+	// Live shapes in z-order
+	Order mOrder;
+	// Z value handed to the next new shape
+	unsigned int mNextZ;
+	size_t mRemovedBytes;
+};
@@ -0,0 +1,440 @@
+#include "SoftwareRenderer.h"
+#include "Shape.h"
+#include <algorithm>
+#include <cmath>
+
+#if defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define PAINT_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+namespace
+{
+	// Scalar source-over of one 8-bit channel
+	inline unsigned int BlendChannel(unsigned int src, unsigned int dst, unsigned int alpha)
+	{
+		unsigned int value = src * alpha + dst * (255 - alpha) + 128;
+		return (value + (value >> 8)) >> 8;
+	}
+	
+	void FillPixels(uint32_t* dest, int count, uint32_t pixel)
+	{
+#ifdef PAINT_USE_SSE2
+		__m128i fill = _mm_set1_epi32(static_cast<int>(pixel));
+		for (; count >= 4; count -= 4, dest += 4)
+		{
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), fill);
+		}
+#endif
+		for (; count > 0; count--)
+		{
+			*dest++ = pixel;
+		}
+	}
+	
+	// pixel must already have its alpha byte set to 255, so that the
+	// destination alpha comes out as alpha + dst * (1 - alpha)
+	void BlendPixels(uint32_t* dest, int count, uint32_t pixel, unsigned int alpha)
+	{
+#ifdef PAINT_USE_SSE2
+		const __m128i zero = _mm_setzero_si128();
+		const __m128i round = _mm_set1_epi16(128);
+		const __m128i inverse = _mm_set1_epi16(static_cast<short>(255 - alpha));
+		// Source times alpha for two pixels, as 16-bit lanes
+		__m128i source = _mm_unpacklo_epi8(_mm_set1_epi32(static_cast<int>(pixel)), zero);
+		source = _mm_mullo_epi16(source, _mm_set1_epi16(static_cast<short>(alpha)));
+		source = _mm_add_epi16(source, round);
+		for (; count >= 4; count -= 4, dest += 4)
+		{
+			__m128i dst = _mm_loadu_si128(reinterpret_cast<const __m128i*>(dest));
+			__m128i lo = _mm_unpacklo_epi8(dst, zero);
+			__m128i hi = _mm_unpackhi_epi8(dst, zero);
+			lo = _mm_add_epi16(_mm_mullo_epi16(lo, inverse), source);
+			hi = _mm_add_epi16(_mm_mullo_epi16(hi, inverse), source);
+			lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+			hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+			_mm_storeu_si128(reinterpret_cast<__m128i*>(dest), _mm_packus_epi16(lo, hi));
+		}
+#endif
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(&pixel);
+		for (; count > 0; count--, dest++)
+		{
+			unsigned char* dst = reinterpret_cast<unsigned char*>(dest);
+			for (int i = 0; i < 4; i++)
+			{
+				dst[i] = static_cast<unsigned char>(BlendChannel(src[i], dst[i], alpha));
+			}
+		}
+	}
+	
+	// Half-open pixel range covered by [lo, hi) on a row or column
+	inline void ToPixelRange(double lo, double hi, int& first, int& last)
+	{
+		first = static_cast<int>(std::ceil(lo));
+		last = static_cast<int>(std::ceil(hi)) - 1;
+	}
+	
+	// Narrows [lo, hi] to the x values where lo <= slope * x + constant <= hi
+	void Constrain(double slope, double constant, double lo, double hi, double& xMin, double& xMax)
+	{
+		if (std::fabs(slope) < 1e-12)
+		{
+			if (constant < lo || constant > hi)
+			{
+				xMin = 1.0;
+				xMax = 0.0;
+			}
+			return;
+		}
+		double a = (lo - constant) / slope;
+		double b = (hi - constant) / slope;
+		xMin = std::max(xMin, std::min(a, b));
+		xMax = std::min(xMax, std::max(a, b));
+	}
+	
+	// Horizontal extent of the ellipse with the given radii on row dy
+	// (relative to its centre); false if the row misses it
+	bool EllipseRow(double radiusX, double radiusY, double dy, double& halfWidth)
+	{
+		if (radiusX <= 0.0 || radiusY <= 0.0 || std::fabs(dy) > radiusY)
+		{
+			return false;
+		}
+		double t = dy / radiusY;
+		halfWidth = radiusX * std::sqrt(1.0 - t * t);
+		return true;
+	}
+	
+	// Colour with its alpha forced to opaque, as BlendPixels expects; the
+	// real alpha is passed alongside
+	inline uint32_t SourcePixel(const wxColour& colour)
+	{
+		return RasterImage::ToPixel(wxColour(colour.Red(), colour.Green(), colour.Blue()));
+	}
+}
+
+RasterStyle::RasterStyle()
+: mPenPixel(0)
+, mPenAlpha(0)
+, mPenWidth(1)
+, mBrushPixel(0)
+, mBrushAlpha(0)
+{
+	
+}
+
+RasterStyle::RasterStyle(const wxPen& pen, const wxBrush& brush)
+: mPenPixel(SourcePixel(pen.GetColour()))
+, mPenAlpha(pen.IsTransparent() ? 0 : pen.GetColour().Alpha())
+, mPenWidth(std::max(pen.GetWidth(), 1))
+, mBrushPixel(SourcePixel(brush.GetColour()))
+, mBrushAlpha(brush.IsTransparent() ? 0 : brush.GetColour().Alpha())
+{
+	
+}
+
+SoftwareRenderer::SoftwareRenderer(RasterImage& target)
+: mTarget(target)
+, mClip(0, 0, target.GetWidth(), target.GetHeight())
+{
+	
+}
+
+void SoftwareRenderer::SetClip(const wxRect& clip)
+{
+	mClip = clip.Intersect(wxRect(0, 0, mTarget.GetWidth(), mTarget.GetHeight()));
+}
+
+void SoftwareRenderer::Clear(const wxColour& colour)
+{
+	uint32_t pixel = RasterImage::ToPixel(colour);
+	for (int y = mClip.GetTop(); y <= mClip.GetBottom(); y++)
+	{
+		FillPixels(mTarget.GetRow(y) + mClip.x, mClip.width, pixel);
+	}
+}
+
+void SoftwareRenderer::FillSpan(int y, int x0, int x1, uint32_t pixel, unsigned int alpha)
+{
+	if (y < mClip.GetTop() || y > mClip.GetBottom())
+	{
+		return;
+	}
+	x0 = std::max(x0, mClip.GetLeft());
+	x1 = std::min(x1, mClip.GetRight());
+	if (x0 > x1)
+	{
+		return;
+	}
+	
+	uint32_t* dest = mTarget.GetRow(y) + x0;
+	if (alpha == 255)
+	{
+		FillPixels(dest, x1 - x0 + 1, pixel);
+	}
+	else if (alpha != 0)
+	{
+		BlendPixels(dest, x1 - x0 + 1, pixel, alpha);
+	}
+}
+
+void SoftwareRenderer::DrawShape(const Shape& shape, const StyleTable& styles)
+{
+	DrawShape(shape, RasterStyle(styles.GetPen(shape.GetStyle()), styles.GetBrush(shape.GetStyle())));
+}
+
+void SoftwareRenderer::DrawShape(const Shape& shape, const RasterStyle& style)
+{
+	wxPoint topLeft;
+	wxPoint botRight;
+	shape.GetBounds(topLeft, botRight);
+	switch (shape.GetKind())
+	{
+		case SK_Rect:
+			DrawRectangle(wxRect(topLeft, botRight), style);
+			break;
+		case SK_Ellipse:
+			DrawEllipse(wxRect(topLeft, botRight), style);
+			break;
+		case SK_Line:
+		{
+			wxPoint start;
+			wxPoint end;
+			static_cast<const LineShape&>(shape).GetEndpoints(start, end);
+			DrawLine(start, end, style);
+			break;
+		}
+		case SK_Pencil:
+		{
+			const PencilShape& pencil = static_cast<const PencilShape&>(shape);
+			DrawPencil(pencil.GetPoints(), pencil.GetOffset(), style);
+			break;
+		}
+	}
+}
+
+void SoftwareRenderer::DrawRectangle(const wxRect& rect, const RasterStyle& style)
+{
+	int left = rect.GetLeft();
+	int top = rect.GetTop();
+	int right = rect.GetRight();
+	int bottom = rect.GetBottom();
+	bool stroke = style.mPenAlpha != 0;
+	
+	if (style.mBrushAlpha != 0)
+	{
+		// The brush covers the inside of the 1 pixel outline, or the
+		// whole rectangle if there is no outline
+		int inset = stroke ? 1 : 0;
+		for (int y = top + inset; y <= bottom - inset; y++)
+		{
+			FillSpan(y, left + inset, right - inset, style.mBrushPixel, style.mBrushAlpha);
+		}
+	}
+	
+	if (stroke)
+	{
+		// The pen is centred on the edge pixels. Walk the rows once so
+		// corners and thin rectangles aren't blended twice.
+		int outer = (style.mPenWidth - 1) / 2;
+		int inner = style.mPenWidth - 1 - outer;
+		uint32_t pixel = style.mPenPixel;
+		unsigned int alpha = style.mPenAlpha;
+		for (int y = top - outer; y <= bottom + outer; y++)
+		{
+			if (y <= top + inner || y >= bottom - inner)
+			{
+				FillSpan(y, left - outer, right + outer, pixel, alpha);
+			}
+			else if (left + inner + 1 >= right - inner)
+			{
+				FillSpan(y, left - outer, right + outer, pixel, alpha);
+			}
+			else
+			{
+				FillSpan(y, left - outer, left + inner, pixel, alpha);
+				FillSpan(y, right - inner, right + outer, pixel, alpha);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::DrawEllipse(const wxRect& rect, const RasterStyle& style)
+{
+	// Work with pixel centres, so the edge pixels of rect sit on the ellipse
+	double centerX = rect.x + (rect.width - 1) / 2.0;
+	double centerY = rect.y + (rect.height - 1) / 2.0;
+	double radiusX = (rect.width - 1) / 2.0;
+	double radiusY = (rect.height - 1) / 2.0;
+	bool stroke = style.mPenAlpha != 0;
+	double penRadius = stroke ? style.mPenWidth / 2.0 : 0.0;
+	
+	int firstRow;
+	int lastRow;
+	ToPixelRange(centerY - radiusY - penRadius, centerY + radiusY + penRadius, firstRow, lastRow);
+	for (int y = firstRow; y <= lastRow; y++)
+	{
+		double dy = y - centerY;
+		double halfWidth;
+		int innerFirst = 0;
+		int innerLast = -1;
+		// Everything within the ellipse, shrunk by half the pen if the
+		// pen is going to be drawn over the edge
+		if (EllipseRow(radiusX - penRadius, radiusY - penRadius, dy, halfWidth))
+		{
+			ToPixelRange(centerX - halfWidth, centerX + halfWidth, innerFirst, innerLast);
+			if (!stroke)
+			{
+				// Without an outline the fill reaches the bounding pixels
+				innerFirst = static_cast<int>(std::floor(centerX - halfWidth + 0.5));
+				innerLast = static_cast<int>(std::ceil(centerX + halfWidth - 0.5));
+			}
+			FillSpan(y, innerFirst, innerLast, style.mBrushPixel, style.mBrushAlpha);
+		}
+		if (stroke && EllipseRow(radiusX + penRadius, radiusY + penRadius, dy, halfWidth))
+		{
+			int outerFirst;
+			int outerLast;
+			ToPixelRange(centerX - halfWidth, centerX + halfWidth, outerFirst, outerLast);
+			if (innerFirst > innerLast)
+			{
+				FillSpan(y, outerFirst, outerLast, style.mPenPixel, style.mPenAlpha);
+			}
+			else
+			{
+				FillSpan(y, outerFirst, innerFirst - 1, style.mPenPixel, style.mPenAlpha);
+				FillSpan(y, innerLast + 1, outerLast, style.mPenPixel, style.mPenAlpha);
+			}
+		}
+	}
+}
+
+void SoftwareRenderer::DrawLine(const wxPoint& from, const wxPoint& to, const RasterStyle& style)
+{
+	if (style.mPenAlpha != 0)
+	{
+		StrokeSegment(from, to, style.mPenWidth / 2.0, style.mPenPixel, style.mPenAlpha);
+	}
+}
+
+void SoftwareRenderer::DrawLines(int count, const wxPoint* points, const wxPoint& offset, const RasterStyle& style)
+{
+	if (style.mPenAlpha == 0 || count < 1)
+	{
+		return;
+	}
+	double radius = style.mPenWidth / 2.0;
+	if (count == 1)
+	{
+		StrokeSegment(points[0] + offset, points[0] + offset, radius, style.mPenPixel, style.mPenAlpha);
+	}
+	for (int i = 1; i < count; i++)
+	{
+		StrokeSegment(points[i - 1] + offset, points[i] + offset, radius, style.mPenPixel, style.mPenAlpha);
+	}
+}
+
+void SoftwareRenderer::DrawPencil(const PointStream& points, const wxPoint& offset, const RasterStyle& style)
+{
+	// Decode in batches like PencilShape::DrawPoints, carrying the last
+	// point over so the segments stay connected
+	const size_t BATCH_SIZE = 256;
+	wxPoint batch[BATCH_SIZE];
+	PointStream::Reader reader(points);
+	size_t count = reader.Read(batch, BATCH_SIZE);
+	if (count == 1)
+	{
+		DrawLines(1, batch, offset, style);
+	}
+	while (count > 1)
+	{
+		DrawLines(static_cast<int>(count), batch, offset, style);
+		batch[0] = batch[count - 1];
+		count = 1 + reader.Read(batch + 1, BATCH_SIZE - 1);
+	}
+}
+
+void SoftwareRenderer::StrokeSegment(const wxPoint& from, const wxPoint& to, double radius,
+	uint32_t pixel, unsigned int alpha)
+{
+	// The stroke is every point within radius of the segment: a rectangle
+	// along the segment plus a disc at each end. That shape is convex, so
+	// each row of it is the union of the rows of the three parts.
+	double dx = to.x - from.x;
+	double dy = to.y - from.y;
+	double length = std::sqrt(dx * dx + dy * dy);
+	double ux = length > 0.0 ? dx / length : 0.0;
+	double uy = length > 0.0 ? dy / length : 0.0;
+	
+	int firstRow;
+	int lastRow;
+	ToPixelRange(std::min(from.y, to.y) - radius, std::max(from.y, to.y) + radius, firstRow, lastRow);
+	firstRow = std::max(firstRow, mClip.GetTop());
+	lastRow = std::min(lastRow, mClip.GetBottom());
+	for (int y = firstRow; y <= lastRow; y++)
+	{
+		double xMin = 1e300;
+		double xMax = -1e300;
+		const wxPoint* ends[2] = { &from, &to };
+		for (auto end : ends)
+		{
+			double halfWidth;
+			if (EllipseRow(radius, radius, y - end->y, halfWidth))
+			{
+				xMin = std::min(xMin, end->x - halfWidth);
+				xMax = std::max(xMax, end->x + halfWidth);
+			}
+		}
+		if (length > 0.0)
+		{
+			// Position along the segment in [0, length] and distance
+			// across it in [-radius, radius], both linear in x
+			double bodyMin = -1e300;
+			double bodyMax = 1e300;
+			double ry = y - from.y;
+			Constrain(ux, ry * uy - from.x * ux, 0.0, length, bodyMin, bodyMax);
+			Constrain(-uy, ry * ux + from.x * uy, -radius, radius, bodyMin, bodyMax);
+			if (bodyMin <= bodyMax)
+			{
+				xMin = std::min(xMin, bodyMin);
+				xMax = std::max(xMax, bodyMax);
+			}
+		}
+		
+		if (xMin > xMax)
+		{
+			continue;
+		}
+		int x0;
+		int x1;
+		ToPixelRange(std::max(xMin, mClip.GetLeft() - 1.0), std::min(xMax, mClip.GetRight() + 1.0), x0, x1);
+		FillSpan(y, x0, x1, pixel, alpha);
+	}
+}
+
+void SoftwareRenderer::DrawImage(const wxImage& image, const wxPoint& position)
+{
+	RasterImage raster;
+	raster.Assign(image);
+	DrawImage(raster, position);
+}
+
+void SoftwareRenderer::DrawImage(const RasterImage& image, const wxPoint& position)
+{
+	wxRect area = wxRect(position.x, position.y, image.GetWidth(), image.GetHeight()).Intersect(mClip);
+	for (int y = area.GetTop(); y <= area.GetBottom(); y++)
+	{
+		const unsigned char* src = reinterpret_cast<const unsigned char*>(
+			image.GetRow(y - position.y) + (area.x - position.x));
+		unsigned char* dest = reinterpret_cast<unsigned char*>(mTarget.GetRow(y) + area.x);
+		for (int x = 0; x < area.width; x++, src += 4, dest += 4)
+		{
+			unsigned int alpha = src[3];
+			for (int i = 0; i < 3; i++)
+			{
+				dest[i] = static_cast<unsigned char>(BlendChannel(src[i], dest[i], alpha));
+			}
+			dest[3] = static_cast<unsigned char>(BlendChannel(255, dest[3], alpha));
+		}
+	}
+}
@@ -0,0 +1,51 @@
+#include "SpillFile.h"
+#include <wx/filefn.h>
+#include <wx/filename.h>
+
+SpillFile::SpillFile()
+: mSize(0)
+{
+}
+
+SpillFile::~SpillFile()
+{
+	mFile.Close();
+	if (!mName.empty())
+	{
+		wxRemoveFile(mName);
+	}
+}
+
+bool SpillFile::Append(const std::vector<unsigned char>& record, uint64_t& offset)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	if (!mFile.IsOpened())
+	{
+		mName = wxFileName::CreateTempFileName("paint-history");
+		if (mName.empty() || !mFile.Open(mName, wxFile::read_write))
+		{
+			return false;
+		}
+	}
+	if (mFile.Seek(mSize) == wxInvalidOffset || mFile.Write(record.data(), record.size()) != record.size())
+	{
+		return false;
+	}
+	offset = mSize;
+	mSize += record.size();
+	return true;
+}
+
+bool SpillFile::Read(uint64_t offset, uint32_t size, std::vector<unsigned char>& record)
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	record.resize(size);
+	return offset <= mSize && size <= mSize - offset && mFile.Seek(offset) != wxInvalidOffset &&
+		mFile.Read(record.data(), record.size()) == static_cast<ssize_t>(record.size());
+}
+
+uint64_t SpillFile::GetSize() const
+{
+	std::lock_guard<std::mutex> lock(mMutex);
+	return mSize;
+}
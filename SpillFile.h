@@ -0,0 +1,35 @@
+#pragma once
+#include <cstdint>
+#include <mutex>
+#include <vector>
+#include <wx/file.h>
+#include <wx/string.h>
+
+// Temporary file of records that are appended and read back by where they
+// start. A record never moves once it's written, so whoever wrote it can
+// keep its offset for as long as the file is open. The file is created on
+// the first append and removed when this is destroyed. Records can be read
+// on any thread, while others are appended.
+class SpillFile
+{
+public:
+	SpillFile();
+	// Removes the file
+	~SpillFile();
+	// Appends record and puts where it starts in offset
+	bool Append(const std::vector<unsigned char>& record, uint64_t& offset);
+	// Reads size bytes at offset into record
+	bool Read(uint64_t offset, uint32_t size, std::vector<unsigned char>& record);
+	// Bytes appended so far
+	uint64_t GetSize() const;
+
+	// Disallow copy/assignment
+	SpillFile(const SpillFile&) = delete;
+	SpillFile& operator=(const SpillFile&) = delete;
+private:
+	wxFile mFile;
+	wxString mName;
+	uint64_t mSize;
+	// Seeking and reading or writing go together
+	mutable std::mutex mMutex;
+};
@@ -0,0 +1,37 @@
+#include "StyleTable.h"
+
+StyleTable::StyleTable()
+{
+	Clear();
+}
+
+StyleId StyleTable::Intern(const wxPen& pen, const wxBrush& brush)
+{
+	Key key = GetKey(pen, brush);
+	auto iter = mLookup.find(key);
+	if (iter != mLookup.end())
+	{
+		return iter->second;
+	}
+	
+	Style style;
+	style.mPen = pen;
+	style.mBrush = brush;
+	StyleId id = static_cast<StyleId>(mStyles.size());
+	mStyles.push_back(style);
+	mLookup.emplace(key, id);
+	return id;
+}
+
+void StyleTable::Clear()
+{
+	mStyles.clear();
+	mLookup.clear();
+	Intern(*wxBLACK_PEN, *wxWHITE_BRUSH);
+}
+
+StyleTable::Key StyleTable::GetKey(const wxPen& pen, const wxBrush& brush)
+{
+	return Key(pen.GetColour().GetRGBA(), pen.GetWidth(), pen.GetStyle(),
+		brush.GetColour().GetRGBA(), brush.GetStyle());
+}
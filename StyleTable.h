@@ -0,0 +1,47 @@
+#pragma once
+#include <deque>
+#include <map>
+#include <tuple>
+#include <wx/pen.h>
+#include <wx/brush.h>
+
+// Handle to an interned pen/brush combination
+typedef unsigned int StyleId;
+
+// Interns every unique pen/brush combination used in a document, so shapes
+// and commands can refer to a style with a small integer. Two shapes share
+// a style exactly when their handles are equal.
+class StyleTable
+{
+public:
+	// Style every new document starts with (black pen, white brush)
+	static const StyleId DEFAULT_STYLE = 0;
+	
+	StyleTable();
+	
+	// Returns the handle for the combination, adding it if it's new
+	StyleId Intern(const wxPen& pen, const wxBrush& brush);
+	
+	const wxPen& GetPen(StyleId style) const { return mStyles[style].mPen; }
+	
+	const wxBrush& GetBrush(StyleId style) const { return mStyles[style].mBrush; }
+	
+	size_t GetCount() const { return mStyles.size(); }
+	// Drop every style except the default one
+	void Clear();
+private:
+	struct Style
+	{
+		wxPen mPen;
+		wxBrush mBrush;
+	};
+	
+	typedef std::tuple<unsigned int, int, int, unsigned int, int> Key;
+	
+	static Key GetKey(const wxPen& pen, const wxBrush& brush);
+	
+	// Indexed by StyleId; a deque so references stay valid as it grows
+	std::deque<Style> mStyles;
+	// Handle for each unique combination
+	std::map<Key, StyleId> mLookup;
+};
@@ -0,0 +1,106 @@
+#include "TileRenderer.h"
+#include "Profiler.h"
+#include "PaintModel.h"
+#include <algorithm>
+#include <thread>
+
+TileRenderer::TileRenderer(int tileSize, unsigned int threadCount)
+: mTileSize(std::max(tileSize, 16))
+, mThreadCount(threadCount)
+{
+	if (mThreadCount == 0)
+	{
+		mThreadCount = std::max(std::thread::hardware_concurrency(), 1u);
+	}
+}
+
+void TileRenderer::Render(PaintModel& model, RasterImage& target)
+{
+	RenderSnapshot snapshot;
+	snapshot.Capture(model, wxSize(target.GetWidth(), target.GetHeight()));
+	Render(snapshot, target);
+}
+
+bool TileRenderer::Render(const RenderSnapshot& snapshot, RasterImage& target,
+	const std::atomic<bool>* cancel, ProgressFunc progress)
+{
+	PROFILE_SCOPE("TileRenderer::Render");
+	if (!target.IsOk())
+	{
+		return true;
+	}
+	
+	int columns = (target.GetWidth() + mTileSize - 1) / mTileSize;
+	int rows = (target.GetHeight() + mTileSize - 1) / mTileSize;
+	wxRect canvas(0, 0, target.GetWidth(), target.GetHeight());
+	std::vector<Tile> tiles(static_cast<size_t>(columns) * rows);
+	for (int row = 0; row < rows; row++)
+	{
+		for (int column = 0; column < columns; column++)
+		{
+			wxRect rect(column * mTileSize, row * mTileSize, mTileSize, mTileSize);
+			tiles[row * columns + column].mRect = rect.Intersect(canvas);
+		}
+	}
+	
+	// Bin in draw order, so every tile's list is already sorted by z
+	for (size_t i = 0; i < snapshot.GetCount(); i++)
+	{
+		wxRect bounds = snapshot.GetBounds(i).Intersect(canvas);
+		if (bounds.IsEmpty())
+		{
+			continue;
+		}
+		for (int row = bounds.GetTop() / mTileSize; row <= bounds.GetBottom() / mTileSize; row++)
+		{
+			for (int column = bounds.GetLeft() / mTileSize; column <= bounds.GetRight() / mTileSize; column++)
+			{
+				tiles[row * columns + column].mItems.push_back(i);
+			}
+		}
+	}
+	
+	std::atomic<size_t> nextTile(0);
+	std::atomic<size_t> doneTiles(0);
+	auto worker = [&]()
+	{
+		for (size_t i = nextTile++; i < tiles.size(); i = nextTile++)
+		{
+			if (cancel != nullptr && *cancel)
+			{
+				return;
+			}
+			RenderTile(snapshot, tiles[i], target);
+			size_t done = ++doneTiles;
+			if (progress)
+			{
+				progress(done, tiles.size());
+			}
+		}
+	};
+	
+	unsigned int threadCount = static_cast<unsigned int>(std::min<size_t>(mThreadCount, tiles.size()));
+	std::vector<std::thread> threads;
+	for (unsigned int i = 1; i < threadCount; i++)
+	{
+		threads.push_back(std::thread(worker));
+	}
+	// The calling thread takes tiles too
+	worker();
+	for (auto& thread : threads)
+	{
+		thread.join();
+	}
+	return doneTiles == tiles.size();
+}
+
+void TileRenderer::RenderTile(const RenderSnapshot& snapshot, const Tile& tile, RasterImage& target)
+{
+	SoftwareRenderer renderer(target);
+	renderer.SetClip(tile.mRect);
+	snapshot.DrawBackground(renderer);
+	for (auto index : tile.mItems)
+	{
+		snapshot.DrawItem(renderer, index);
+	}
+}
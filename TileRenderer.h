@@ -0,0 +1,47 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <vector>
+#include <wx/gdicmn.h>
+#include "RasterImage.h"
+#include "RenderSnapshot.h"
+
+class PaintModel;
+
+// Renders a model into a RasterImage on several threads. The target is
+// cut into square tiles and each shape is binned into the tiles its
+// bounds touch; workers then take tiles off a shared counter and draw
+// their shapes in z-order. Tiles don't overlap, so each one is drawn
+// straight into its part of the target and the result is the same as
+// drawing everything on one thread.
+class TileRenderer
+{
+public:
+	// Called with the number of finished tiles and the total, from
+	// whichever thread finished the tile
+	typedef std::function<void(size_t, size_t)> ProgressFunc;
+	
+	// threadCount 0 uses one thread per hardware core
+	TileRenderer(int tileSize = 256, unsigned int threadCount = 0);
+	// Snapshots the model and renders it, blocking until every tile is
+	// drawn. Call on the UI thread.
+	void Render(PaintModel& model, RasterImage& target);
+	// Renders a snapshot; safe to call from any thread. Stops early and
+	// returns false once cancel becomes true.
+	bool Render(const RenderSnapshot& snapshot, RasterImage& target,
+		const std::atomic<bool>* cancel = nullptr, ProgressFunc progress = ProgressFunc());
+	
+	unsigned int GetThreadCount() const { return mThreadCount; }
+private:
+	struct Tile
+	{
+		wxRect mRect;
+		// Snapshot items, lowest z first
+		std::vector<size_t> mItems;
+	};
+	
+	static void RenderTile(const RenderSnapshot& snapshot, const Tile& tile, RasterImage& target);
+	
+	int mTileSize;
+	unsigned int mThreadCount;
+};
@@ -0,0 +1,347 @@
+#include "TiledImage.h"
+#include "SoftwareRenderer.h"
+#include <algorithm>
+#include <wx/filename.h>
+#include <wx/filefn.h>
+
+namespace
+{
+	// Bytes per pixel in the page file (8-bit RGB)
+	const int PIXEL_SIZE = 3;
+}
+
+// std::min takes these by reference
+const int TiledImage::TILE_SIZE;
+const size_t TiledImage::MAX_CACHED_TILES;
+
+TiledImage::TiledImage()
+: mWidth(0)
+, mHeight(0)
+, mPageFileSize(0)
+{
+
+}
+
+TiledImage::~TiledImage()
+{
+	if (!mPageFileName.IsEmpty())
+	{
+		mPageFile.Close();
+		wxRemoveFile(mPageFileName);
+	}
+}
+
+bool TiledImage::Create(const wxImage& image, const std::atomic<bool>* cancel, ProgressFunc progress)
+{
+	if (!image.IsOk() || !mLevels.empty())
+	{
+		return false;
+	}
+	mWidth = image.GetWidth();
+	mHeight = image.GetHeight();
+
+	// Halve until everything fits in one tile
+	size_t total = 0;
+	int width = mWidth;
+	int height = mHeight;
+	while (true)
+	{
+		Level level;
+		level.mWidth = width;
+		level.mHeight = height;
+		level.mColumns = (width + TILE_SIZE - 1) / TILE_SIZE;
+		level.mRows = (height + TILE_SIZE - 1) / TILE_SIZE;
+		size_t tiles = static_cast<size_t>(level.mColumns) * level.mRows;
+		level.mOffsets.reserve(tiles);
+		total += tiles;
+		mLevels.push_back(level);
+		if (width <= TILE_SIZE && height <= TILE_SIZE)
+		{
+			break;
+		}
+		width = (width + 1) / 2;
+		height = (height + 1) / 2;
+	}
+
+	mPageFileName = wxFileName::CreateTempFileName("paint", &mPageFile);
+	bool ok = !mPageFileName.IsEmpty() && mPageFile.IsOpened();
+
+	// Full size tiles come straight from the image; every other level is
+	// filtered from the tiles just written for the level above it
+	size_t done = 0;
+	TileData data;
+	const unsigned char* pixels = image.GetData();
+	for (size_t index = 0; ok && index < mLevels.size(); index++)
+	{
+		Level& level = mLevels[index];
+		for (int row = 0; ok && row < level.mRows; row++)
+		{
+			for (int column = 0; ok && column < level.mColumns; column++)
+			{
+				if (cancel != nullptr && *cancel)
+				{
+					ok = false;
+					break;
+				}
+				if (index == 0)
+				{
+					wxSize size = GetTileSize(level, column, row);
+					size_t rowSize = static_cast<size_t>(size.GetWidth()) * PIXEL_SIZE;
+					data.resize(rowSize * size.GetHeight());
+					for (int y = 0; y < size.GetHeight(); y++)
+					{
+						size_t source = (static_cast<size_t>(row * TILE_SIZE + y) * mWidth +
+							static_cast<size_t>(column) * TILE_SIZE) * PIXEL_SIZE;
+						std::copy(pixels + source, pixels + source + rowSize, data.begin() + y * rowSize);
+					}
+				}
+				else
+				{
+					Downsample(static_cast<int>(index), column, row, data);
+				}
+				ok = WriteTile(level, data);
+				done++;
+				if (progress)
+				{
+					progress(done, total);
+				}
+			}
+		}
+	}
+
+	if (!ok)
+	{
+		mLevels.clear();
+		if (!mPageFileName.IsEmpty())
+		{
+			mPageFile.Close();
+			wxRemoveFile(mPageFileName);
+			mPageFileName.Clear();
+		}
+		mPageFileSize = 0;
+	}
+	return ok;
+}
+
+wxSize TiledImage::GetTileSize(const Level& level, int column, int row) const
+{
+	return wxSize(std::min(TILE_SIZE, level.mWidth - column * TILE_SIZE),
+		std::min(TILE_SIZE, level.mHeight - row * TILE_SIZE));
+}
+
+bool TiledImage::WriteTile(Level& level, const TileData& data)
+{
+	// Reads while building the levels move the file position
+	if (mPageFile.Seek(mPageFileSize) != mPageFileSize ||
+		mPageFile.Write(data.data(), data.size()) != data.size())
+	{
+		return false;
+	}
+	level.mOffsets.push_back(mPageFileSize);
+	mPageFileSize += static_cast<wxFileOffset>(data.size());
+	return true;
+}
+
+bool TiledImage::ReadTile(int levelIndex, int column, int row, TileData& data)
+{
+	const Level& level = mLevels[levelIndex];
+	wxSize size = GetTileSize(level, column, row);
+	data.resize(static_cast<size_t>(size.GetWidth()) * size.GetHeight() * PIXEL_SIZE);
+	wxFileOffset offset = level.mOffsets[static_cast<size_t>(row) * level.mColumns + column];
+	return mPageFile.Seek(offset) == offset &&
+		mPageFile.Read(data.data(), data.size()) == static_cast<ssize_t>(data.size());
+}
+
+void TiledImage::Downsample(int levelIndex, int column, int row, TileData& data)
+{
+	const Level& above = mLevels[levelIndex - 1];
+	wxSize size = GetTileSize(mLevels[levelIndex], column, row);
+	data.assign(static_cast<size_t>(size.GetWidth()) * size.GetHeight() * PIXEL_SIZE, 255);
+
+	// Gather the source tiles into one block twice the size
+	int sourceWidth = std::min(2 * TILE_SIZE, above.mWidth - 2 * column * TILE_SIZE);
+	int sourceHeight = std::min(2 * TILE_SIZE, above.mHeight - 2 * row * TILE_SIZE);
+	TileData source(static_cast<size_t>(sourceWidth) * sourceHeight * PIXEL_SIZE, 255);
+	TileData tile;
+	for (int dy = 0; dy < 2 && 2 * row + dy < above.mRows; dy++)
+	{
+		for (int dx = 0; dx < 2 && 2 * column + dx < above.mColumns; dx++)
+		{
+			if (!ReadTile(levelIndex - 1, 2 * column + dx, 2 * row + dy, tile))
+			{
+				continue;
+			}
+			wxSize tileSize = GetTileSize(above, 2 * column + dx, 2 * row + dy);
+			size_t rowSize = static_cast<size_t>(tileSize.GetWidth()) * PIXEL_SIZE;
+			for (int y = 0; y < tileSize.GetHeight(); y++)
+			{
+				size_t target = (static_cast<size_t>(dy * TILE_SIZE + y) * sourceWidth +
+					static_cast<size_t>(dx) * TILE_SIZE) * PIXEL_SIZE;
+				std::copy(tile.begin() + y * rowSize, tile.begin() + (y + 1) * rowSize,
+					source.begin() + target);
+			}
+		}
+	}
+
+	// Average each 2x2 block; odd edges repeat their last row/column
+	for (int y = 0; y < size.GetHeight(); y++)
+	{
+		int y0 = 2 * y;
+		int y1 = std::min(y0 + 1, sourceHeight - 1);
+		for (int x = 0; x < size.GetWidth(); x++)
+		{
+			int x0 = 2 * x;
+			int x1 = std::min(x0 + 1, sourceWidth - 1);
+			const unsigned char* p00 = &source[(static_cast<size_t>(y0) * sourceWidth + x0) * PIXEL_SIZE];
+			const unsigned char* p01 = &source[(static_cast<size_t>(y0) * sourceWidth + x1) * PIXEL_SIZE];
+			const unsigned char* p10 = &source[(static_cast<size_t>(y1) * sourceWidth + x0) * PIXEL_SIZE];
+			const unsigned char* p11 = &source[(static_cast<size_t>(y1) * sourceWidth + x1) * PIXEL_SIZE];
+			unsigned char* out = &data[(static_cast<size_t>(y) * size.GetWidth() + x) * PIXEL_SIZE];
+			for (int c = 0; c < PIXEL_SIZE; c++)
+			{
+				out[c] = static_cast<unsigned char>((p00[c] + p01[c] + p10[c] + p11[c] + 2) / 4);
+			}
+		}
+	}
+}
+
+const wxBitmap& TiledImage::GetTileBitmap(int levelIndex, int column, int row)
+{
+	uint64_t key = MakeKey(levelIndex, column, row);
+	auto iter = mCache.find(key);
+	if (iter != mCache.end())
+	{
+		mCacheUse.splice(mCacheUse.begin(), mCacheUse, iter->second.mUse);
+		return iter->second.mBitmap;
+	}
+
+	if (mCache.size() >= MAX_CACHED_TILES)
+	{
+		mCache.erase(mCacheUse.back());
+		mCacheUse.pop_back();
+	}
+
+	TileData data;
+	if (!ReadTile(levelIndex, column, row, data))
+	{
+		// Better a blank tile than none at all
+		std::fill(data.begin(), data.end(), 255);
+	}
+	wxSize size = GetTileSize(mLevels[levelIndex], column, row);
+	mCacheUse.push_front(key);
+	CachedTile& tile = mCache[key];
+	{
+		// The bitmap copies the pixels, so the image can borrow them
+		wxImage image(size.GetWidth(), size.GetHeight(), data.data(), true);
+		tile.mBitmap = wxBitmap(image);
+	}
+	tile.mUse = mCacheUse.begin();
+	return tile.mBitmap;
+}
+
+int TiledImage::ChooseLevel(double scale) const
+{
+	int index = 0;
+	while (index + 1 < GetLevelCount() && (1 << (index + 1)) * scale <= 1.0)
+	{
+		index++;
+	}
+	return index;
+}
+
+void TiledImage::Draw(wxDC& dc, const wxRect* clip)
+{
+	wxRect area(0, 0, mWidth, mHeight);
+	if (clip != nullptr)
+	{
+		area.Intersect(*clip);
+	}
+	if (!IsOk() || area.IsEmpty())
+	{
+		return;
+	}
+
+	double scaleX;
+	double scaleY;
+	dc.GetUserScale(&scaleX, &scaleY);
+	int levelIndex = ChooseLevel(std::min(scaleX, scaleY));
+	const Level& level = mLevels[levelIndex];
+	// Full size pixels covered by one tile of the level
+	int span = TILE_SIZE << levelIndex;
+	int firstColumn = area.GetLeft() / span;
+	int lastColumn = std::min(area.GetRight() / span, level.mColumns - 1);
+	int firstRow = area.GetTop() / span;
+	int lastRow = std::min(area.GetBottom() / span, level.mRows - 1);
+
+	// Draw the level's tiles in its own coordinates, scaled back up
+	if (levelIndex > 0)
+	{
+		dc.SetUserScale(scaleX * (1 << levelIndex), scaleY * (1 << levelIndex));
+	}
+	for (int row = firstRow; row <= lastRow; row++)
+	{
+		for (int column = firstColumn; column <= lastColumn; column++)
+		{
+			dc.DrawBitmap(GetTileBitmap(levelIndex, column, row),
+				wxPoint(column * TILE_SIZE, row * TILE_SIZE));
+		}
+	}
+	if (levelIndex > 0)
+	{
+		dc.SetUserScale(scaleX, scaleY);
+	}
+}
+
+void TiledImage::Draw(SoftwareRenderer& renderer)
+{
+	wxRect area = renderer.GetClip();
+	area.Intersect(wxRect(0, 0, mWidth, mHeight));
+	RasterImage pixels;
+	Read(area, pixels);
+	if (pixels.IsOk())
+	{
+		renderer.DrawImage(pixels, area.GetTopLeft());
+	}
+}
+
+void TiledImage::Read(const wxRect& rect, RasterImage& target)
+{
+	wxRect area = rect;
+	area.Intersect(wxRect(0, 0, mWidth, mHeight));
+	if (!IsOk() || area.IsEmpty())
+	{
+		target.Create(0, 0);
+		return;
+	}
+	target.Create(area.GetWidth(), area.GetHeight());
+
+	const Level& level = mLevels[0];
+	TileData data;
+	for (int row = area.GetTop() / TILE_SIZE; row <= area.GetBottom() / TILE_SIZE; row++)
+	{
+		for (int column = area.GetLeft() / TILE_SIZE; column <= area.GetRight() / TILE_SIZE; column++)
+		{
+			wxRect tileRect(wxPoint(column * TILE_SIZE, row * TILE_SIZE), GetTileSize(level, column, row));
+			wxRect common = tileRect;
+			common.Intersect(area);
+			if (!ReadTile(0, column, row, data))
+			{
+				std::fill(data.begin(), data.end(), 255);
+			}
+			for (int y = common.GetTop(); y <= common.GetBottom(); y++)
+			{
+				unsigned char* out = reinterpret_cast<unsigned char*>(
+					target.GetRow(y - area.GetTop()) + (common.GetLeft() - area.GetLeft()));
+				const unsigned char* in = &data[(static_cast<size_t>(y - tileRect.GetTop()) *
+					tileRect.GetWidth() + (common.GetLeft() - tileRect.GetLeft())) * PIXEL_SIZE];
+				for (int x = 0; x < common.GetWidth(); x++, out += 4, in += PIXEL_SIZE)
+				{
+					out[0] = in[0];
+					out[1] = in[1];
+					out[2] = in[2];
+					out[3] = 255;
+				}
+			}
+		}
+	}
+}
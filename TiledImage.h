@@ -0,0 +1,119 @@
+#pragma once
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <list>
+#include <unordered_map>
+#include <vector>
+#include <wx/bitmap.h>
+#include <wx/dc.h>
+#include <wx/file.h>
+#include <wx/image.h>
+#include "RasterImage.h"
+
+class SoftwareRenderer;
+
+// Large image stored as fixed size tiles, along with a pyramid of half
+// size levels down to a single tile. The pixels live in a temporary page
+// file; only the tiles that get drawn are read back, and the bitmaps
+// made from them are kept in a bounded LRU cache. Drawing picks the
+// level closest to the DC's scale and only touches the tiles that
+// intersect the area being drawn, so neither memory nor repaint time
+// grows with the size of the image.
+//
+// Create can run on any thread; once the image is handed to the UI
+// thread, everything else must be called from there.
+class TiledImage
+{
+public:
+	// Width and height of a tile, in pixels of its level
+	static const int TILE_SIZE = 256;
+	// Most tile bitmaps kept at once (256KB each as 32-bit bitmaps)
+	static const size_t MAX_CACHED_TILES = 256;
+
+	// Called with the number of tiles written and the total
+	typedef std::function<void(size_t, size_t)> ProgressFunc;
+
+	TiledImage();
+	// Deletes the page file
+	~TiledImage();
+	// Splits image into tiles and builds the levels. Returns false if
+	// the page file couldn't be written or cancel became true
+	bool Create(const wxImage& image, const std::atomic<bool>* cancel = nullptr,
+		ProgressFunc progress = ProgressFunc());
+
+	bool IsOk() const { return !mLevels.empty(); }
+
+	int GetWidth() const { return mWidth; }
+
+	int GetHeight() const { return mHeight; }
+
+	wxSize GetSize() const { return wxSize(mWidth, mHeight); }
+
+	int GetLevelCount() const { return static_cast<int>(mLevels.size()); }
+	// Draws the tiles that intersect clip (in full size image
+	// coordinates) at dc's user scale; null clip means the whole image
+	void Draw(wxDC& dc, const wxRect* clip = nullptr);
+	// Draws the full size pixels inside the renderer's clip
+	void Draw(SoftwareRenderer& renderer);
+	// Copies the full size pixels in rect into target, which is resized
+	// to the part of rect that lies on the image
+	void Read(const wxRect& rect, RasterImage& target);
+
+	// Disallow copy/assignment
+	TiledImage(const TiledImage&) = delete;
+	TiledImage& operator=(const TiledImage&) = delete;
+private:
+	struct Level
+	{
+		int mWidth;
+		int mHeight;
+		int mColumns;
+		int mRows;
+		// Where each tile starts in the page file, row by row
+		std::vector<wxFileOffset> mOffsets;
+	};
+
+	// Tile pixels, tightly packed RGB like wxImage data
+	typedef std::vector<unsigned char> TileData;
+
+	// Size of tile (column, row) of a level, smaller on the right and
+	// bottom edges
+	wxSize GetTileSize(const Level& level, int column, int row) const;
+
+	bool WriteTile(Level& level, const TileData& data);
+
+	bool ReadTile(int levelIndex, int column, int row, TileData& data);
+	// Box filters the (up to) four tiles of the level above that cover
+	// tile (column, row) of levelIndex
+	void Downsample(int levelIndex, int column, int row, TileData& data);
+	// The tile as a bitmap, from the cache if it's there
+	const wxBitmap& GetTileBitmap(int levelIndex, int column, int row);
+	// Coarsest level whose pixels are still no smaller than a device
+	// pixel at scale
+	int ChooseLevel(double scale) const;
+
+	static uint64_t MakeKey(int levelIndex, int column, int row)
+	{
+		return (static_cast<uint64_t>(levelIndex) << 48) |
+			(static_cast<uint64_t>(static_cast<uint32_t>(column) & 0xffffff) << 24) |
+			(static_cast<uint32_t>(row) & 0xffffff);
+	}
+
+	struct CachedTile
+	{
+		wxBitmap mBitmap;
+		std::list<uint64_t>::iterator mUse;
+	};
+
+	int mWidth;
+	int mHeight;
+	// Level 0 is full size, each following one is half the size
+	std::vector<Level> mLevels;
+	wxString mPageFileName;
+	wxFile mPageFile;
+	wxFileOffset mPageFileSize;
+	// Tile bitmaps by key, and their keys from most to least recently used
+	std::unordered_map<uint64_t, CachedTile> mCache;
+	std::list<uint64_t> mCacheUse;
+};
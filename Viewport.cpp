@@ -0,0 +1,79 @@
+#include "Viewport.h"
+#include <algorithm>
+#include <cmath>
+
+namespace
+{
+	const double MIN_ZOOM = 1.0 / 64.0;
+	const double MAX_ZOOM = 32.0;
+}
+
+Viewport::Viewport()
+: mZoom(1.0)
+, mOffset(0, 0)
+{
+
+}
+
+wxPoint Viewport::ToDocument(const wxPoint& point) const
+{
+	return wxPoint(static_cast<int>(std::floor((point.x - mOffset.x) / mZoom)),
+		static_cast<int>(std::floor((point.y - mOffset.y) / mZoom)));
+}
+
+wxPoint Viewport::ToPanel(const wxPoint& point) const
+{
+	return wxPoint(static_cast<int>(std::floor(point.x * mZoom)) + mOffset.x,
+		static_cast<int>(std::floor(point.y * mZoom)) + mOffset.y);
+}
+
+wxRect Viewport::ToDocument(const wxRect& rect) const
+{
+	int left = static_cast<int>(std::floor((rect.x - mOffset.x) / mZoom));
+	int top = static_cast<int>(std::floor((rect.y - mOffset.y) / mZoom));
+	int right = static_cast<int>(std::ceil((rect.x + rect.width - mOffset.x) / mZoom));
+	int bottom = static_cast<int>(std::ceil((rect.y + rect.height - mOffset.y) / mZoom));
+	return wxRect(left, top, right - left, bottom - top);
+}
+
+wxRect Viewport::ToPanel(const wxRect& rect) const
+{
+	int left = static_cast<int>(std::floor(rect.x * mZoom)) + mOffset.x;
+	int top = static_cast<int>(std::floor(rect.y * mZoom)) + mOffset.y;
+	int right = static_cast<int>(std::ceil((rect.x + rect.width) * mZoom)) + mOffset.x;
+	int bottom = static_cast<int>(std::ceil((rect.y + rect.height) * mZoom)) + mOffset.y;
+	return wxRect(left, top, right - left, bottom - top);
+}
+
+void Viewport::SetZoom(double zoom, const wxPoint& anchor)
+{
+	zoom = std::max(MIN_ZOOM, std::min(MAX_ZOOM, zoom));
+	double x = (anchor.x - mOffset.x) / mZoom;
+	double y = (anchor.y - mOffset.y) / mZoom;
+	mZoom = zoom;
+	mOffset.x = static_cast<int>(std::floor(anchor.x - x * mZoom + 0.5));
+	mOffset.y = static_cast<int>(std::floor(anchor.y - y * mZoom + 0.5));
+}
+
+void Viewport::Pan(const wxPoint& delta)
+{
+	mOffset += delta;
+}
+
+void Viewport::SetIdentity()
+{
+	mZoom = 1.0;
+	mOffset = wxPoint(0, 0);
+}
+
+void Viewport::ApplyTo(wxDC& dc) const
+{
+	dc.SetUserScale(mZoom, mZoom);
+	dc.SetDeviceOrigin(mOffset.x, mOffset.y);
+}
+
+void Viewport::ResetDC(wxDC& dc)
+{
+	dc.SetUserScale(1.0, 1.0);
+	dc.SetDeviceOrigin(0, 0);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <wx/dc.h>
+#include <wx/gdicmn.h>
+
+// Maps between document coordinates, which the model and its shapes
+// use, and panel pixels: panel = document * zoom + offset. The offset is
+// kept in whole panel pixels so that panning moves every pixel by the
+// same amount and already rendered pixels can be scrolled instead of
+// redrawn.
+class Viewport
+{
+public:
+	Viewport();
+	// Panel pixels per document pixel
+	double GetZoom() const { return mZoom; }
+	// Panel position of the document origin
+	const wxPoint& GetOffset() const { return mOffset; }
+
+	wxPoint ToDocument(const wxPoint& point) const;
+
+	wxPoint ToPanel(const wxPoint& point) const;
+	// Smallest document rectangle covering every pixel of rect
+	wxRect ToDocument(const wxRect& rect) const;
+	// Smallest panel rectangle covering all of rect
+	wxRect ToPanel(const wxRect& rect) const;
+	// Zooms (clamped to the supported range) keeping the document point
+	// under anchor, in panel pixels, where it is
+	void SetZoom(double zoom, const wxPoint& anchor);
+	// Moves the document by delta panel pixels
+	void Pan(const wxPoint& delta);
+	// Back to 100% with the document origin in the top left corner
+	void SetIdentity();
+	// Sets dc's scale and origin so drawing in document coordinates
+	// lands on the right panel pixels
+	void ApplyTo(wxDC& dc) const;
+	// Back to drawing in panel pixels
+	static void ResetDC(wxDC& dc);
+
+	bool operator==(const Viewport& other) const
+	{
+		return mZoom == other.mZoom && mOffset == other.mOffset;
+	}
+
+	bool operator!=(const Viewport& other) const { return !(*this == other); }
+private:
+	double mZoom;
+	wxPoint mOffset;
+};